@@ -0,0 +1,423 @@
+/*****************************************************************************
+ * archive.c: Append-only, delta-encoded archive of every generation, written
+ * on a background thread and read back through a memory mapping.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "types.h"
+#include "error.h"
+#include "strategy.h"
+#include "population.h"
+#include "archive.h"
+
+
+#define ARCHIVE_MAGIC		"ROBYARCH"
+#define ARCHIVE_VERSION		1
+#define ARCHIVE_RECORD_MAGIC	0x524e4547 /* "GENR" */
+#define ARCHIVE_KEYFRAME_RECORDS	64 /* Every this many records is a keyframe */
+#define ARCHIVE_LITERAL		0xffffffffu /* Diff count of a genome stored in full */
+
+
+/* On-disk file header */
+typedef struct {
+	char     szMagic[8];      /* ARCHIVE_MAGIC, not nul-terminated */
+	uint32_t nVersion;
+	uint32_t cGenes;          /* STRATEGY_LENGTH of the writing build */
+	uint32_t cstg;
+	uint8_t  rgbReserved[44];
+} ARCHIVEHEADER;
+
+
+/*
+ * On-disk generation record header. It is followed by
+ *   double   rgrFitness[cstg];
+ *   int32_t  rgistgParent[cstg];  index in the previous record, or -1
+ *   uint32_t rgcDiffs[cstg];      genes that differ from the parent, or
+ *                                 ARCHIVE_LITERAL
+ * and then each strategy's genes in order: STRATEGY_LENGTH bytes if it is
+ * literal, otherwise one uint32_t per differing gene, (index << 3) | action.
+ * The record is padded to a multiple of 8 bytes.
+ */
+typedef struct {
+	uint32_t nMagic;          /* ARCHIVE_RECORD_MAGIC */
+	uint32_t iGeneration;
+	uint32_t bKeyframe;       /* Every genome is literal */
+	uint32_t nReserved;
+	uint64_t cbRecord;        /* Including this header and the padding */
+} ARCHIVERECORD;
+
+
+/* Writer thread: encodes one snapshot against the previous one and appends
+ * it to the file */
+static void ArchiveWriteSnapshot(ARCHIVE* parch, const ARCHIVESNAPSHOT* psnap) {
+	const int cstg = parch->cstg;
+	bool bKeyframe = parch->cRecords % ARCHIVE_KEYFRAME_RECORDS == 0 ||
+		psnap->iGeneration != parch->iGenerationPrevious + 1;
+
+	ARCHIVERECORD* prec = (ARCHIVERECORD*) parch->pbRecord;
+	double* rgrFitness = (double*)(prec + 1);
+	int32_t* rgistgParent = (int32_t*)(rgrFitness + cstg);
+	uint32_t* rgcDiffs = (uint32_t*)(rgistgParent + cstg);
+	uint8_t* pb = (uint8_t*)(rgcDiffs + cstg);
+	int istg, iact;
+
+	memcpy(rgrFitness, psnap->rgrFitness, sizeof(double) * cstg);
+	memcpy(rgistgParent, psnap->rgistgParent, sizeof(int32_t) * cstg);
+	for (istg = 0; istg < cstg; ++istg) {
+		const uint8_t* rgact = &psnap->rgact[(size_t)istg * STRATEGY_LENGTH];
+		int istgParent = rgistgParent[istg];
+		rgcDiffs[istg] = ARCHIVE_LITERAL;
+		if (!bKeyframe && istgParent >= 0 && istgParent < cstg) {
+			const uint8_t* rgactParent = &parch->rgactPrevious[(size_t)istgParent * STRATEGY_LENGTH];
+			uint32_t* pnDiff = (uint32_t*) pb;
+			const int maxDiffs = STRATEGY_LENGTH / sizeof(uint32_t);
+			int cDiffs = 0;
+			for (iact = 0; iact < STRATEGY_LENGTH && cDiffs < maxDiffs; ++iact) {
+				if (rgact[iact] != rgactParent[iact])
+					pnDiff[cDiffs++] = ((uint32_t)iact << 3) | rgact[iact];
+			}
+			if (iact == STRATEGY_LENGTH) {
+				rgcDiffs[istg] = cDiffs;
+				pb += sizeof(uint32_t) * cDiffs;
+				continue;
+			}
+			/* Too different to be worth a delta */
+		}
+		memcpy(pb, rgact, STRATEGY_LENGTH);
+		pb += STRATEGY_LENGTH;
+	}
+	while ((pb - parch->pbRecord) % 8 != 0)
+		*pb++ = 0;
+
+	prec->nMagic = ARCHIVE_RECORD_MAGIC;
+	prec->iGeneration = psnap->iGeneration;
+	prec->bKeyframe = bKeyframe;
+	prec->nReserved = 0;
+	prec->cbRecord = pb - parch->pbRecord;
+	if (fwrite(parch->pbRecord, prec->cbRecord, 1, parch->pf) != 1)
+		Die("Error writing '%s'", parch->pszFile);
+
+	memcpy(parch->rgactPrevious, psnap->rgact, (size_t)cstg * STRATEGY_LENGTH);
+	parch->iGenerationPrevious = psnap->iGeneration;
+	parch->cRecords++;
+}
+
+
+/* Writer thread: writes queued snapshots in order until the archive is
+ * closed and the queue is empty */
+static void* ArchiveWriter(void* pv) {
+	ARCHIVE* parch = (ARCHIVE*) pv;
+	pthread_mutex_lock(&parch->mutex);
+	for (;;) {
+		while (parch->cQueue == 0 && !parch->bClosing)
+			pthread_cond_wait(&parch->condSnapshot, &parch->mutex);
+		if (parch->cQueue == 0)
+			break;
+		/* The head snapshot stays queued, and so untouched by
+		 * ArchiveAppend, until it has been written */
+		ARCHIVESNAPSHOT* psnap = &parch->rgsnap[parch->iQueueHead];
+		pthread_mutex_unlock(&parch->mutex);
+		ArchiveWriteSnapshot(parch, psnap);
+		pthread_mutex_lock(&parch->mutex);
+		parch->iQueueHead = (parch->iQueueHead + 1) % ARCHIVE_QUEUE_LENGTH;
+		parch->cQueue--;
+		pthread_cond_signal(&parch->condRoom);
+	}
+	pthread_mutex_unlock(&parch->mutex);
+	fflush(parch->pf);
+	return NULL;
+}
+
+
+/* Creates (or truncates) an archive file for populations of cstg strategies
+ * and starts its writer thread */
+ARCHIVE* ArchiveCreate(PCSZ pszFile, int cstg) {
+	ASSERT(pszFile && cstg > 0);
+	ARCHIVE* parch = (ARCHIVE*) malloc(sizeof(ARCHIVE));
+	VerifyAlloc(parch, "archive");
+	parch->pf = fopen(pszFile, "wb");
+	if (!parch->pf)
+		Die("Cannot create '%s'", pszFile);
+	parch->pszFile = strdup(pszFile);
+	VerifyAlloc(parch->pszFile, "archive file name");
+	parch->cstg = cstg;
+
+	ARCHIVEHEADER hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.szMagic, ARCHIVE_MAGIC, sizeof(hdr.szMagic));
+	hdr.nVersion = ARCHIVE_VERSION;
+	hdr.cGenes = STRATEGY_LENGTH;
+	hdr.cstg = cstg;
+	if (fwrite(&hdr, sizeof(hdr), 1, parch->pf) != 1)
+		Die("Error writing '%s'", pszFile);
+
+	int i;
+	const size_t cbGenes = (size_t)cstg * STRATEGY_LENGTH;
+	for (i = 0; i < ARCHIVE_QUEUE_LENGTH; ++i) {
+		ARCHIVESNAPSHOT* psnap = &parch->rgsnap[i];
+		psnap->rgact = (uint8_t*) malloc(cbGenes);
+		psnap->rgrFitness = (double*) malloc(sizeof(double) * cstg);
+		psnap->rgistgParent = (int32_t*) malloc(sizeof(int32_t) * cstg);
+		VerifyAlloc(psnap->rgact && psnap->rgrFitness && psnap->rgistgParent ? psnap : NULL,
+			"archive snapshot (%d strategies)", cstg);
+	}
+	parch->rgactPrevious = (uint8_t*) malloc(cbGenes);
+	VerifyAlloc(parch->rgactPrevious, "archive genomes (%d strategies)", cstg);
+	/* Worst case: every genome literal */
+	parch->cbRecordMax = sizeof(ARCHIVERECORD) + (sizeof(double) + 2 * sizeof(uint32_t)) * cstg + cbGenes + 8;
+	parch->pbRecord = (uint8_t*) malloc(parch->cbRecordMax);
+	VerifyAlloc(parch->pbRecord, "archive record buffer");
+	parch->iGenerationPrevious = -1;
+	parch->cRecords = 0;
+
+	parch->iQueueHead = parch->cQueue = 0;
+	parch->bClosing = false;
+	pthread_mutex_init(&parch->mutex, NULL);
+	pthread_cond_init(&parch->condSnapshot, NULL);
+	pthread_cond_init(&parch->condRoom, NULL);
+	if (pthread_create(&parch->thread, NULL, ArchiveWriter, parch) != 0)
+		Die("Cannot create archive writer thread");
+	return parch;
+}
+
+
+/* Queues a generation (which must have the archive's population size) to be
+ * appended. Returns as soon as the population is copied, unless the writer
+ * is ARCHIVE_QUEUE_LENGTH generations behind. Strategies' istgParent must
+ * index the population appended just before. */
+void ArchiveAppend(ARCHIVE* parch, int iGeneration, const POPULATION* pPop) {
+	ASSERT(parch && pPop);
+	ASSERT(pPop->cstg == parch->cstg);
+
+	pthread_mutex_lock(&parch->mutex);
+	while (parch->cQueue == ARCHIVE_QUEUE_LENGTH)
+		pthread_cond_wait(&parch->condRoom, &parch->mutex);
+	ARCHIVESNAPSHOT* psnap = &parch->rgsnap[(parch->iQueueHead + parch->cQueue) % ARCHIVE_QUEUE_LENGTH];
+	pthread_mutex_unlock(&parch->mutex);
+
+	int istg;
+	psnap->iGeneration = iGeneration;
+	for (istg = 0; istg < pPop->cstg; ++istg) {
+		const STRATEGY* pstg = &pPop->rgstg[istg];
+		StrategyGetActions(pstg, &psnap->rgact[(size_t)istg * STRATEGY_LENGTH]);
+		psnap->rgrFitness[istg] = pstg->rFitness;
+		psnap->rgistgParent[istg] = pstg->istgParent;
+	}
+
+	pthread_mutex_lock(&parch->mutex);
+	parch->cQueue++;
+	pthread_cond_signal(&parch->condSnapshot);
+	pthread_mutex_unlock(&parch->mutex);
+}
+
+
+/* Writes out every queued generation, stops the writer thread and closes the
+ * archive */
+void ArchiveClose(ARCHIVE* parch) {
+	ASSERT(parch);
+	pthread_mutex_lock(&parch->mutex);
+	parch->bClosing = true;
+	pthread_cond_signal(&parch->condSnapshot);
+	pthread_mutex_unlock(&parch->mutex);
+	pthread_join(parch->thread, NULL);
+
+	if (fclose(parch->pf) != 0)
+		Die("Error writing '%s'", parch->pszFile);
+	pthread_cond_destroy(&parch->condRoom);
+	pthread_cond_destroy(&parch->condSnapshot);
+	pthread_mutex_destroy(&parch->mutex);
+	int i;
+	for (i = 0; i < ARCHIVE_QUEUE_LENGTH; ++i) {
+		free(parch->rgsnap[i].rgact);
+		free(parch->rgsnap[i].rgrFitness);
+		free(parch->rgsnap[i].rgistgParent);
+	}
+	free(parch->rgactPrevious);
+	free(parch->pbRecord);
+	free(parch->pszFile);
+	free(parch);
+}
+
+
+/* Maps an archive file and indexes its records. A record cut short (say, by
+ * a crash while writing) ends the archive. */
+ARCHIVEREADER* ArchiveOpen(PCSZ pszFile) {
+	ASSERT(pszFile);
+	int fd = open(pszFile, O_RDONLY);
+	if (fd < 0)
+		Die("Cannot open '%s'", pszFile);
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+		Die("Cannot stat '%s'", pszFile);
+	if ((size_t)st.st_size < sizeof(ARCHIVEHEADER))
+		Die("'%s' is too short to be a generation archive", pszFile);
+	void* pvMap = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (pvMap == MAP_FAILED)
+		Die("Cannot map '%s'", pszFile);
+	close(fd);
+
+	const ARCHIVEHEADER* phdr = (const ARCHIVEHEADER*) pvMap;
+	if (memcmp(phdr->szMagic, ARCHIVE_MAGIC, sizeof(phdr->szMagic)) != 0)
+		Die("'%s' is not a generation archive", pszFile);
+	if (phdr->nVersion != ARCHIVE_VERSION)
+		Die("'%s' is archive version %d (expected %d)", pszFile, phdr->nVersion, ARCHIVE_VERSION);
+	if (phdr->cGenes != STRATEGY_LENGTH)
+		Die("'%s' holds %d-gene strategies; this build uses %d", pszFile, phdr->cGenes, STRATEGY_LENGTH);
+
+	ARCHIVEREADER* prdr = (ARCHIVEREADER*) malloc(sizeof(ARCHIVEREADER));
+	VerifyAlloc(prdr, "archive reader");
+	prdr->pvMap = pvMap;
+	prdr->cbMap = st.st_size;
+	prdr->cstg = phdr->cstg;
+	prdr->cRecords = 0;
+
+	/* Hop from record header to record header */
+	const uint8_t* pbMap = (const uint8_t*) pvMap;
+	size_t ib, cRecordsMax = 64;
+	prdr->rgpbRecord = (const uint8_t**) malloc(sizeof(uint8_t*) * cRecordsMax);
+	VerifyAlloc(prdr->rgpbRecord, "archive index");
+	for (ib = sizeof(ARCHIVEHEADER); ib + sizeof(ARCHIVERECORD) <= prdr->cbMap; ) {
+		const ARCHIVERECORD* prec = (const ARCHIVERECORD*) &pbMap[ib];
+		if (prec->nMagic != ARCHIVE_RECORD_MAGIC || prec->cbRecord < sizeof(ARCHIVERECORD) ||
+		    prec->cbRecord > prdr->cbMap - ib)
+			break;
+		if (prdr->cRecords == cRecordsMax) {
+			cRecordsMax *= 2;
+			prdr->rgpbRecord = (const uint8_t**) realloc(prdr->rgpbRecord, sizeof(uint8_t*) * cRecordsMax);
+			VerifyAlloc(prdr->rgpbRecord, "archive index");
+		}
+		prdr->rgpbRecord[prdr->cRecords++] = &pbMap[ib];
+		ib += prec->cbRecord;
+	}
+
+	prdr->rgactDecoded = (uint8_t*) malloc((size_t)prdr->cstg * STRATEGY_LENGTH);
+	prdr->rgactScratch = (uint8_t*) malloc((size_t)prdr->cstg * STRATEGY_LENGTH);
+	VerifyAlloc(prdr->rgactDecoded && prdr->rgactScratch ? prdr : NULL,
+		"archive genomes (%d strategies)", prdr->cstg);
+	prdr->iDecoded = -1;
+	return prdr;
+}
+
+
+/* Returns the generation number of a record */
+int ArchiveGetGeneration(const ARCHIVEREADER* prdr, int iRecord) {
+	ASSERT(prdr && iRecord >= 0 && iRecord < prdr->cRecords);
+	return ((const ARCHIVERECORD*) prdr->rgpbRecord[iRecord])->iGeneration;
+}
+
+
+/* Returns a record's fitness values (cstg of them), in place in the mapping */
+const double* ArchiveGetFitness(const ARCHIVEREADER* prdr, int iRecord) {
+	ASSERT(prdr && iRecord >= 0 && iRecord < prdr->cRecords);
+	return (const double*)((const ARCHIVERECORD*) prdr->rgpbRecord[iRecord] + 1);
+}
+
+
+/* Decodes record iRecord's genomes into rgact, given the previous record's
+ * genomes in rgactPrevious (unused for keyframes) */
+static void ArchiveDecodeRecord(const ARCHIVEREADER* prdr, int iRecord, const uint8_t* rgactPrevious, uint8_t* rgact) {
+	const int cstg = prdr->cstg;
+	const double* rgrFitness = ArchiveGetFitness(prdr, iRecord);
+	const int32_t* rgistgParent = (const int32_t*)(rgrFitness + cstg);
+	const uint32_t* rgcDiffs = (const uint32_t*)(rgistgParent + cstg);
+	const uint8_t* pb = (const uint8_t*)(rgcDiffs + cstg);
+	int istg;
+	uint32_t iDiff;
+
+	for (istg = 0; istg < cstg; ++istg) {
+		uint8_t* rgactChild = &rgact[(size_t)istg * STRATEGY_LENGTH];
+		if (rgcDiffs[istg] == ARCHIVE_LITERAL) {
+			memcpy(rgactChild, pb, STRATEGY_LENGTH);
+			pb += STRATEGY_LENGTH;
+			continue;
+		}
+		ASSERT(rgactPrevious && rgistgParent[istg] >= 0 && rgistgParent[istg] < cstg);
+		memcpy(rgactChild, &rgactPrevious[(size_t)rgistgParent[istg] * STRATEGY_LENGTH], STRATEGY_LENGTH);
+		for (iDiff = 0; iDiff < rgcDiffs[istg]; ++iDiff) {
+			uint32_t nDiff;
+			memcpy(&nDiff, pb, sizeof(nDiff));
+			pb += sizeof(nDiff);
+			rgactChild[nDiff >> 3] = nDiff & 7;
+		}
+	}
+}
+
+
+/* Reads a whole generation into pPop, which must hold at least the
+ * archive's population size. Decodes forward from the nearest keyframe, or
+ * from the last record read if that is nearer, so reading generations in
+ * order costs one record each. */
+void ArchiveReadPopulation(ARCHIVEREADER* prdr, int iRecord, POPULATION* pPop) {
+	ASSERT(prdr && pPop);
+	ASSERT(iRecord >= 0 && iRecord < prdr->cRecords);
+	ASSERT(pPop->maxstg >= prdr->cstg);
+
+	int i = iRecord;
+	if (prdr->iDecoded == iRecord)
+		++i;
+	else {
+		while (!((const ARCHIVERECORD*) prdr->rgpbRecord[i])->bKeyframe && i - 1 != prdr->iDecoded) {
+			if (i == 0)
+				Die("Archive record %d has no keyframe before it", iRecord);
+			--i;
+		}
+	}
+
+	for (; i <= iRecord; ++i) {
+		const bool bKeyframe = ((const ARCHIVERECORD*) prdr->rgpbRecord[i])->bKeyframe;
+		ArchiveDecodeRecord(prdr, i, bKeyframe ? NULL : prdr->rgactDecoded, prdr->rgactScratch);
+		uint8_t* rgactSwap = prdr->rgactDecoded;
+		prdr->rgactDecoded = prdr->rgactScratch;
+		prdr->rgactScratch = rgactSwap;
+		prdr->iDecoded = i;
+	}
+
+	const double* rgrFitness = ArchiveGetFitness(prdr, iRecord);
+	const int32_t* rgistgParent = (const int32_t*)(rgrFitness + prdr->cstg);
+	pPop->cstg = prdr->cstg;
+	for (i = 0; i < prdr->cstg; ++i) {
+		StrategySetActions(&pPop->rgstg[i], &prdr->rgactDecoded[(size_t)i * STRATEGY_LENGTH]);
+		pPop->rgstg[i].rFitness = rgrFitness[i];
+		pPop->rgstg[i].istgParent = rgistgParent[i];
+	}
+}
+
+
+/* Unmaps an archive opened with ArchiveOpen */
+void ArchiveCloseReader(ARCHIVEREADER* prdr) {
+	ASSERT(prdr);
+	munmap(prdr->pvMap, prdr->cbMap);
+	free(prdr->rgpbRecord);
+	free(prdr->rgactDecoded);
+	free(prdr->rgactScratch);
+	free(prdr);
+}
@@ -0,0 +1,96 @@
+/*****************************************************************************
+ * archive.h: Header for archive.c.
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#pragma once
+#include <pthread.h>
+#include <stdio.h>
+#include "types.h"
+#include "population.h"
+
+
+/* Snapshots waiting for the writer thread; appending blocks only when the
+ * writer is this many generations behind */
+#define ARCHIVE_QUEUE_LENGTH	4
+
+/* One queued generation, copied out of the population */
+typedef struct {
+	int       iGeneration;
+	uint8_t*  rgact;          /* cstg genomes, back to back */
+	double*   rgrFitness;
+	int32_t*  rgistgParent;
+} ARCHIVESNAPSHOT; /* snap */
+
+
+/*
+ * Writes a generation archive: an append-only file of every generation's
+ * population and fitness. Each strategy is stored as the genes in which it
+ * differs from its parent in the previous generation, with every strategy
+ * stored in full at regular keyframes. Encoding and I/O happen on a
+ * background thread.
+ */
+typedef struct {
+	FILE*           pf;
+	PSZ             pszFile;
+	int             cstg;
+	ARCHIVESNAPSHOT rgsnap[ARCHIVE_QUEUE_LENGTH];
+	int             iQueueHead;
+	int             cQueue;
+	bool            bClosing;
+	pthread_t       thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t  condSnapshot;  /* Signaled when a snapshot is queued */
+	pthread_cond_t  condRoom;      /* Signaled when the queue has room */
+
+	/* Used by the writer thread only */
+	uint8_t*        rgactPrevious; /* Genomes of the last generation written */
+	int             iGenerationPrevious;
+	int             cRecords;
+	uint8_t*        pbRecord;      /* Record being encoded */
+	size_t          cbRecordMax;
+} ARCHIVE; /* arch */
+
+
+/*
+ * Reads a generation archive through a read-only mapping. Fitness (and the
+ * genes of keyframes) are used in place; other generations are decoded from
+ * the nearest keyframe before them.
+ */
+typedef struct {
+	void*           pvMap;
+	size_t          cbMap;
+	int             cstg;
+	int             cRecords;      /* Complete generation records in the file */
+	const uint8_t** rgpbRecord;    /* Per record: its start in the mapping */
+	uint8_t*        rgactDecoded;  /* Genomes of the last record decoded */
+	uint8_t*        rgactScratch;
+	int             iDecoded;      /* Which record that is, or -1 */
+} ARCHIVEREADER; /* rdr */
+
+
+/* Function prototypes */
+ARCHIVE*       ArchiveCreate(PCSZ pszFile, int cstg);
+void           ArchiveAppend(ARCHIVE* parch, int iGeneration, const POPULATION* pPop);
+void           ArchiveClose(ARCHIVE* parch);
+ARCHIVEREADER* ArchiveOpen(PCSZ pszFile);
+int            ArchiveGetGeneration(const ARCHIVEREADER* prdr, int iRecord);
+const double*  ArchiveGetFitness(const ARCHIVEREADER* prdr, int iRecord);
+void           ArchiveReadPopulation(ARCHIVEREADER* prdr, int iRecord, POPULATION* pPop);
+void           ArchiveCloseReader(ARCHIVEREADER* prdr);
@@ -0,0 +1,68 @@
+/*****************************************************************************
+ * args.c: Default run parameters.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <stddef.h> /* NULL */
+#include "types.h"
+#include "args.h"
+
+
+/*
+ * Default program parameters
+ */
+const ARGS k_argsDefault = {
+	.nPopulationSize  = 200,
+	.cGenerations     = 500,
+	.cSessions        = 200,
+	.cSessionActions  = 200,
+	.rMutationProbability = 0.005,
+	.rCanProbability  = 0.5,
+	.nSeed            = 8675309,
+	.pszWorld         = "default.world",
+	.bUseCrossover    = true,
+	.robbyType        = NormalRobby,
+	.cThreads         = 0,
+	.cGeneralizeTop   = 5,
+	.rGeneralizeWidth = 1.0,
+	.evolutionType    = Generational,
+	.cReportEvaluations = 0,
+	.pszTestBank      = NULL,
+	.pszCounts        = NULL,
+	.bDiversity       = false,
+	.pszArchive       = NULL,
+	.bLazyCans        = false,
+	.bDeltaEvaluation = false,
+	.pszMetrics       = NULL,
+	.cCheckpointInterval = 0,
+	.nSurrogateOversample = 0,
+	.rTimeBudget      = 0.0,
+	.bTargetFitness   = false,
+	.rTargetFitness   = 0.0,
+	.cStopWindow      = 0,
+	.rStopTolerance   = 0.0,
+	.cLayoutProducers = 0,
+	.cSearchConfigs   = 0,
+	.pszPopulationDir = NULL
+};
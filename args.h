@@ -0,0 +1,75 @@
+/*****************************************************************************
+ * args.h: Run parameters shared by the engine and its front ends.
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#pragma once
+#include "types.h"
+
+typedef enum {
+	NormalRobby,
+	SmartRobby,
+	IdRobby,
+} RobbyType;
+
+typedef enum {
+	Generational,
+	SteadyStateReplaceWorst,      /* Child replaces the worst, if it is no worse */
+	SteadyStateReplaceTournament, /* Child replaces the loser of a random tournament */
+} EvolutionType;
+
+typedef struct {
+	/*  Variable                 Command line arg */
+	int nPopulationSize;         /* -p */
+	int cGenerations;            /* -g */
+	int cSessions;               /* -s */
+	int cSessionActions;         /* -a */
+	double rMutationProbability; /* -m */
+	double rCanProbability;      /* -c */
+	int nSeed;                   /* -r */
+	PCSZ pszWorld;               /* -w */
+	bool bUseCrossover;          /* -x to turn off crossover*/
+	RobbyType robbyType;         /* -z smart: SmartRobby, -z id: IntelligentDesignRobby */
+	int cThreads;                /* -t (0: one per online CPU) */
+	int cGeneralizeTop;          /* -k */
+	double rGeneralizeWidth;     /* -e */
+	EvolutionType evolutionType; /* -S worst|tournament: steady-state evolution */
+	int cReportEvaluations;      /* -n (0: population size) */
+	PCSZ pszTestBank;            /* --test-bank: generalize on a layout bank */
+	PCSZ pszCounts;              /* --counts: hit counts file (instrumented builds) */
+	bool bDiversity;             /* --diversity: report population diversity */
+	PCSZ pszArchive;             /* --archive: generation archive file */
+	bool bLazyCans;              /* --lazy-cans: decide cans where Robby looks */
+	bool bDeltaEvaluation;       /* --delta: rerun only sessions changed genes affect */
+	PCSZ pszMetrics;             /* --metrics: publish live metrics under this name */
+	int cCheckpointInterval;     /* --checkpoint: generations between checkpoints (0: none) */
+	int nSurrogateOversample;    /* --surrogate: children bred per child evaluated (0: off) */
+	double rTimeBudget;          /* --time-budget: seconds before evolution stops (0: none) */
+	bool bTargetFitness;         /* --target-fitness: stop once the best reaches... */
+	double rTargetFitness;       /* ...this fitness */
+	int cStopWindow;             /* --window: stop after this many steps without improvement (0: none) */
+	double rStopTolerance;       /* --tolerance: smallest improvement --window counts */
+	int cLayoutProducers;        /* --producers: threads placing cans ahead of evaluation (0: none) */
+	int cSearchConfigs;          /* --search: configurations to search over (0: plain run) */
+	PCSZ pszPopulationDir;       /* --population-dir: keep populations in mapped files here */
+} ARGS; /* args */
+
+
+/* Default program parameters */
+extern const ARGS k_argsDefault;
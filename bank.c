@@ -0,0 +1,218 @@
+/*****************************************************************************
+ * bank.c: Layout banks: precomputed, memory-mapped can layouts shared by runs
+ * that need to score strategies on identical worlds.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "types.h"
+#include "error.h"
+#include "rng.h"
+#include "world.h"
+#include "bank.h"
+
+
+#define BANK_MAGIC	"ROBYBANK"
+#define BANK_VERSION	1
+
+
+/* On-disk header, followed by cLayouts * cWordsPerLayout 64-bit words. It is
+ * 64 bytes long so the layouts start cache-line aligned in the mapping. */
+typedef struct {
+	char     szMagic[8];      /* BANK_MAGIC, not nul-terminated */
+	uint32_t nVersion;
+	uint32_t cx;
+	uint32_t cy;
+	uint32_t ccellOpen;
+	uint32_t cLayouts;
+	uint32_t cWordsPerLayout;
+	double   rCanProbability;
+	uint64_t nSeed;
+	uint64_t nWorldHash;      /* See BankWorldHash */
+	uint8_t  rgbReserved[8];
+} BANKHEADER;
+
+
+/* Hashes a world's walls and Robby's starting cell, so that a bank is only
+ * ever used with the world it was drawn for. Cans are ignored. */
+static uint64_t BankWorldHash(const WORLD* pWorld) {
+	uint64_t nHash = RngHash(((uint64_t)pWorld->cx << 32) | pWorld->cy);
+	uint icell;
+	for (icell = 0; icell < pWorld->cx * pWorld->cy; ++icell)
+		nHash = RngHash(nHash ^ (pWorld->cells[icell] == CELL_WALL));
+	return RngHash(nHash ^ (((uint64_t)pWorld->xStart << 32) | pWorld->yStart));
+}
+
+
+/* Draws cLayouts can layouts for pWorld with the given can probability and
+ * writes them to a new bank file. Layout i is drawn from stream i of nSeed,
+ * by the same placement as every other session uses. */
+void BankWrite(PCSZ pszFile, const WORLD* pWorld, uint cLayouts, double rCanProbability, uint64_t nSeed) {
+	ASSERT(pszFile && pWorld);
+	ASSERT(cLayouts > 0);
+
+	BANKHEADER hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.szMagic, BANK_MAGIC, sizeof(hdr.szMagic));
+	hdr.nVersion = BANK_VERSION;
+	hdr.cx = pWorld->cx;
+	hdr.cy = pWorld->cy;
+	hdr.ccellOpen = pWorld->ccellOpen;
+	hdr.cLayouts = cLayouts;
+	hdr.cWordsPerLayout = (pWorld->ccellOpen + 63) / 64;
+	hdr.rCanProbability = rCanProbability;
+	hdr.nSeed = nSeed;
+	hdr.nWorldHash = BankWorldHash(pWorld);
+
+	FILE* pf = fopen(pszFile, "wb");
+	if (!pf)
+		Die("Cannot create '%s'", pszFile);
+	if (fwrite(&hdr, sizeof(hdr), 1, pf) != 1)
+		Die("Error writing '%s'", pszFile);
+
+	WORLD* pwld = WorldCreate(pWorld->cx, pWorld->cy);
+	uint64_t* rgnLayout = (uint64_t*) malloc(sizeof(uint64_t) * (hdr.cWordsPerLayout + 1));
+	VerifyAlloc(rgnLayout, "bank layout (%d words)", hdr.cWordsPerLayout);
+	uint iLayout, iOpen;
+	for (iLayout = 0; iLayout < cLayouts; ++iLayout) {
+		RNG rng;
+		RngSeedStream(&rng, nSeed, iLayout);
+		WorldCopy(pWorld, pwld);
+		WorldSetCansRandomly(pwld, rCanProbability, &rng);
+
+		memset(rgnLayout, 0, sizeof(uint64_t) * hdr.cWordsPerLayout);
+		for (iOpen = 0; iOpen < pwld->ccellOpen; ++iOpen) {
+			if (pwld->cells[pwld->rgicellOpen[iOpen]] == CELL_CAN)
+				rgnLayout[iOpen / 64] |= 1ULL << (iOpen % 64);
+		}
+		if (fwrite(rgnLayout, sizeof(uint64_t), hdr.cWordsPerLayout, pf) != hdr.cWordsPerLayout)
+			Die("Error writing '%s'", pszFile);
+	}
+	free(rgnLayout);
+	WorldDestroy(pwld);
+	if (fclose(pf) != 0)
+		Die("Error writing '%s'", pszFile);
+}
+
+
+/* Maps a bank file written by BankWrite for pWorld. Returns NULL, with the
+ * reason in szError, if the file cannot be read, is not a bank, or was drawn
+ * for a different world. */
+BANK* BankTryOpen(PCSZ pszFile, const WORLD* pWorld, char* szError, size_t cchError) {
+	ASSERT(pszFile && pWorld && szError && cchError > 0);
+
+	int fd = open(pszFile, O_RDONLY);
+	if (fd < 0) {
+		snprintf(szError, cchError, "Cannot open '%s'", pszFile);
+		return NULL;
+	}
+	struct stat st;
+	void* pvMap = MAP_FAILED;
+	if (fstat(fd, &st) != 0)
+		snprintf(szError, cchError, "Cannot stat '%s'", pszFile);
+	else if ((size_t)st.st_size < sizeof(BANKHEADER))
+		snprintf(szError, cchError, "'%s' is too short to be a layout bank", pszFile);
+	else if ((pvMap = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+		snprintf(szError, cchError, "Cannot map '%s'", pszFile);
+	close(fd);
+	if (pvMap == MAP_FAILED)
+		return NULL;
+
+	const BANKHEADER* phdr = (const BANKHEADER*) pvMap;
+	bool bOk = false;
+	if (memcmp(phdr->szMagic, BANK_MAGIC, sizeof(phdr->szMagic)) != 0)
+		snprintf(szError, cchError, "'%s' is not a layout bank", pszFile);
+	else if (phdr->nVersion != BANK_VERSION)
+		snprintf(szError, cchError, "'%s' is layout bank version %d (expected %d)", pszFile, phdr->nVersion,
+			BANK_VERSION);
+	else if (phdr->cx != pWorld->cx || phdr->cy != pWorld->cy ||
+	         phdr->ccellOpen != pWorld->ccellOpen || phdr->nWorldHash != BankWorldHash(pWorld))
+		snprintf(szError, cchError, "'%s' was drawn for a different world", pszFile);
+	else if (phdr->cWordsPerLayout != (pWorld->ccellOpen + 63) / 64 ||
+	         (size_t)st.st_size != sizeof(BANKHEADER) +
+	         sizeof(uint64_t) * (size_t)phdr->cLayouts * phdr->cWordsPerLayout)
+		snprintf(szError, cchError, "'%s' is truncated or corrupt", pszFile);
+	else
+		bOk = true;
+	if (!bOk) {
+		munmap(pvMap, st.st_size);
+		return NULL;
+	}
+
+	BANK* pbank = (BANK*) malloc(sizeof(BANK));
+	VerifyAlloc(pbank, "layout bank");
+	pbank->pvMap = pvMap;
+	pbank->cbMap = st.st_size;
+	pbank->cLayouts = phdr->cLayouts;
+	pbank->cWordsPerLayout = phdr->cWordsPerLayout;
+	pbank->rCanProbability = phdr->rCanProbability;
+	pbank->nSeed = phdr->nSeed;
+	pbank->rgnLayouts = (const uint64_t*)(phdr + 1);
+	return pbank;
+}
+
+
+/* Maps a bank file written by BankWrite for pWorld. Dies if the file is not
+ * a bank, or was drawn for a different world. */
+BANK* BankOpen(PCSZ pszFile, const WORLD* pWorld) {
+	char szError[512];
+	BANK* pbank = BankTryOpen(pszFile, pWorld, szError, sizeof(szError));
+	if (!pbank)
+		Die("%s", szError);
+	return pbank;
+}
+
+
+/* Unmaps a bank opened with BankOpen */
+void BankClose(BANK* pbank) {
+	ASSERT(pbank);
+	munmap(pbank->pvMap, pbank->cbMap);
+	free(pbank);
+}
+
+
+/* Resets pwld to pWorld (which the bank was opened for) with layout iLayout's
+ * cans. Like WorldSetCansRandomly, this starts a new layout for
+ * WorldRestoreLayout. */
+void BankSetLayout(const BANK* pbank, uint iLayout, const WORLD* pWorld, WORLD* pwld) {
+	ASSERT(pbank && pWorld && pwld && !pwld->bLazyCans);
+	ASSERT(iLayout < pbank->cLayouts);
+
+	const uint64_t* rgnLayout = &pbank->rgnLayouts[(size_t)iLayout * pbank->cWordsPerLayout];
+	uint iword;
+	WorldCopy(pWorld, pwld);
+	for (iword = 0; iword < pbank->cWordsPerLayout; ++iword) {
+		uint64_t nMask = rgnLayout[iword];
+		while (nMask) {
+			pwld->cells[pwld->rgicellOpen[iword * 64 + __builtin_ctzll(nMask)]] = CELL_CAN;
+			nMask &= nMask - 1;
+		}
+	}
+}
@@ -0,0 +1,49 @@
+/*****************************************************************************
+ * bank.h: Header for bank.c.
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#pragma once
+#include "types.h"
+#include "world.h"
+
+
+/*
+ * A layout bank is a file of precomputed can layouts for one world, mapped
+ * read-only into memory. Layout i is a bit mask over the world's open cells
+ * (bit j set: a can on open cell j), padded to whole 64-bit words. Several
+ * runs can map the same bank and share its page-cached layouts.
+ */
+typedef struct {
+	void*           pvMap;
+	size_t          cbMap;
+	uint            cLayouts;
+	uint            cWordsPerLayout;
+	double          rCanProbability; /* Density the layouts were drawn with */
+	uint64_t        nSeed;           /* Seed the layouts were drawn with */
+	const uint64_t* rgnLayouts;
+} BANK; /* bank */
+
+
+/* Function prototypes */
+void  BankWrite(PCSZ pszFile, const WORLD* pWorld, uint cLayouts, double rCanProbability, uint64_t nSeed);
+BANK* BankOpen(PCSZ pszFile, const WORLD* pWorld);
+BANK* BankTryOpen(PCSZ pszFile, const WORLD* pWorld, char* szError, size_t cchError);
+void  BankClose(BANK* pbank);
+void  BankSetLayout(const BANK* pbank, uint iLayout, const WORLD* pWorld, WORLD* pwld);
@@ -0,0 +1,157 @@
+/*****************************************************************************
+ * checkpoint.c: Generalization checkpoints: scores snapshots of the best
+ * strategy on a background thread while evolution continues.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <pthread.h>
+#include <stdlib.h>
+#include "types.h"
+#include "error.h"
+#include "args.h"
+#include "strategy.h"
+#include "world.h"
+#include "bank.h"
+#include "evolve.h"
+#include "checkpoint.h"
+
+
+/* Mixed into the run's seed so checkpoints draw layouts and random moves
+ * apart from the run's own generalization */
+#define CHECKPOINT_SEED_MASK	0x43686b70
+
+
+/* Evaluator thread: scores each submitted snapshot until the checkpointer
+ * is destroyed */
+static void* CheckpointerEvaluator(void* pv) {
+	CHECKPOINTER* pchk = (CHECKPOINTER*) pv;
+	pthread_mutex_lock(&pchk->mutex);
+	for (;;) {
+		while (!pchk->bBusy && !pchk->bClosing)
+			pthread_cond_wait(&pchk->condSnapshot, &pchk->mutex);
+		if (!pchk->bBusy)
+			break;
+		/* The snapshot is left alone until bBusy is cleared */
+		pthread_mutex_unlock(&pchk->mutex);
+		GENERALIZATION gen;
+		CalculateGeneralization(&pchk->args, &pchk->pstg, 1, pchk->pWorld, pchk->pbank, &pchk->pwld, &gen);
+		pthread_mutex_lock(&pchk->mutex);
+		pchk->gen = gen;
+		pchk->bBusy = false;
+		pchk->bReady = true;
+		pthread_cond_signal(&pchk->condScored);
+	}
+	pthread_mutex_unlock(&pchk->mutex);
+	return NULL;
+}
+
+
+/* Creates a checkpointer for a run with the given parameters, world template
+ * and test bank (or NULL), and starts its evaluator thread. The world and
+ * bank must outlive the checkpointer. */
+CHECKPOINTER* CheckpointerCreate(const ARGS* pArgs, const WORLD* pWorld, const BANK* pbank) {
+	ASSERT(pArgs && pWorld);
+	CHECKPOINTER* pchk = (CHECKPOINTER*) malloc(sizeof(CHECKPOINTER));
+	VerifyAlloc(pchk, "checkpointer");
+	pchk->args = *pArgs;
+	pchk->args.cThreads = 1;
+	pchk->args.nSeed ^= CHECKPOINT_SEED_MASK;
+	pchk->pWorld = pWorld;
+	pchk->pbank = pbank;
+	pchk->pwld = WorldCreate(pWorld->cx, pWorld->cy);
+	WorldEnableUndo(pchk->pwld, pArgs->cSessionActions);
+	WorldEnableCycleDetection(pchk->pwld, pArgs->cSessionActions);
+	if (pArgs->bLazyCans)
+		WorldEnableLazyCans(pchk->pwld);
+	pchk->pstg = StrategyAllocArray(1);
+	pchk->iGeneration = 0;
+	pchk->bBusy = pchk->bReady = pchk->bClosing = false;
+	pthread_mutex_init(&pchk->mutex, NULL);
+	pthread_cond_init(&pchk->condSnapshot, NULL);
+	pthread_cond_init(&pchk->condScored, NULL);
+	if (pthread_create(&pchk->thread, NULL, CheckpointerEvaluator, pchk) != 0)
+		Die("Cannot create checkpoint evaluator thread");
+	return pchk;
+}
+
+
+/* Copies pstg, the best strategy after generation iGeneration, and has it
+ * scored in the background. Returns false without submitting if the
+ * previous checkpoint is still being scored, or scored but not collected. */
+bool CheckpointerSubmit(CHECKPOINTER* pchk, const STRATEGY* pstg, int iGeneration) {
+	ASSERT(pchk && pstg);
+	pthread_mutex_lock(&pchk->mutex);
+	bool bIdle = !pchk->bBusy && !pchk->bReady;
+	pthread_mutex_unlock(&pchk->mutex);
+	if (!bIdle)
+		return false;
+
+	StrategyCopy(pstg, pchk->pstg);
+	pchk->iGeneration = iGeneration;
+
+	pthread_mutex_lock(&pchk->mutex);
+	pchk->bBusy = true;
+	pthread_cond_signal(&pchk->condSnapshot);
+	pthread_mutex_unlock(&pchk->mutex);
+	return true;
+}
+
+
+/* Takes the result of the last submitted checkpoint, if it is scored and not
+ * yet collected; with bWait, first waits for it to be scored. Returns true
+ * and fills in *piGeneration and *pgen if there was a result. */
+bool CheckpointerCollect(CHECKPOINTER* pchk, bool bWait, int* piGeneration, GENERALIZATION* pgen) {
+	ASSERT(pchk && piGeneration && pgen);
+	bool bReady;
+	pthread_mutex_lock(&pchk->mutex);
+	while (bWait && pchk->bBusy)
+		pthread_cond_wait(&pchk->condScored, &pchk->mutex);
+	bReady = pchk->bReady;
+	if (bReady) {
+		*piGeneration = pchk->iGeneration;
+		*pgen = pchk->gen;
+		pchk->bReady = false;
+	}
+	pthread_mutex_unlock(&pchk->mutex);
+	return bReady;
+}
+
+
+/* Finishes scoring any submitted checkpoint, stops the evaluator thread and
+ * frees the checkpointer. An uncollected result is discarded. */
+void CheckpointerDestroy(CHECKPOINTER* pchk) {
+	ASSERT(pchk);
+	pthread_mutex_lock(&pchk->mutex);
+	pchk->bClosing = true;
+	pthread_cond_signal(&pchk->condSnapshot);
+	pthread_mutex_unlock(&pchk->mutex);
+	pthread_join(pchk->thread, NULL);
+
+	pthread_cond_destroy(&pchk->condScored);
+	pthread_cond_destroy(&pchk->condSnapshot);
+	pthread_mutex_destroy(&pchk->mutex);
+	StrategyFreeArray(pchk->pstg);
+	WorldDestroy(pchk->pwld);
+	free(pchk);
+}
@@ -0,0 +1,60 @@
+/*****************************************************************************
+ * checkpoint.h: Header for checkpoint.c.
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#pragma once
+#include <pthread.h>
+#include "types.h"
+#include "args.h"
+#include "strategy.h"
+#include "world.h"
+#include "bank.h"
+#include "evolve.h"
+
+
+/*
+ * Scores snapshots of a run's best strategy for generalization on a
+ * background thread while evolution continues. One snapshot is scored at a
+ * time, single-threaded, in the checkpointer's own session world and on its
+ * own random streams, so results do not depend on when they are collected.
+ */
+typedef struct {
+	ARGS            args;          /* Run's parameters; one thread, own seed */
+	const WORLD*    pWorld;        /* The run's world template */
+	const BANK*     pbank;         /* The run's test bank, or NULL */
+	WORLD*          pwld;          /* Session world of the evaluator thread */
+	STRATEGY*       pstg;          /* Snapshot being (or last) scored */
+	int             iGeneration;   /* ...taken after this generation */
+	GENERALIZATION  gen;           /* ...and its score, once bReady */
+	bool            bBusy;         /* A snapshot is waiting or being scored */
+	bool            bReady;        /* gen holds a result not yet collected */
+	bool            bClosing;
+	pthread_t       thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t  condSnapshot;  /* Signaled when a snapshot is submitted */
+	pthread_cond_t  condScored;    /* Signaled when a snapshot is scored */
+} CHECKPOINTER; /* chk */
+
+
+/* Function prototypes */
+CHECKPOINTER* CheckpointerCreate(const ARGS* pArgs, const WORLD* pWorld, const BANK* pbank);
+bool          CheckpointerSubmit(CHECKPOINTER* pchk, const STRATEGY* pstg, int iGeneration);
+bool          CheckpointerCollect(CHECKPOINTER* pchk, bool bWait, int* piGeneration, GENERALIZATION* pgen);
+void          CheckpointerDestroy(CHECKPOINTER* pchk);
@@ -0,0 +1,422 @@
+/*****************************************************************************
+ * context.c: Reentrant evolution run state: the entry points for embedding
+ * the Robby engine.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <stdio.h>  /* snprintf */
+#include <stdlib.h>
+#include <string.h> /* memset */
+#include "types.h"
+#include "error.h"
+#include "args.h"
+#include "misc.h"
+#include "parallel.h"
+#include "rng.h"
+#include "strategy.h"
+#include "population.h"
+#include "instrument.h"
+#include "world.h"
+#include "bank.h"
+#include "archive.h"
+#include "evolve.h"
+#include "metrics.h"
+#include "surrogate.h"
+#include "ring.h"
+#include "context.h"
+
+
+/* Stream family for sampling diversity, which must not disturb evolution */
+#define DIVERSITY_STREAM	0x44697665727369ULL
+
+
+/* Allocates a population of cstg strategies, in a mapped file if the run
+ * keeps its populations on disk (--population-dir) */
+static POPULATION* ContextCreatePopulation(const ARGS* pArgs, int cstg) {
+	return pArgs->pszPopulationDir ? PopulationCreateMapped(cstg, pArgs->pszPopulationDir) : PopulationCreate(cstg);
+}
+
+
+/* Grows the context's scratch worlds to cScratch */
+static void ContextAddScratch(CONTEXT* pctx, int cScratch) {
+	const ARGS* pArgs = &pctx->args;
+	if (cScratch <= pctx->cScratch)
+		return;
+	pctx->rgpwldScratch = (WORLD**) realloc(pctx->rgpwldScratch, sizeof(WORLD*) * cScratch);
+	VerifyAlloc(pctx->rgpwldScratch, "scratch worlds");
+	for (; pctx->cScratch < cScratch; ++pctx->cScratch) {
+		WORLD* pwld = WorldCreate(pctx->pwld->cx, pctx->pwld->cy);
+		WorldEnableUndo(pwld, pArgs->cSessionActions);
+		WorldEnableCycleDetection(pwld, pArgs->cSessionActions);
+		if (pArgs->bLazyCans)
+			WorldEnableLazyCans(pwld);
+		pctx->rgpwldScratch[pctx->cScratch] = pwld;
+	}
+}
+
+
+/* Allocates a context for one run with the given parameters. If pwldTemplate
+ * is NULL the world is loaded from pArgs->pszWorld; otherwise the context
+ * keeps its own copy of pwldTemplate. The initial population is randomized,
+ * but not yet evaluated. */
+CONTEXT* ContextCreate(const ARGS* pArgs, const WORLD* pwldTemplate) {
+	ASSERT(pArgs);
+	ASSERT(pArgs->nPopulationSize > 0);
+	ASSERT(pArgs->cSessionActions > 0);
+
+	CONTEXT* pctx = (CONTEXT*) malloc(sizeof(CONTEXT));
+	VerifyAlloc(pctx, "context");
+	pctx->args = *pArgs;
+	pctx->args.cThreads = ParallelThreadCount(pArgs->cThreads);
+	pctx->pwld = pwldTemplate ? WorldClone(pwldTemplate) : WorldCreateFromFile(pArgs->pszWorld);
+	pctx->pbank = pArgs->pszTestBank ? BankOpen(pArgs->pszTestBank, pctx->pwld) : NULL;
+	RngSeed(&pctx->rng, pArgs->nSeed);
+
+	/* Only need two populations; the current generation's population,
+	 * and one to build the next generation into. We can just swap
+	 * them after every generation. */
+	pctx->pPopCurrent = ContextCreatePopulation(pArgs, pArgs->nPopulationSize);
+	pctx->pPopOther   = ContextCreatePopulation(pArgs, pArgs->nPopulationSize);
+	PopulationRandomize(pctx->pPopCurrent, &pctx->rng);
+
+	pctx->cScratch = 0;
+	pctx->rgpwldScratch = NULL;
+	ContextAddScratch(pctx, pctx->args.cThreads);
+	pctx->iGeneration = 0;
+	pctx->parch = pArgs->pszArchive ? ArchiveCreate(pArgs->pszArchive, pArgs->nPopulationSize) : NULL;
+	pctx->plogCurrent = pArgs->bDeltaEvaluation ? SessionLogCreate(pArgs->nPopulationSize, pArgs->cSessions) : NULL;
+	pctx->plogOther   = pArgs->bDeltaEvaluation ? SessionLogCreate(pArgs->nPopulationSize, pArgs->cSessions) : NULL;
+	pctx->cSessionsScored = pctx->cSessionsReused = 0;
+	pctx->cEvaluations = 0;
+	pctx->rCreated = Seconds();
+	pctx->rBestRecord = pctx->rMeanRecord = 0.0;
+	pctx->iImproved = 0;
+	pctx->szStopReason[0] = '\0';
+	pctx->pring = pArgs->cLayoutProducers > 0 ?
+		RingCreate(&pctx->args, pctx->pwld, pArgs->cLayoutProducers, pctx->args.cThreads) : NULL;
+	pctx->psur = pArgs->nSurrogateOversample > 0 ? SurrogateCreate(pArgs->nPopulationSize) : NULL;
+	pctx->pPopPool = pArgs->nSurrogateOversample > 0 ?
+		ContextCreatePopulation(pArgs, pArgs->nSurrogateOversample * pArgs->nPopulationSize) : NULL;
+	pctx->rSecondsEvaluating = pctx->rSecondsBreeding = pctx->rSecondsGeneralizing = 0.0;
+	return pctx;
+}
+
+
+/* Changes the number of threads the run's evaluation, breeding and
+ * generalization use from the next step on. Results do not depend on it.
+ * Not for runs with layout producers, whose ring is sized per thread. */
+void ContextSetThreads(CONTEXT* pctx, int cThreads) {
+	ASSERT(pctx && !pctx->pring);
+	pctx->args.cThreads = ParallelThreadCount(cThreads);
+	ContextAddScratch(pctx, pctx->args.cThreads);
+}
+
+
+/* Destroys a context allocated by ContextCreate */
+void ContextDestroy(CONTEXT* pctx) {
+	ASSERT(pctx);
+	if (pctx->parch)
+		ArchiveClose(pctx->parch);
+	if (pctx->plogCurrent) {
+		SessionLogDestroy(pctx->plogCurrent);
+		SessionLogDestroy(pctx->plogOther);
+	}
+	if (pctx->pring)
+		RingDestroy(pctx->pring);
+	if (pctx->psur) {
+		SurrogateDestroy(pctx->psur);
+		PopulationDestroy(pctx->pPopPool);
+	}
+	int i;
+	for (i = 0; i < pctx->cScratch; ++i)
+		WorldDestroy(pctx->rgpwldScratch[i]);
+	free(pctx->rgpwldScratch);
+	PopulationDestroy(pctx->pPopOther);
+	PopulationDestroy(pctx->pPopCurrent);
+	if (pctx->pbank)
+		BankClose(pctx->pbank);
+	WorldDestroy(pctx->pwld);
+	free(pctx);
+}
+
+
+/* Evaluates the current population and sorts it by fitness, then queues it
+ * for the archive, if there is one. By delta, after the first generation,
+ * the other population holds the parents. A surrogate model is trained on
+ * the population before it is sorted, while it is still in breeding order. */
+void ContextEvaluate(CONTEXT* pctx) {
+	ASSERT(pctx);
+	double rStart = Seconds();
+	if (pctx->plogCurrent) {
+		bool bParents = pctx->iGeneration > 0;
+		pctx->cSessionsReused += CalculateFitnessDelta(&pctx->args, pctx->pPopCurrent, pctx->plogCurrent,
+			bParents ? pctx->pPopOther : NULL, bParents ? pctx->plogOther : NULL,
+			pctx->pwld, pctx->rgpwldScratch, pctx->iGeneration);
+		pctx->cSessionsScored += (int64_t)pctx->pPopCurrent->cstg * pctx->args.cSessions;
+	} else if (pctx->pring) {
+		CalculateFitnessRing(&pctx->args, pctx->pPopCurrent, pctx->pring, pctx->iGeneration);
+	} else {
+		CalculateFitness(&pctx->args, pctx->pPopCurrent, pctx->pwld, pctx->rgpwldScratch, pctx->iGeneration);
+	}
+	if (pctx->psur)
+		SurrogateTrain(pctx->psur, pctx->pPopCurrent, pctx->iGeneration > 0);
+	/* The next generation will be bred into pPopOther, so it can take the
+	 * sorted copy; a mapped population is then sorted in sequential passes */
+	if (pctx->plogCurrent)
+		SessionLogSortPopulation(pctx->plogCurrent, pctx->pPopCurrent, pctx->pPopOther);
+	else
+		PopulationSortByFitnessInto(pctx->pPopCurrent, pctx->pPopOther, NULL);
+	SwapPointers((void**)&pctx->pPopCurrent, (void**)&pctx->pPopOther);
+	pctx->rSecondsEvaluating += Seconds() - rStart;
+	pctx->cEvaluations += pctx->pPopCurrent->cstg;
+	pctx->iGeneration++;
+	PopulationWriteBack(pctx->pPopCurrent);
+	if (pctx->parch)
+		ArchiveAppend(pctx->parch, pctx->iGeneration, pctx->pPopCurrent);
+}
+
+
+/* Advances the run by one generation: the first call evaluates the initial
+ * population, later calls breed a new population from the current one and
+ * evaluate that. With a surrogate model, several times as many children are
+ * bred, and only those it predicts fittest make up the new population. */
+void ContextStep(CONTEXT* pctx) {
+	ASSERT(pctx);
+	if (pctx->iGeneration > 0) {
+		double rStart = Seconds();
+		if (pctx->psur) {
+			EvolveChildren(&pctx->args, pctx->pPopCurrent, pctx->pPopPool, pctx->pPopPool->maxstg, &pctx->rng);
+			SurrogateScreen(pctx->psur, pctx->pPopCurrent, pctx->pPopPool, pctx->pPopOther, pctx->pPopCurrent->cstg);
+		} else {
+			EvolveNewPopulation(&pctx->args, pctx->pPopCurrent, pctx->pPopOther, &pctx->rng);
+		}
+		SwapPointers((void**)&pctx->pPopCurrent, (void**)&pctx->pPopOther);
+		if (pctx->plogCurrent)
+			SwapPointers((void**)&pctx->plogCurrent, (void**)&pctx->plogOther);
+		pctx->rSecondsBreeding += Seconds() - rStart;
+	}
+	ContextEvaluate(pctx);
+}
+
+
+/* Mean fitness of the current population */
+static double ContextMeanFitness(const CONTEXT* pctx) {
+	const POPULATION* pPop = pctx->pPopCurrent;
+	double rSum = 0.0;
+	int istg;
+	for (istg = 0; istg < pPop->cstg; ++istg)
+		rSum += pPop->rgstg[istg].rFitness;
+	return rSum / pPop->cstg;
+}
+
+
+/* Applies the run's early stopping criteria after step iStep (a generation,
+ * or a steady-state report) with the given best and mean fitness. Returns
+ * true, and records why, if evolution should stop. */
+static bool ContextStopCriteria(CONTEXT* pctx, int iStep, double rBestFitness, double rMeanFitness) {
+	const ARGS* pArgs = &pctx->args;
+	/* A record only moves when beaten by more than the tolerance, so slow
+	 * but steady progress still counts */
+	if (iStep == 1 || rBestFitness > pctx->rBestRecord + pArgs->rStopTolerance) {
+		pctx->rBestRecord = rBestFitness;
+		pctx->iImproved = iStep;
+	}
+	if (iStep == 1 || rMeanFitness > pctx->rMeanRecord + pArgs->rStopTolerance) {
+		pctx->rMeanRecord = rMeanFitness;
+		pctx->iImproved = iStep;
+	}
+
+	if (pArgs->bTargetFitness && rBestFitness >= pArgs->rTargetFitness)
+		snprintf(pctx->szStopReason, sizeof(pctx->szStopReason), "target fitness %g reached",
+			pArgs->rTargetFitness);
+	else if (pArgs->rTimeBudget > 0.0 && Seconds() - pctx->rCreated >= pArgs->rTimeBudget)
+		snprintf(pctx->szStopReason, sizeof(pctx->szStopReason), "time budget of %g seconds used",
+			pArgs->rTimeBudget);
+	else if (pArgs->cStopWindow > 0 && iStep - pctx->iImproved >= pArgs->cStopWindow)
+		snprintf(pctx->szStopReason, sizeof(pctx->szStopReason),
+			"no improvement over %g in best or mean fitness for %d %s", pArgs->rStopTolerance,
+			pArgs->cStopWindow, pArgs->evolutionType == Generational ? "generations" : "reports");
+	else
+		return false;
+	return true;
+}
+
+
+/* Checks the run's early stopping criteria (--time-budget, --target-fitness,
+ * --window) against the generation just evaluated. Returns true if evolution
+ * should stop; ContextGetStopReason says why. */
+bool ContextCheckStop(CONTEXT* pctx) {
+	ASSERT(pctx && pctx->iGeneration > 0);
+	return ContextStopCriteria(pctx, pctx->iGeneration, ContextGetBest(pctx)->rFitness, ContextMeanFitness(pctx));
+}
+
+
+/* Returns why evolution stopped early, or NULL if it has not */
+PCSZ ContextGetStopReason(const CONTEXT* pctx) {
+	ASSERT(pctx);
+	return pctx->szStopReason[0] ? pctx->szStopReason : NULL;
+}
+
+
+/* The caller's steady-state progress callback, and the context it also
+ * checks the stopping criteria of */
+typedef struct {
+	CONTEXT*        pctx;
+	PFNSTEADYREPORT pfnReport;
+	void*           pvReport;
+} CONTEXTREPORT; /* crpt */
+
+
+/* Steady-state progress callback: passes the report on, then stops if the
+ * caller or the stopping criteria say so */
+static bool ContextSteadyStateReport(void* pvReport, int iReport, double rBestFitness, double rMeanFitness) {
+	CONTEXTREPORT* pcrpt = (CONTEXTREPORT*) pvReport;
+	bool bStop = pcrpt->pfnReport && pcrpt->pfnReport(pcrpt->pvReport, iReport, rBestFitness, rMeanFitness);
+	return ContextStopCriteria(pcrpt->pctx, iReport, rBestFitness, rMeanFitness) || bStop;
+}
+
+
+/* Runs the whole evolution in steady-state mode (see EvolveSteadyState),
+ * leaving the final pool sorted by fitness. Stops early if pfnReport or the
+ * run's stopping criteria say so. */
+void ContextEvolveSteadyState(CONTEXT* pctx, PFNSTEADYREPORT pfnReport, void* pvReport) {
+	ASSERT(pctx);
+	ASSERT(pctx->iGeneration == 0);
+	double rStart = Seconds();
+	CONTEXTREPORT crpt = { .pctx = pctx, .pfnReport = pfnReport, .pvReport = pvReport };
+	long cEvaluations = EvolveSteadyState(&pctx->args, pctx->pPopCurrent, pctx->pwld, pctx->rgpwldScratch,
+		&pctx->rng, ContextSteadyStateReport, &crpt);
+	PopulationSortByFitnessInto(pctx->pPopCurrent, pctx->pPopOther, NULL);
+	SwapPointers((void**)&pctx->pPopCurrent, (void**)&pctx->pPopOther);
+	pctx->rSecondsEvaluating += Seconds() - rStart;
+	pctx->cEvaluations += cEvaluations;
+	pctx->iGeneration = (int)((cEvaluations + pctx->pPopCurrent->cstg - 1) / pctx->pPopCurrent->cstg);
+}
+
+
+/* Returns the fittest strategy of the most recently evaluated generation */
+const STRATEGY* ContextGetBest(const CONTEXT* pctx) {
+	ASSERT(pctx && pctx->iGeneration > 0);
+	return &pctx->pPopCurrent->rgstg[0];
+}
+
+
+/* Returns the current population (sorted by fitness once evaluated) */
+const POPULATION* ContextGetPopulation(const CONTEXT* pctx) {
+	ASSERT(pctx);
+	return pctx->pPopCurrent;
+}
+
+
+/* Returns the run's surrogate model, or NULL if it has none */
+const SURROGATE* ContextGetSurrogate(const CONTEXT* pctx) {
+	ASSERT(pctx);
+	return pctx->psur;
+}
+
+
+/* Scores the generalization of the given strategies (see
+ * CalculateGeneralization) using the context's world, test bank and scratch
+ * space */
+void ContextGeneralize(CONTEXT* pctx, STRATEGY** rgpstg, int cstg, GENERALIZATION* rggen) {
+	ASSERT(pctx);
+	double rStart = Seconds();
+	CalculateGeneralization(&pctx->args, rgpstg, cstg, pctx->pwld, pctx->pbank, pctx->rgpwldScratch, rggen);
+	pctx->rSecondsGeneralizing += Seconds() - rStart;
+}
+
+
+/* Returns how many actions all sessions so far have accounted for, and how
+ * many of those were fast-forwarded by cycle detection instead of simulated */
+void ContextGetActionCounts(const CONTEXT* pctx, uint64_t* pcActionsRun, uint64_t* pcActionsSkipped) {
+	ASSERT(pctx && pcActionsRun && pcActionsSkipped);
+	int i;
+	*pcActionsRun = *pcActionsSkipped = 0;
+	for (i = 0; i < pctx->cScratch; ++i) {
+		*pcActionsRun += pctx->rgpwldScratch[i]->cActionsRun;
+		*pcActionsSkipped += pctx->rgpwldScratch[i]->cActionsSkipped;
+	}
+	if (pctx->pring)
+		RingGetActionCounts(pctx->pring, pcActionsRun, pcActionsSkipped);
+}
+
+
+/* Returns how many strategy sessions evaluation has scored, and how many of
+ * those delta evaluation copied from a parent instead of running */
+void ContextGetSessionCounts(const CONTEXT* pctx, int64_t* pcSessionsScored, int64_t* pcSessionsReused) {
+	ASSERT(pctx && pcSessionsScored && pcSessionsReused);
+	*pcSessionsScored = pctx->cSessionsScored;
+	*pcSessionsReused = pctx->cSessionsReused;
+}
+
+
+/* Collects the hit counts of all sessions since the last call into pcnt and
+ * resets them. Must not be called while sessions are running. Builds without
+ * INSTRUMENT count nothing, and always return zeros. */
+void ContextTakeCounters(CONTEXT* pctx, COUNTERS* pcnt) {
+	ASSERT(pctx && pcnt);
+	memset(pcnt, 0, sizeof(COUNTERS));
+#ifdef INSTRUMENT
+	int i;
+	for (i = 0; i < pctx->cScratch; ++i) {
+		CountersAdd(pcnt, &pctx->rgpwldScratch[i]->cnt);
+		memset(&pctx->rgpwldScratch[i]->cnt, 0, sizeof(COUNTERS));
+	}
+#endif
+	if (pctx->pring)
+		RingTakeCounters(pctx->pring, pcnt);
+}
+
+
+/* Measures the diversity of the current population (see
+ * PopulationDiversity). Sampling draws from its own stream per generation,
+ * so it does not change the course of the run. */
+void ContextGetDiversity(const CONTEXT* pctx, DIVERSITY* pdiv) {
+	ASSERT(pctx && pdiv);
+	RNG rng;
+	RngSeedStream(&rng, pctx->args.nSeed ^ DIVERSITY_STREAM, pctx->iGeneration);
+	PopulationDiversity(pctx->pPopCurrent, &rng, pdiv);
+}
+
+
+/* Fills a metrics sample with the run's progress so far. Must not be called
+ * while sessions are running. */
+void ContextGetMetrics(const CONTEXT* pctx, PCSZ pszPhase, METRICSSAMPLE* psmp) {
+	ASSERT(pctx && pszPhase && psmp);
+	uint64_t cActionsRun, cActionsSkipped;
+	ContextGetActionCounts(pctx, &cActionsRun, &cActionsSkipped);
+	memset(psmp, 0, sizeof(METRICSSAMPLE));
+	psmp->pszPhase = pszPhase;
+	psmp->iGeneration = pctx->iGeneration;
+	psmp->cGenerations = pctx->args.cGenerations;
+	psmp->cEvaluations = pctx->cEvaluations;
+	psmp->cActions = cActionsRun;
+	psmp->rSecondsEvaluating = pctx->rSecondsEvaluating;
+	psmp->rSecondsBreeding = pctx->rSecondsBreeding;
+	psmp->rSecondsGeneralizing = pctx->rSecondsGeneralizing;
+	if (pctx->iGeneration > 0) {
+		psmp->rBestFitness = pctx->pPopCurrent->rgstg[0].rFitness;
+		psmp->rMeanFitness = ContextMeanFitness(pctx);
+	}
+}
@@ -0,0 +1,85 @@
+/*****************************************************************************
+ * context.h: Header for context.c.
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#pragma once
+#include "args.h"
+#include "population.h"
+#include "world.h"
+#include "bank.h"
+#include "archive.h"
+#include "evolve.h"
+#include "metrics.h"
+#include "surrogate.h"
+
+/*
+ * A CONTEXT is one complete, independent evolution run: it owns its world,
+ * populations, random number stream and per-thread scratch worlds, all
+ * allocated up front. Nothing in it is shared, so separate contexts may be
+ * driven from separate threads at the same time.
+ */
+typedef struct {
+	ARGS        args;          /* Copy of the run's parameters; threads resolved */
+	WORLD*      pwld;          /* The world template sessions are copied from */
+	BANK*       pbank;         /* Generalization layouts (--test-bank), or NULL */
+	RNG         rng;           /* Initial population and breeding */
+	POPULATION* pPopCurrent;   /* Sorted by fitness once evaluated */
+	POPULATION* pPopOther;     /* The next generation is bred into this */
+	WORLD**     rgpwldScratch; /* One session world per thread */
+	int         cScratch;      /* ...for the most threads the run has had */
+	int         iGeneration;   /* Generations evaluated so far */
+	ARCHIVE*    parch;         /* Every evaluated generation (--archive), or NULL */
+	SESSIONLOG* plogCurrent;   /* Session logs of the two populations, if */
+	SESSIONLOG* plogOther;     /* evaluating by delta (--delta); else NULL */
+	int64_t     cSessionsScored; /* Strategy sessions scored so far */
+	int64_t     cSessionsReused; /* ...of which were copied from a parent */
+	int64_t     cEvaluations;  /* Strategies evaluated so far */
+	double      rCreated;      /* Seconds at creation, for --time-budget */
+	double      rBestRecord;   /* Best and mean fitness records, and the */
+	double      rMeanRecord;   /* step either last beat its record by */
+	int         iImproved;     /* more than the tolerance (--window) */
+	char        szStopReason[128]; /* Why evolution stopped early, or "" */
+	RING*       pring;         /* Session worlds made ready by producer
+	                            * threads (--producers), or NULL */
+	SURROGATE*  psur;          /* Screens oversampled children (--surrogate), */
+	POPULATION* pPopPool;      /* which are bred into this; else both NULL */
+	double      rSecondsEvaluating; /* Time spent in each phase so far */
+	double      rSecondsBreeding;
+	double      rSecondsGeneralizing;
+} CONTEXT; /* ctx */
+
+/* Function prototypes */
+CONTEXT*          ContextCreate(const ARGS* pArgs, const WORLD* pwldTemplate);
+void              ContextDestroy(CONTEXT* pctx);
+void              ContextSetThreads(CONTEXT* pctx, int cThreads);
+void              ContextEvaluate(CONTEXT* pctx);
+void              ContextStep(CONTEXT* pctx);
+void              ContextEvolveSteadyState(CONTEXT* pctx, PFNSTEADYREPORT pfnReport, void* pvReport);
+bool              ContextCheckStop(CONTEXT* pctx);
+PCSZ              ContextGetStopReason(const CONTEXT* pctx);
+const STRATEGY*   ContextGetBest(const CONTEXT* pctx);
+const POPULATION* ContextGetPopulation(const CONTEXT* pctx);
+const SURROGATE*  ContextGetSurrogate(const CONTEXT* pctx);
+void              ContextGeneralize(CONTEXT* pctx, STRATEGY** rgpstg, int cstg, GENERALIZATION* rggen);
+void              ContextGetActionCounts(const CONTEXT* pctx, uint64_t* pcActionsRun, uint64_t* pcActionsSkipped);
+void              ContextGetSessionCounts(const CONTEXT* pctx, int64_t* pcSessionsScored, int64_t* pcSessionsReused);
+void              ContextTakeCounters(CONTEXT* pctx, COUNTERS* pcnt);
+void              ContextGetDiversity(const CONTEXT* pctx, DIVERSITY* pdiv);
+void              ContextGetMetrics(const CONTEXT* pctx, PCSZ pszPhase, METRICSSAMPLE* psmp);
@@ -0,0 +1,98 @@
+/*****************************************************************************
+ * dumparchive.c: Lists or dumps the generations of an archive written by
+ * robby --archive.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include "types.h"
+#include "error.h"
+#include "strategy.h"
+#include "population.h"
+#include "archive.h"
+
+
+/* Print program command-line usage */
+void Usage() {
+	fprintf(stderr, "Usage: ./dumparchive <Archive file> [Generation]\n");
+	fprintf(stderr, "Reads a generation archive written by robby --archive. Without a\n"
+	                "generation, lists every generation's best and mean fitness; with one,\n"
+	                "prints that generation's strategies (fitness, parent rank, genes).\n");
+}
+
+
+/* Lists one line per archived generation */
+static void ListGenerations(const ARCHIVEREADER* prdr) {
+	int iRecord, istg;
+	puts("# Generation\tBest\tMean");
+	for (iRecord = 0; iRecord < prdr->cRecords; ++iRecord) {
+		const double* rgrFitness = ArchiveGetFitness(prdr, iRecord);
+		double rSum = 0.0;
+		for (istg = 0; istg < prdr->cstg; ++istg)
+			rSum += rgrFitness[istg];
+		printf("%d\t\t%g\t%g\n", ArchiveGetGeneration(prdr, iRecord), rgrFitness[0], rSum / prdr->cstg);
+	}
+}
+
+
+/* Prints every strategy of one archived generation */
+static void DumpGeneration(ARCHIVEREADER* prdr, int iGeneration) {
+	int iRecord, istg, iact;
+	for (iRecord = 0; iRecord < prdr->cRecords; ++iRecord) {
+		if (ArchiveGetGeneration(prdr, iRecord) == iGeneration)
+			break;
+	}
+	if (iRecord == prdr->cRecords)
+		Die("Generation %d is not in the archive", iGeneration);
+
+	POPULATION* pPop = PopulationCreate(prdr->cstg);
+	ArchiveReadPopulation(prdr, iRecord, pPop);
+	puts("# Rank\tFitness\tParent\tGenes");
+	for (istg = 0; istg < pPop->cstg; ++istg) {
+		const STRATEGY* pstg = &pPop->rgstg[istg];
+		printf("%d\t%g\t%d\t", istg, pstg->rFitness, pstg->istgParent);
+		for (iact = 0; iact < STRATEGY_LENGTH; ++iact)
+			putchar('0' + StrategyGetAction(pstg, iact));
+		putchar('\n');
+	}
+	PopulationDestroy(pPop);
+}
+
+
+/* Program entry point */
+int main(int argc, char** argv) {
+	if (argc < 2 || argc > 3) {
+		Usage();
+		exit(EXIT_FAILURE);
+	}
+	ARCHIVEREADER* prdr = ArchiveOpen(argv[1]);
+	printf("# %s: %d generations of %d strategies\n", argv[1], prdr->cRecords, prdr->cstg);
+	if (argc == 2)
+		ListGenerations(prdr);
+	else
+		DumpGeneration(prdr, atoi(argv[2]));
+	ArchiveCloseReader(prdr);
+	return 0;
+}
@@ -0,0 +1,1023 @@
+/*****************************************************************************
+ * evolve.c: Fitness evaluation, generalization scoring and breeding
+ * of strategies; the core of the genetic algorithm.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <limits.h> /* INT_MAX */
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "error.h"
+#include "args.h"
+#include "parallel.h"
+#include "rng.h"
+#include "strategy.h"
+#include "population.h"
+#include "world.h"
+#include "bank.h"
+#include "ring.h"
+#include "robby.h"
+#include "evolve.h"
+
+
+/* Generalization scoring runs sessions in rounds until the 95% confidence
+ * interval of each strategy's mean score is narrower than the target, or the
+ * session cap is reached */
+#define GENERALIZATION_MIN_SESSIONS	200
+#define GENERALIZATION_MAX_SESSIONS	10000
+#define GENERALIZATION_ITEM_SESSIONS	4   /* Sessions per parallel work item */
+#define GENERALIZATION_Z95		1.96
+/* Stream families, so that no two kinds of work share random numbers */
+#define FITNESS_STREAM			0x4669746e657373ULL
+#define GENERALIZATION_STREAM		0x47656e6572616cULL
+#define RING_STREAM			0x52696e674c6179ULL
+
+
+/* Shared state for one round of parallel generalization sessions */
+typedef struct {
+	const ARGS*     pArgs;
+	const WORLD*    pWorld;
+	const BANK*     pbank;        /* Layouts to use, or NULL to draw them */
+	STRATEGY**      rgpstg;       /* Strategies being scored */
+	int*            rgistgActive; /* Strategies still running this round */
+	int             cActive;
+	int             iSessionFirst;
+	WORLD**         rgpwld;       /* Scratch world per thread */
+	int64_t*        rgnScoreSum;  /* Per work item and active strategy */
+	int64_t*        rgnScoreSquareSum;
+} GENERALIZATIONROUND; /* round */
+
+
+/* Steady-state evolution */
+#define STEADY_QUEUE_LENGTH		64 /* Bred children waiting for a worker */
+#define STEADY_TOURNAMENT_SIZE		4
+#define STEADY_STREAM			0x5374656164794aULL
+
+
+/* Shared state for steady-state evolution. The pool and the queue of bred
+ * children are guarded by one mutex; simulation and reports run outside of
+ * it. */
+typedef struct {
+	const ARGS*     pArgs;
+	const WORLD*    pWorld;
+	POPULATION*     pPop;          /* The pool; always full */
+	WORLD**         rgpwld;        /* Scratch world per worker */
+	RNG*            prngBreed;     /* Used by the breeder thread only */
+	PFNSTEADYREPORT pfnReport;
+	void*           pvReport;
+	pthread_mutex_t mutex;
+	pthread_cond_t  condChild;     /* Signaled when a child is queued */
+	pthread_cond_t  condRoom;      /* Signaled when the queue has room */
+	STRATEGY*       rgstgQueue;    /* STEADY_QUEUE_LENGTH entries */
+	int             iQueueHead;
+	int             cQueue;
+	long            maxChildren;   /* Children to breed and evaluate in total;
+	                                * cut to those taken if a report stops */
+	long            cChildrenBred;
+	long            cChildrenTaken;
+	long            cChildrenDone;
+	int             iReport;
+	int             istgBest;      /* Fittest pool member */
+	double          rFitnessSum;   /* Over the pool */
+	int*            rgistgHeap;    /* Replace-worst only: the pool as a min-heap */
+	int*            rgiHeap;       /* ...and each member's place in it */
+	pthread_mutex_t mutexReport;   /* Held while a report runs; taken before
+	                                * the pool mutex is let go, so reports
+	                                * keep their order */
+} STEADYSTATE; /* ss */
+
+typedef struct {
+	STEADYSTATE* pss;
+	int          iWorker;
+} STEADYWORKER; /* wrk */
+
+
+/* Shared state for parallel fitness evaluation */
+typedef struct {
+	const ARGS*  pArgs;
+	POPULATION*  pPop;
+	const WORLD* pWorld;
+	WORLD**      rgpwld;       /* Scratch world per thread */
+	int          iGeneration;
+} FITNESSJOB; /* job */
+
+
+/* Shared state for fitness evaluation through a layout ring */
+typedef struct {
+	const ARGS*  pArgs;
+	POPULATION*  pPop;
+	RING*        pring;
+	int64_t*     rgnScoreSum;  /* Per strategy; added to atomically */
+} RINGJOB; /* job */
+
+
+/* Shared state for parallel delta evaluation */
+typedef struct {
+	const ARGS*       pArgs;
+	POPULATION*       pPop;
+	SESSIONLOG*       plog;
+	const POPULATION* pPopParents; /* The sorted previous generation, or NULL */
+	const SESSIONLOG* plogParents;
+	const WORLD*      pWorld;
+	WORLD**           rgpwld;      /* Scratch world per thread */
+	int               iGeneration;
+} DELTAJOB; /* job */
+
+
+/* Shared state for parallel breeding */
+#define BREED_ITEM_PAIRS	8 /* Parent pairs per parallel work item */
+
+typedef struct {
+	const ARGS*  pArgs;
+	POPULATION*  pPopOld;
+	POPULATION*  pPopNew;
+	uint64_t     nSeed;        /* Pair i breeds from stream i of this */
+} BREEDJOB; /* job */
+
+
+/* Scores one strategy over pArgs->cSessions fresh random layouts, using
+ * pwldScratch as the session world; returns the average score */
+double EvaluateStrategy(const ARGS* pArgs, STRATEGY* pstg, const WORLD* pWorld, WORLD* pwldScratch, RNG* prng) {
+	ASSERT(pArgs && pstg && pWorld && pwldScratch && prng);
+
+	int iSession, nScoreSum = 0;
+	for (iSession = 0; iSession < pArgs->cSessions; ++iSession) {
+		/* Start with a fresh world with randomly placed cans
+		 * for each cleaning run */
+		WorldCopy(pWorld, pwldScratch);
+		WorldSetCansRandomly(pwldScratch, pArgs->rCanProbability, prng);
+		//WorldDump(pwldScratch, stdout);
+		nScoreSum += RobbyClean(pArgs, pwldScratch, pstg, pArgs->cSessionActions, prng);
+	}
+	return (double)nScoreSum / (double)pArgs->cSessions;
+}
+
+
+/* ParallelFor callback: evaluates one strategy of a population. Each strategy
+ * gets its own stream per generation, so fitness does not depend on the
+ * thread count. */
+static void FitnessWork(void* pvJob, int istg, int iThread) {
+	FITNESSJOB* pjob = (FITNESSJOB*) pvJob;
+	RNG rng;
+	PopulationPrefetch(pjob->pPop, istg, 1);
+	RngSeedStream(&rng, pjob->pArgs->nSeed ^ FITNESS_STREAM,
+		((uint64_t)pjob->iGeneration << 32) | (uint64_t)istg);
+	pjob->pPop->rgstg[istg].rFitness = EvaluateStrategy(pjob->pArgs,
+		&pjob->pPop->rgstg[istg], pjob->pWorld, pjob->rgpwld[iThread], &rng);
+	//Debug("Strategy %d: %g", istg, pjob->pPop->rgstg[istg].rFitness);
+}
+
+
+/* ParallelFor callback: runs session iItem of the generation, which is
+ * session iItem % cSessions of strategy iItem / cSessions, on the world the
+ * layout ring made ready for it */
+static void RingFitnessWork(void* pvJob, int iItem, int iThread) {
+	RINGJOB* pjob = (RINGJOB*) pvJob;
+	const ARGS* pArgs = pjob->pArgs;
+	const int istg = iItem / pArgs->cSessions;
+	RNG* prng;
+	if (iItem % pArgs->cSessions == 0)
+		PopulationPrefetch(pjob->pPop, istg, 1);
+	WORLD* pwld = RingTake(pjob->pring, iItem, &prng);
+	int nScore = RobbyClean(pArgs, pwld, &pjob->pPop->rgstg[istg], pArgs->cSessionActions, prng);
+	RingRelease(pjob->pring, iItem);
+	__atomic_fetch_add(&pjob->rgnScoreSum[istg], nScore, __ATOMIC_RELAXED);
+}
+
+
+/* Calculates the fitness of a population as CalculateFitness does, but with
+ * the ring's producer threads copying the world and placing cans ahead of
+ * the pArgs->cThreads evaluation threads. Layouts and random moves come
+ * from a stream per session rather than per strategy, so fitness differs
+ * from CalculateFitness's, but is just as reproducible. */
+void CalculateFitnessRing(const ARGS* pArgs, POPULATION* pPopulation, RING* pring, int iGeneration) {
+	ASSERT(pArgs && pPopulation && pring);
+	ASSERT(pArgs->cThreads > 0);
+	ASSERT((int64_t)pPopulation->cstg * pArgs->cSessions <= INT_MAX);
+
+	const int cItems = pPopulation->cstg * pArgs->cSessions;
+	int64_t* rgnScoreSum = (int64_t*) calloc(pPopulation->cstg, sizeof(int64_t));
+	VerifyAlloc(rgnScoreSum, "score sums (%d strategies)", pPopulation->cstg);
+	RINGJOB job = {
+		.pArgs       = pArgs,
+		.pPop        = pPopulation,
+		.pring       = pring,
+		.rgnScoreSum = rgnScoreSum
+	};
+	RingStart(pring, pArgs->nSeed ^ RING_STREAM, (uint64_t)iGeneration << 32, cItems);
+	ParallelFor(pArgs->cThreads, cItems, RingFitnessWork, &job);
+	RingFinish(pring);
+
+	int istg;
+	for (istg = 0; istg < pPopulation->cstg; ++istg)
+		pPopulation->rgstg[istg].rFitness = (double)rgnScoreSum[istg] / (double)pArgs->cSessions;
+	free(rgnScoreSum);
+}
+
+
+/* Allocates a session log for cstg strategies of cSessions sessions each */
+SESSIONLOG* SessionLogCreate(int cstg, int cSessions) {
+	ASSERT(cstg > 0 && cSessions > 0);
+	SESSIONLOG* plog = (SESSIONLOG*) malloc(sizeof(SESSIONLOG));
+	VerifyAlloc(plog, "session log");
+	size_t cEntries = (size_t)cstg * cSessions;
+	plog->cstg = cstg;
+	plog->cSessions = cSessions;
+	plog->rgrng = (RNG*) malloc(sizeof(RNG) * cEntries);
+	plog->rgnScore = (int*) malloc(sizeof(int) * cEntries);
+	plog->rgnSeen = (uint64_t*) malloc(sizeof(uint64_t) * WORLD_SEEN_WORDS * cEntries);
+	plog->rgcReused = (int*) malloc(sizeof(int) * cstg);
+	plog->rgistgFrom = (int*) malloc(sizeof(int) * cstg);
+	VerifyAlloc(plog->rgrng && plog->rgnScore && plog->rgnSeen && plog->rgcReused && plog->rgistgFrom ? plog : NULL,
+		"session log (%d strategies, %d sessions)", cstg, cSessions);
+	return plog;
+}
+
+
+/* Deallocates a session log allocated with SessionLogCreate */
+void SessionLogDestroy(SESSIONLOG* plog) {
+	ASSERT(plog);
+	free(plog->rgrng);
+	free(plog->rgnScore);
+	free(plog->rgnSeen);
+	free(plog->rgcReused);
+	free(plog->rgistgFrom);
+	free(plog);
+}
+
+
+/* Sorts a population by fitness into pPopSorted, as
+ * PopulationSortByFitnessInto does, and reorders its session log to match */
+void SessionLogSortPopulation(SESSIONLOG* plog, const POPULATION* pPop, POPULATION* pPopSorted) {
+	ASSERT(plog && pPop && pPopSorted && pPop->cstg == plog->cstg);
+	const int cstg = plog->cstg, cSessions = plog->cSessions;
+	PopulationSortByFitnessInto(pPop, pPopSorted, plog->rgistgFrom);
+
+	RNG* rgrng = (RNG*) malloc(sizeof(RNG) * cstg * cSessions);
+	int* rgnScore = (int*) malloc(sizeof(int) * cstg * cSessions);
+	uint64_t* rgnSeen = (uint64_t*) malloc(sizeof(uint64_t) * WORLD_SEEN_WORDS * cstg * cSessions);
+	VerifyAlloc(rgrng && rgnScore && rgnSeen ? rgrng : NULL, "sorted session log");
+	int istg;
+	for (istg = 0; istg < cstg; ++istg) {
+		size_t iFrom = (size_t)plog->rgistgFrom[istg] * cSessions, iTo = (size_t)istg * cSessions;
+		memcpy(&rgrng[iTo], &plog->rgrng[iFrom], sizeof(RNG) * cSessions);
+		memcpy(&rgnScore[iTo], &plog->rgnScore[iFrom], sizeof(int) * cSessions);
+		memcpy(&rgnSeen[iTo * WORLD_SEEN_WORDS], &plog->rgnSeen[iFrom * WORLD_SEEN_WORDS],
+			sizeof(uint64_t) * WORLD_SEEN_WORDS * cSessions);
+	}
+	free(plog->rgrng);
+	free(plog->rgnScore);
+	free(plog->rgnSeen);
+	plog->rgrng = rgrng;
+	plog->rgnScore = rgnScore;
+	plog->rgnSeen = rgnSeen;
+}
+
+
+/* Runs one session of a strategy from the stream prng, which it advances,
+ * marking the states Robby acts in into rgnSeen; returns the score */
+static int RunLoggedSession(const ARGS* pArgs, STRATEGY* pstg, const WORLD* pWorld, WORLD* pwld, RNG* prng,
+                            uint64_t* rgnSeen) {
+	WorldCopy(pWorld, pwld);
+	WorldSetCansRandomly(pwld, pArgs->rCanProbability, prng);
+	memset(rgnSeen, 0, sizeof(uint64_t) * WORLD_SEEN_WORDS);
+	pwld->rgnSeen = rgnSeen;
+	int nScore = RobbyClean(pArgs, pwld, pstg, pArgs->cSessionActions, prng);
+	pwld->rgnSeen = NULL;
+	return nScore;
+}
+
+
+/* ParallelFor callback: scores one strategy for delta evaluation. A strategy
+ * with a parent inherits the parent's sessions and reruns only those in
+ * which the parent acted in a state whose gene it changed; in every other
+ * session it would act exactly as the parent did. A strategy without one
+ * runs fresh sessions, drawn as FitnessWork draws them. */
+static void DeltaFitnessWork(void* pvJob, int istg, int iThread) {
+	DELTAJOB* pjob = (DELTAJOB*) pvJob;
+	const ARGS* pArgs = pjob->pArgs;
+	const int cSessions = pArgs->cSessions;
+	STRATEGY* pstg = &pjob->pPop->rgstg[istg];
+	WORLD* pwld = pjob->rgpwld[iThread];
+	size_t iFirst = (size_t)istg * cSessions;
+	RNG* rgrng = &pjob->plog->rgrng[iFirst];
+	int* rgnScore = &pjob->plog->rgnScore[iFirst];
+	uint64_t* rgnSeen = &pjob->plog->rgnSeen[iFirst * WORLD_SEEN_WORDS];
+	int iSession, iWord, iact, nScoreSum = 0, cReused = 0;
+	PopulationPrefetch(pjob->pPop, istg, 1);
+
+	if (pjob->pPopParents && pstg->istgParent >= 0) {
+		const STRATEGY* pstgParent = &pjob->pPopParents->rgstg[pstg->istgParent];
+		size_t iParentFirst = (size_t)pstg->istgParent * cSessions;
+		uint64_t rgnChanged[WORLD_SEEN_WORDS] = { 0 };
+		for (iact = 0; iact < STRATEGY_LENGTH; ++iact) {
+			if (StrategyGetAction(pstg, iact) != StrategyGetAction(pstgParent, iact))
+				rgnChanged[(iact % WORLD_SEEN_BITS) / 64] |= 1ULL << (iact % 64);
+		}
+		memcpy(rgrng, &pjob->plogParents->rgrng[iParentFirst], sizeof(RNG) * cSessions);
+		memcpy(rgnScore, &pjob->plogParents->rgnScore[iParentFirst], sizeof(int) * cSessions);
+		memcpy(rgnSeen, &pjob->plogParents->rgnSeen[iParentFirst * WORLD_SEEN_WORDS],
+			sizeof(uint64_t) * WORLD_SEEN_WORDS * cSessions);
+		for (iSession = 0; iSession < cSessions; ++iSession) {
+			uint64_t* pnSeen = &rgnSeen[iSession * WORLD_SEEN_WORDS];
+			uint64_t nOverlap = 0;
+			for (iWord = 0; iWord < WORLD_SEEN_WORDS; ++iWord)
+				nOverlap |= pnSeen[iWord] & rgnChanged[iWord];
+			if (nOverlap) {
+				RNG rng = rgrng[iSession];
+				rgnScore[iSession] = RunLoggedSession(pArgs, pstg, pjob->pWorld, pwld, &rng, pnSeen);
+			} else {
+				++cReused;
+			}
+			nScoreSum += rgnScore[iSession];
+		}
+	} else {
+		RNG rng;
+		RngSeedStream(&rng, pArgs->nSeed ^ FITNESS_STREAM, ((uint64_t)pjob->iGeneration << 32) | (uint64_t)istg);
+		for (iSession = 0; iSession < cSessions; ++iSession) {
+			rgrng[iSession] = rng;
+			rgnScore[iSession] = RunLoggedSession(pArgs, pstg, pjob->pWorld, pwld, &rng,
+				&rgnSeen[iSession * WORLD_SEEN_WORDS]);
+			nScoreSum += rgnScore[iSession];
+		}
+	}
+	pjob->plog->rgcReused[istg] = cReused;
+	pstg->rFitness = (double)nScoreSum / (double)cSessions;
+}
+
+
+/* Delta evaluation: calculates the fitness of a population as
+ * CalculateFitness does, except that each strategy with a parent is scored
+ * on its parent's sessions (from plogParents), running again only the
+ * sessions its changed genes could affect, and records its own sessions in
+ * plog. pPopParents is the sorted generation it was bred from, or NULL if
+ * there is none. Fitness is exactly what running every session would give.
+ * Returns the number of sessions copied instead of run. */
+int64_t CalculateFitnessDelta(const ARGS* pArgs, POPULATION* pPopulation, SESSIONLOG* plog,
+                              const POPULATION* pPopParents, const SESSIONLOG* plogParents,
+                              const WORLD* pWorld, WORLD** rgpwldScratch, int iGeneration) {
+	ASSERT(pArgs && pPopulation && plog && pWorld && rgpwldScratch);
+	ASSERT(plog->cstg == pPopulation->cstg && plog->cSessions == pArgs->cSessions);
+	ASSERT(!pPopParents || (plogParents && plogParents->cstg == pPopParents->cstg));
+
+	DELTAJOB job = {
+		.pArgs       = pArgs,
+		.pPop        = pPopulation,
+		.plog        = plog,
+		.pPopParents = pPopParents,
+		.plogParents = plogParents,
+		.pWorld      = pWorld,
+		.rgpwld      = rgpwldScratch,
+		.iGeneration = iGeneration
+	};
+	ParallelFor(pArgs->cThreads, pPopulation->cstg, DeltaFitnessWork, &job);
+
+	int64_t cReused = 0;
+	int istg;
+	for (istg = 0; istg < pPopulation->cstg; ++istg)
+		cReused += plog->rgcReused[istg];
+	return cReused;
+}
+
+
+/* Calculate fitness of a population, spreading strategies over
+ * pArgs->cThreads threads. rgpwldScratch holds one world per thread. */
+void CalculateFitness(const ARGS* pArgs, POPULATION* pPopulation, const WORLD* pWorld, WORLD** rgpwldScratch, int iGeneration) {
+	ASSERT(pArgs && pPopulation && pWorld && rgpwldScratch);
+	ASSERT(pArgs->cThreads > 0);
+
+	FITNESSJOB job = {
+		.pArgs       = pArgs,
+		.pPop        = pPopulation,
+		.pWorld      = pWorld,
+		.rgpwld      = rgpwldScratch,
+		.iGeneration = iGeneration
+	};
+	ParallelFor(pArgs->cThreads, pPopulation->cstg, FitnessWork, &job);
+}
+
+
+/* ParallelFor callback: runs one work item's worth of generalization sessions
+ * for every active strategy. Each session's layout is set once and restored
+ * from the world's undo log between strategies, so all strategies are scored
+ * on the same layouts. Session i always uses stream i (and bank layout i, if
+ * there is a bank), so the result does not depend on the thread count. */
+static void GeneralizationWork(void* pvRound, int iItem, int iThread) {
+	GENERALIZATIONROUND* pround = (GENERALIZATIONROUND*) pvRound;
+	const ARGS* pArgs = pround->pArgs;
+	const int iSessionFirst = pround->iSessionFirst + iItem * GENERALIZATION_ITEM_SESSIONS;
+	int64_t* rgnScoreSum = &pround->rgnScoreSum[iItem * pround->cActive];
+	int64_t* rgnScoreSquareSum = &pround->rgnScoreSquareSum[iItem * pround->cActive];
+	WORLD* pwldCurrent = pround->rgpwld[iThread];
+
+	int iSession, iActive;
+	for (iActive = 0; iActive < pround->cActive; ++iActive)
+		rgnScoreSum[iActive] = rgnScoreSquareSum[iActive] = 0;
+
+	for (iSession = iSessionFirst; iSession < iSessionFirst + GENERALIZATION_ITEM_SESSIONS; ++iSession) {
+		RNG rngLayout;
+		if (pround->pbank) {
+			/* Random moves depend on the bank, not the run, so banked
+			 * scores are comparable across runs */
+			RngSeedStream(&rngLayout, pround->pbank->nSeed ^ GENERALIZATION_STREAM, iSession);
+			BankSetLayout(pround->pbank, iSession, pround->pWorld, pwldCurrent);
+		} else {
+			RngSeedStream(&rngLayout, pArgs->nSeed ^ GENERALIZATION_STREAM, iSession);
+			WorldCopy(pround->pWorld, pwldCurrent);
+			WorldSetCansRandomly(pwldCurrent, pArgs->rCanProbability, &rngLayout);
+		}
+		for (iActive = 0; iActive < pround->cActive; ++iActive) {
+			/* Every strategy continues the same stream for its random moves */
+			RNG rngMoves = rngLayout;
+			STRATEGY* pstg = pround->rgpstg[pround->rgistgActive[iActive]];
+			int nScore = RobbyClean(pArgs, pwldCurrent, pstg, pArgs->cSessionActions, &rngMoves);
+			rgnScoreSum[iActive] += nScore;
+			rgnScoreSquareSum[iActive] += (int64_t)nScore * nScore;
+			WorldRestoreLayout(pwldCurrent);
+		}
+	}
+}
+
+
+/* Calculate generalization scores for several strategies at once. Sessions are
+ * run in parallel rounds; a strategy stops once its 95% confidence interval
+ * half-width drops to the target (pArgs->rGeneralizeWidth) or it reaches
+ * GENERALIZATION_MAX_SESSIONS. rgpwldScratch holds one world per thread, each
+ * with undo enabled for at least pArgs->cSessionActions removals.
+ * If pbank is not NULL, session i is played on the bank's layout i instead of
+ * a freshly drawn one, and no strategy runs more sessions than the bank holds. */
+void CalculateGeneralization(const ARGS* pArgs, STRATEGY** rgpstg, int cstg, const WORLD* pWorld, const BANK* pbank,
+                             WORLD** rgpwldScratch, GENERALIZATION* rggen) {
+	ASSERT(pArgs && rgpstg && pWorld && rgpwldScratch && rggen);
+	ASSERT(cstg > 0);
+	ASSERT(pArgs->cThreads > 0);
+
+	const int cItems = GENERALIZATION_ROUND_SESSIONS / GENERALIZATION_ITEM_SESSIONS;
+	int maxSessions = GENERALIZATION_MAX_SESSIONS;
+	if (pbank) {
+		if (pbank->cLayouts < GENERALIZATION_ROUND_SESSIONS)
+			Die("Layout bank has %d layouts; at least %d are needed", pbank->cLayouts,
+				GENERALIZATION_ROUND_SESSIONS);
+		if (pbank->cLayouts < GENERALIZATION_MAX_SESSIONS)
+			maxSessions = pbank->cLayouts / GENERALIZATION_ROUND_SESSIONS * GENERALIZATION_ROUND_SESSIONS;
+	}
+
+	int* rgistgActive = (int*) malloc(sizeof(int) * cstg);
+	VerifyAlloc(rgistgActive, "active strategies");
+	int64_t* rgnScoreSum = (int64_t*) malloc(sizeof(int64_t) * cItems * cstg);
+	VerifyAlloc(rgnScoreSum, "score sums");
+	int64_t* rgnScoreSquareSum = (int64_t*) malloc(sizeof(int64_t) * cItems * cstg);
+	VerifyAlloc(rgnScoreSquareSum, "score square sums");
+
+	GENERALIZATIONROUND round = {
+		.pArgs             = pArgs,
+		.pWorld            = pWorld,
+		.pbank             = pbank,
+		.rgpstg            = rgpstg,
+		.rgistgActive      = rgistgActive,
+		.cActive           = 0,
+		.iSessionFirst     = 0,
+		.rgpwld            = rgpwldScratch,
+		.rgnScoreSum       = rgnScoreSum,
+		.rgnScoreSquareSum = rgnScoreSquareSum
+	};
+
+	int i, istg, iActive;
+	memset(rggen, 0, sizeof(GENERALIZATION) * cstg);
+
+	for (;;) {
+		round.cActive = 0;
+		for (istg = 0; istg < cstg; ++istg) {
+			if (!rggen[istg].bDone)
+				rgistgActive[round.cActive++] = istg;
+		}
+		if (round.cActive == 0)
+			break;
+
+		ParallelFor(pArgs->cThreads, cItems, GeneralizationWork, &round);
+		round.iSessionFirst += GENERALIZATION_ROUND_SESSIONS;
+
+		for (iActive = 0; iActive < round.cActive; ++iActive) {
+			GENERALIZATION* pgen = &rggen[rgistgActive[iActive]];
+			for (i = 0; i < cItems; ++i) {
+				pgen->nScoreSum += rgnScoreSum[i * round.cActive + iActive];
+				pgen->nScoreSquareSum += rgnScoreSquareSum[i * round.cActive + iActive];
+			}
+			pgen->cSessions += GENERALIZATION_ROUND_SESSIONS;
+
+			double n = (double)pgen->cSessions;
+			double rVariance = ((double)pgen->nScoreSquareSum -
+				(double)pgen->nScoreSum * (double)pgen->nScoreSum / n) / (n - 1.0);
+			pgen->rMean = (double)pgen->nScoreSum / n;
+			pgen->rHalfWidth = GENERALIZATION_Z95 * sqrt(rVariance > 0.0 ? rVariance / n : 0.0);
+			if (pgen->cSessions >= maxSessions ||
+			    (pgen->cSessions >= GENERALIZATION_MIN_SESSIONS &&
+			     pgen->rHalfWidth <= pArgs->rGeneralizeWidth))
+				pgen->bDone = true;
+		}
+	}
+	free(rgnScoreSquareSum);
+	free(rgnScoreSum);
+	free(rgistgActive);
+}
+
+
+/* Selects a parent for mating based on fitness rank of a (pre-sorted) population */
+int SelectParent(POPULATION* pPop, RNG* prng) {
+	ASSERT(pPop && prng);
+
+	const int nPopSize = pPop->cstg;
+	int istg = RngInt(prng, nPopSize);
+	int cTries = nPopSize;
+	/* sum = 1 + 2 + ... + n (where n is population size) or
+	 * n(n+1)/2 */
+	double sum = (double)nPopSize * (nPopSize + 1) / 2;
+	while (cTries-- > 0) {
+		/* istg is the index of the strategy we're looking at *and*
+		 * its (0-based) rank.
+		 * The probability that each individual will be chosen:
+		 *    POPULATION_SIZE - fitness_rank + 1
+		 *   ------------------------------------
+		 *    1 + 2 + ... + POPULATION_SIZE
+		 */
+		double rRandom = RngZeroOne(prng);
+		double rProb = (double)(nPopSize - istg + 1) / sum;
+		if (rRandom < rProb)
+			return istg;
+
+		istg = (istg + 1) % nPopSize;
+	}
+	return RngInt(prng, nPopSize);
+}
+
+
+/* Mates two strategies given a crossover index, putting resulting ACTION set into child */
+void MateStrategies(
+	const STRATEGY* pstgMother,
+	const STRATEGY* pstgFather,
+	STRATEGY* pstgChild,
+	int iactCrossover)
+{
+	ASSERT(pstgMother && pstgFather && pstgChild);
+	ASSERT(iactCrossover >= 0 && iactCrossover < STRATEGY_LENGTH);
+
+#ifdef PACKED_GENOME
+	/* Whole words from each side, and the word holding the crossover point
+	 * merged under a mask */
+	int iWord = iactCrossover / GENES_PER_WORD;
+	uint64_t nMaskMother = ((uint64_t)1 << (GENE_BITS * (iactCrossover % GENES_PER_WORD))) - 1;
+	size_t cb = sizeof(pstgChild->rgnGenes[0]);
+
+	memcpy(&pstgChild->rgnGenes[0], &pstgMother->rgnGenes[0], cb * iWord);
+	pstgChild->rgnGenes[iWord] = (pstgMother->rgnGenes[iWord] & nMaskMother) |
+		(pstgFather->rgnGenes[iWord] & ~nMaskMother);
+	memcpy(&pstgChild->rgnGenes[iWord + 1], &pstgFather->rgnGenes[iWord + 1], cb * (GENOME_WORDS - iWord - 1));
+#else
+	size_t as = sizeof(pstgMother->rgact[0]);
+	int cactMother = iactCrossover;
+	int cactFather = STRATEGY_LENGTH - iactCrossover;
+
+	memcpy(&pstgChild->rgact[0], &pstgMother->rgact[0], as * cactMother);
+	memcpy(&pstgChild->rgact[iactCrossover], &pstgFather->rgact[iactCrossover], as * cactFather);
+#endif
+}
+
+
+/* Mutate given strategy. "For each number in the child's chromosome, with
+ * probability MUTATION PROBABILITY replace that number with a randomly
+ * generated number between 0 and 6." */
+void MutateStrategy(double rMutationProbability, STRATEGY* pstg, RNG* prng) {
+	int iact;
+#if STRATEGY_LENGTH > 4096
+	/* Large genomes: rather than a draw per gene, jump straight from one
+	 * mutated gene to the next. Geometric gaps give every gene the same
+	 * independent chance. */
+	if (rMutationProbability >= 1.0) {
+		for (iact = 0; iact < STRATEGY_LENGTH; ++iact)
+			StrategySetAction(pstg, iact, RngInt(prng, NUM_ACTIONS));
+		return;
+	}
+	if (rMutationProbability <= 0.0)
+		return;
+	const double rLogMiss = log1p(-rMutationProbability);
+	double rNext = -1.0;
+	for (;;) {
+		rNext += 1.0 + floor(log(1.0 - RngZeroOne(prng)) / rLogMiss);
+		if (rNext >= (double)STRATEGY_LENGTH)
+			break;
+		StrategySetAction(pstg, (int)rNext, RngInt(prng, NUM_ACTIONS));
+	}
+#else
+	for (iact = 0; iact < STRATEGY_LENGTH; ++iact) {
+		if (RngZeroOne(prng) < rMutationProbability)
+			StrategySetAction(pstg, iact, RngInt(prng, NUM_ACTIONS));
+	}
+#endif
+}
+
+
+/* ParallelFor callback: breeds one work item's worth of parent pairs. Pair i
+ * draws from stream i and writes its two children straight into slots 2i
+ * and 2i + 1 of the new population, so the result does not depend on the
+ * thread count. */
+static void BreedWork(void* pvJob, int iItem, int iThread) {
+	BREEDJOB* pjob = (BREEDJOB*) pvJob;
+	const ARGS* pArgs = pjob->pArgs;
+	POPULATION* pPopOld = pjob->pPopOld;
+	const int cstg = pjob->pPopNew->cstg;
+	int iPair;
+
+	/* Children are written in order; parents are read at random */
+	PopulationPrefetch(pjob->pPopNew, 2 * iItem * BREED_ITEM_PAIRS, 2 * BREED_ITEM_PAIRS);
+	for (iPair = iItem * BREED_ITEM_PAIRS; iPair < (iItem + 1) * BREED_ITEM_PAIRS && 2 * iPair < cstg; ++iPair) {
+		STRATEGY* pstgMother;
+		STRATEGY* pstgFather;
+		int istgMother, istgFather;
+		RNG rng;
+		RngSeedStream(&rng, pjob->nSeed, iPair);
+
+		/* Pick parents via "roulette-wheel" selection */
+		istgMother = SelectParent(pPopOld, &rng);
+		istgFather = SelectParent(pPopOld, &rng);
+		ASSERT(istgMother >= 0 && istgMother < pPopOld->cstg);
+		ASSERT(istgFather >= 0 && istgFather < pPopOld->cstg);
+
+		pstgMother = &pPopOld->rgstg[istgMother];
+		pstgFather = &pPopOld->rgstg[istgFather];
+
+		/* An odd-sized population has no room for the last daughter */
+		STRATEGY* pstgSon = &pjob->pPopNew->rgstg[2 * iPair];
+		STRATEGY* pstgDaughter = 2 * iPair + 1 < cstg ? &pjob->pPopNew->rgstg[2 * iPair + 1] : NULL;
+
+		if (pArgs->bUseCrossover) {
+			/* Mate the parent strategies to form two children using same
+			 * crossover point, but switching parent order for second child, to
+			 * get both combinations of this specific crossover point */
+			int iactCrossover = RngInt(&rng, STRATEGY_LENGTH);
+			bool bMotherMost = 2 * iactCrossover >= STRATEGY_LENGTH;
+			MateStrategies(pstgMother, pstgFather, pstgSon, iactCrossover);
+			pstgSon->istgParent = bMotherMost ? istgMother : istgFather;
+			if (pstgDaughter) {
+				MateStrategies(pstgFather, pstgMother, pstgDaughter, iactCrossover);
+				pstgDaughter->istgParent = bMotherMost ? istgFather : istgMother;
+			}
+		} else {
+			/* Don't use crossover; just clone mother and father, and mutate */
+			StrategyCopy(pstgFather, pstgSon);
+			pstgSon->istgParent = istgFather;
+			if (pstgDaughter) {
+				StrategyCopy(pstgMother, pstgDaughter);
+				pstgDaughter->istgParent = istgMother;
+			}
+		}
+		/* Either way, mutate the children in place */
+		MutateStrategy(pArgs->rMutationProbability, pstgSon, &rng);
+		if (pstgDaughter)
+			MutateStrategy(pArgs->rMutationProbability, pstgDaughter, &rng);
+	}
+}
+
+
+/* Breeds cChildren children of an existing population into pPopNew using
+ * crossover/cloning, and genetic mutation. Pairs of children are bred in
+ * parallel on pArgs->cThreads threads; prng only seeds this generation's pair
+ * streams, so the first children of a larger brood are the same ones. */
+void EvolveChildren(const ARGS* pArgs, POPULATION* pPopOld, POPULATION* pPopNew, int cChildren, RNG* prng) {
+	ASSERT(pPopOld && pPopNew && prng);
+	ASSERT(cChildren > 0 && cChildren <= pPopNew->maxstg);
+	ASSERT(pArgs->cThreads > 0);
+
+	BREEDJOB job = {
+		.pArgs   = pArgs,
+		.pPopOld = pPopOld,
+		.pPopNew = pPopNew,
+		.nSeed   = RngNext(prng)
+	};
+	const int cPairs = (cChildren + 1) / 2;
+	pPopNew->cstg = cChildren;
+	ParallelFor(pArgs->cThreads, (cPairs + BREED_ITEM_PAIRS - 1) / BREED_ITEM_PAIRS, BreedWork, &job);
+}
+
+
+/* Evolves a complete, new population from an existing one (see
+ * EvolveChildren) */
+void EvolveNewPopulation(const ARGS* pArgs, POPULATION* pPopOld, POPULATION* pPopNew, RNG* prng) {
+	ASSERT(pPopOld && pPopNew);
+	ASSERT(pPopOld->maxstg == pPopNew->maxstg);
+	EvolveChildren(pArgs, pPopOld, pPopNew, pPopOld->cstg, prng);
+}
+
+
+/* Picks the fittest of a few randomly chosen pool members. Used instead of
+ * rank selection in steady-state mode, where the pool is never sorted. */
+static int SteadyStateSelectParent(POPULATION* pPop, RNG* prng) {
+	int istgBest = RngInt(prng, pPop->cstg);
+	int i;
+	for (i = 1; i < STEADY_TOURNAMENT_SIZE; ++i) {
+		int istg = RngInt(prng, pPop->cstg);
+		if (pPop->rgstg[istg].rFitness > pPop->rgstg[istgBest].rFitness)
+			istgBest = istg;
+	}
+	return istgBest;
+}
+
+
+/* Returns whether heap entry i1 is less fit than heap entry i2. Ties go to
+ * the lower pool index, as a scan for the worst member would pick it. */
+static bool SteadyStateHeapLess(const STEADYSTATE* pss, int i1, int i2) {
+	const int istg1 = pss->rgistgHeap[i1], istg2 = pss->rgistgHeap[i2];
+	const double rFitness1 = pss->pPop->rgstg[istg1].rFitness, rFitness2 = pss->pPop->rgstg[istg2].rFitness;
+	return rFitness1 < rFitness2 || (rFitness1 == rFitness2 && istg1 < istg2);
+}
+
+
+/* Moves heap entry i down until neither child is less fit than it */
+static void SteadyStateHeapSiftDown(STEADYSTATE* pss, int i) {
+	const int cstg = pss->pPop->cstg;
+	for (;;) {
+		int iLeast = i, iChild = 2 * i + 1;
+		if (iChild < cstg && SteadyStateHeapLess(pss, iChild, iLeast))
+			iLeast = iChild;
+		if (iChild + 1 < cstg && SteadyStateHeapLess(pss, iChild + 1, iLeast))
+			iLeast = iChild + 1;
+		if (iLeast == i)
+			return;
+		int istg = pss->rgistgHeap[i];
+		pss->rgistgHeap[i] = pss->rgistgHeap[iLeast];
+		pss->rgistgHeap[iLeast] = istg;
+		pss->rgiHeap[pss->rgistgHeap[i]] = i;
+		pss->rgiHeap[istg] = iLeast;
+		i = iLeast;
+	}
+}
+
+
+/* Works out the evaluated pool's best member and fitness sum, and for
+ * replace-worst, arranges it into a min-heap */
+static void SteadyStateIndexPool(STEADYSTATE* pss) {
+	const POPULATION* pPop = pss->pPop;
+	int istg, i;
+	pss->istgBest = 0;
+	pss->rFitnessSum = 0.0;
+	for (istg = 0; istg < pPop->cstg; ++istg) {
+		if (pPop->rgstg[istg].rFitness > pPop->rgstg[pss->istgBest].rFitness)
+			pss->istgBest = istg;
+		pss->rFitnessSum += pPop->rgstg[istg].rFitness;
+	}
+	if (pss->rgistgHeap) {
+		for (istg = 0; istg < pPop->cstg; ++istg)
+			pss->rgistgHeap[istg] = pss->rgiHeap[istg] = istg;
+		for (i = pPop->cstg / 2 - 1; i >= 0; --i)
+			SteadyStateHeapSiftDown(pss, i);
+	}
+}
+
+
+/* Offers an evaluated child to the pool, keeping the pool's best member,
+ * fitness sum and heap up to date. Caller holds the mutex. */
+static void SteadyStateReplace(STEADYSTATE* pss, const STRATEGY* pstgChild, RNG* prng) {
+	POPULATION* pPop = pss->pPop;
+	int i, istgVictim;
+	if (pss->pArgs->evolutionType == SteadyStateReplaceWorst) {
+		istgVictim = pss->rgistgHeap[0];
+		if (pstgChild->rFitness < pPop->rgstg[istgVictim].rFitness)
+			return;
+	} else {
+		ASSERT(pss->pArgs->evolutionType == SteadyStateReplaceTournament);
+		istgVictim = RngInt(prng, pPop->cstg);
+		for (i = 1; i < STEADY_TOURNAMENT_SIZE; ++i) {
+			int istg = RngInt(prng, pPop->cstg);
+			if (pPop->rgstg[istg].rFitness < pPop->rgstg[istgVictim].rFitness)
+				istgVictim = istg;
+		}
+	}
+	const double rFitnessOld = pPop->rgstg[istgVictim].rFitness;
+	StrategyCopy(pstgChild, &pPop->rgstg[istgVictim]);
+	pss->rFitnessSum += pstgChild->rFitness - rFitnessOld;
+	if (pstgChild->rFitness > pPop->rgstg[pss->istgBest].rFitness) {
+		pss->istgBest = istgVictim;
+	} else if (istgVictim == pss->istgBest && pstgChild->rFitness < rFitnessOld) {
+		/* Only tournament replacement can lose the best member, and only
+		 * when the tournament was all ties */
+		for (i = 0; i < pPop->cstg; ++i) {
+			if (pPop->rgstg[i].rFitness > pPop->rgstg[pss->istgBest].rFitness)
+				pss->istgBest = i;
+		}
+	}
+	if (pss->rgistgHeap)
+		SteadyStateHeapSiftDown(pss, pss->rgiHeap[istgVictim]);
+}
+
+
+/* Reports progress with the pool's best and mean fitness, and stops breeding
+ * and taking children if the report callback says so. Caller holds the
+ * mutex; the callback runs without it, so a slow report does not hold up
+ * the workers, and the mutex is held again on return. */
+static void SteadyStateReport(STEADYSTATE* pss) {
+	if (!pss->pfnReport)
+		return;
+	const int iReport = ++pss->iReport;
+	const double rBestFitness = pss->pPop->rgstg[pss->istgBest].rFitness;
+	const double rMeanFitness = pss->rFitnessSum / pss->pPop->cstg;
+	pthread_mutex_lock(&pss->mutexReport);
+	pthread_mutex_unlock(&pss->mutex);
+	bool bStop = pss->pfnReport(pss->pvReport, iReport, rBestFitness, rMeanFitness);
+	pthread_mutex_unlock(&pss->mutexReport);
+	pthread_mutex_lock(&pss->mutex);
+	if (bStop) {
+		/* Children already taken are still evaluated */
+		pss->maxChildren = pss->cChildrenTaken;
+		pthread_cond_broadcast(&pss->condChild);
+		pthread_cond_broadcast(&pss->condRoom);
+	}
+}
+
+
+/* Breeder thread: keeps the child queue topped up from the current pool. It
+ * is the only thread that uses pss->prngBreed. */
+static void* SteadyStateBreeder(void* pv) {
+	STEADYSTATE* pss = (STEADYSTATE*) pv;
+	const ARGS* pArgs = pss->pArgs;
+	RNG* prng = pss->prngBreed;
+	STRATEGY stgMother, stgFather, stgChild;
+
+	pthread_mutex_lock(&pss->mutex);
+	while (pss->cChildrenBred < pss->maxChildren) {
+		/* Copy the parents out so the pool is only locked briefly */
+		StrategyCopy(&pss->pPop->rgstg[SteadyStateSelectParent(pss->pPop, prng)], &stgMother);
+		StrategyCopy(&pss->pPop->rgstg[SteadyStateSelectParent(pss->pPop, prng)], &stgFather);
+		pthread_mutex_unlock(&pss->mutex);
+
+		if (pArgs->bUseCrossover)
+			MateStrategies(&stgMother, &stgFather, &stgChild, RngInt(prng, STRATEGY_LENGTH));
+		else
+			StrategyCopy(&stgMother, &stgChild);
+		MutateStrategy(pArgs->rMutationProbability, &stgChild, prng);
+
+		pthread_mutex_lock(&pss->mutex);
+		while (pss->cQueue == STEADY_QUEUE_LENGTH && pss->cChildrenBred < pss->maxChildren)
+			pthread_cond_wait(&pss->condRoom, &pss->mutex);
+		if (pss->cChildrenBred >= pss->maxChildren)
+			break; /* Stopped early */
+		StrategyCopy(&stgChild, &pss->rgstgQueue[(pss->iQueueHead + pss->cQueue) % STEADY_QUEUE_LENGTH]);
+		pss->cQueue++;
+		pss->cChildrenBred++;
+		pthread_cond_signal(&pss->condChild);
+	}
+	pthread_mutex_unlock(&pss->mutex);
+	return NULL;
+}
+
+
+/* Worker thread: takes the next child, evaluates it and offers it to the pool,
+ * until every child has been taken */
+static void* SteadyStateWorker(void* pv) {
+	STEADYWORKER* pwrk = (STEADYWORKER*) pv;
+	STEADYSTATE* pss = pwrk->pss;
+	const ARGS* pArgs = pss->pArgs;
+	WORLD* pwldScratch = pss->rgpwld[pwrk->iWorker];
+	const int cReport = pArgs->cReportEvaluations > 0 ? pArgs->cReportEvaluations : pss->pPop->cstg;
+	STRATEGY stgChild;
+	RNG rng;
+
+	RngSeedStream(&rng, pArgs->nSeed ^ STEADY_STREAM, pss->pPop->cstg + pwrk->iWorker);
+	pthread_mutex_lock(&pss->mutex);
+	for (;;) {
+		while (pss->cQueue == 0 && pss->cChildrenTaken < pss->maxChildren)
+			pthread_cond_wait(&pss->condChild, &pss->mutex);
+		if (pss->cChildrenTaken >= pss->maxChildren)
+			break;
+		StrategyCopy(&pss->rgstgQueue[pss->iQueueHead], &stgChild);
+		pss->iQueueHead = (pss->iQueueHead + 1) % STEADY_QUEUE_LENGTH;
+		pss->cQueue--;
+		if (++pss->cChildrenTaken >= pss->maxChildren)
+			pthread_cond_broadcast(&pss->condChild); /* Release idle workers */
+		pthread_cond_signal(&pss->condRoom);
+		pthread_mutex_unlock(&pss->mutex);
+
+		stgChild.rFitness = EvaluateStrategy(pArgs, &stgChild, pss->pWorld, pwldScratch, &rng);
+
+		pthread_mutex_lock(&pss->mutex);
+		SteadyStateReplace(pss, &stgChild, &rng);
+		if (++pss->cChildrenDone % cReport == 0)
+			SteadyStateReport(pss);
+	}
+	pthread_mutex_unlock(&pss->mutex);
+	return NULL;
+}
+
+
+/* ParallelFor callback: evaluates one member of the initial pool */
+static void SteadyStateInitialWork(void* pvSteadyState, int istg, int iThread) {
+	STEADYSTATE* pss = (STEADYSTATE*) pvSteadyState;
+	RNG rng;
+	RngSeedStream(&rng, pss->pArgs->nSeed ^ STEADY_STREAM, istg);
+	pss->pPop->rgstg[istg].rFitness = EvaluateStrategy(pss->pArgs,
+		&pss->pPop->rgstg[istg], pss->pWorld, pss->rgpwld[iThread], &rng);
+}
+
+
+/* Evolves a (randomized) pool without generation barriers: one breeder thread
+ * produces children from the current pool while pArgs->cThreads workers each
+ * evaluate a child and fold it back into the pool as soon as it is scored.
+ * Runs (cGenerations - 1) * population size evaluations after the initial
+ * pool, calling pfnReport (if given) every pArgs->cReportEvaluations of them,
+ * and stopping early if it returns true. rgpwldScratch holds one world per
+ * thread; prng drives breeding. Because children are evaluated against a pool
+ * that changes under them, results depend on thread timing, not just the
+ * seed. Returns the number of evaluations run, counting the initial pool. */
+long EvolveSteadyState(const ARGS* pArgs, POPULATION* pPop, const WORLD* pWorld, WORLD** rgpwldScratch, RNG* prng,
+                       PFNSTEADYREPORT pfnReport, void* pvReport) {
+	ASSERT(pArgs && pPop && pWorld && rgpwldScratch && prng);
+	ASSERT(pArgs->cThreads > 0);
+
+	const int cWorkers = pArgs->cThreads;
+	pthread_t threadBreeder;
+	STEADYSTATE* pss = (STEADYSTATE*) malloc(sizeof(STEADYSTATE));
+	VerifyAlloc(pss, "steady-state");
+	STEADYWORKER* rgwrk = (STEADYWORKER*) malloc(sizeof(STEADYWORKER) * cWorkers);
+	VerifyAlloc(rgwrk, "%d workers", cWorkers);
+	pthread_t* rgthread = (pthread_t*) malloc(sizeof(pthread_t) * cWorkers);
+	VerifyAlloc(rgthread, "%d threads", cWorkers);
+
+	int i;
+	pss->pArgs = pArgs;
+	pss->pWorld = pWorld;
+	pss->pPop = pPop;
+	pss->rgpwld = rgpwldScratch;
+	pss->prngBreed = prng;
+	pss->pfnReport = pfnReport;
+	pss->pvReport = pvReport;
+	pss->rgstgQueue = StrategyAllocArray(STEADY_QUEUE_LENGTH);
+	pss->iQueueHead = pss->cQueue = 0;
+	pss->maxChildren = (long)(pArgs->cGenerations - 1) * pPop->cstg;
+	pss->cChildrenBred = pss->cChildrenTaken = pss->cChildrenDone = 0;
+	pss->iReport = 0;
+	pss->rgistgHeap = pss->rgiHeap = NULL;
+	if (pArgs->evolutionType == SteadyStateReplaceWorst) {
+		pss->rgistgHeap = (int*) malloc(sizeof(int) * pPop->cstg);
+		VerifyAlloc(pss->rgistgHeap, "pool heap (%d strategies)", pPop->cstg);
+		pss->rgiHeap = (int*) malloc(sizeof(int) * pPop->cstg);
+		VerifyAlloc(pss->rgiHeap, "pool heap (%d strategies)", pPop->cstg);
+	}
+	pthread_mutex_init(&pss->mutex, NULL);
+	pthread_mutex_init(&pss->mutexReport, NULL);
+	pthread_cond_init(&pss->condChild, NULL);
+	pthread_cond_init(&pss->condRoom, NULL);
+
+	ParallelFor(cWorkers, pPop->cstg, SteadyStateInitialWork, pss);
+	SteadyStateIndexPool(pss);
+	pthread_mutex_lock(&pss->mutex);
+	SteadyStateReport(pss);
+	pthread_mutex_unlock(&pss->mutex);
+
+	if (pthread_create(&threadBreeder, NULL, SteadyStateBreeder, pss) != 0)
+		Die("Cannot create breeder thread");
+	for (i = 0; i < cWorkers; ++i) {
+		rgwrk[i].pss = pss;
+		rgwrk[i].iWorker = i;
+		if (pthread_create(&rgthread[i], NULL, SteadyStateWorker, &rgwrk[i]) != 0)
+			Die("Cannot create worker thread %d", i);
+	}
+	for (i = 0; i < cWorkers; ++i)
+		pthread_join(rgthread[i], NULL);
+	pthread_join(threadBreeder, NULL);
+
+	long cEvaluations = pPop->cstg + pss->cChildrenDone;
+	pthread_cond_destroy(&pss->condRoom);
+	pthread_cond_destroy(&pss->condChild);
+	pthread_mutex_destroy(&pss->mutexReport);
+	pthread_mutex_destroy(&pss->mutex);
+	free(pss->rgiHeap);
+	free(pss->rgistgHeap);
+	StrategyFreeArray(pss->rgstgQueue);
+	free(rgthread);
+	free(rgwrk);
+	free(pss);
+	return cEvaluations;
+}
@@ -0,0 +1,83 @@
+/*****************************************************************************
+ * evolve.h: Header for evolve.c.
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#pragma once
+#include "args.h"
+#include "population.h"
+#include "world.h"
+#include "bank.h"
+#include "ring.h"
+
+
+/* Generalization runs this many sessions per strategy per round, so a test
+ * bank must hold at least this many layouts */
+#define GENERALIZATION_ROUND_SESSIONS	100
+
+
+/* Generalization result for one strategy */
+typedef struct {
+	int     cSessions;        /* Sessions run so far */
+	int64_t nScoreSum;
+	int64_t nScoreSquareSum;
+	double  rMean;
+	double  rHalfWidth;       /* Half-width of the 95% confidence interval */
+	bool    bDone;
+} GENERALIZATION; /* gen */
+
+
+/* Delta evaluation's record of a generation: for each strategy and session,
+ * the stream the session started from, its score, and the states Robby acted
+ * in (see CalculateFitnessDelta). Kept in the population's order. */
+typedef struct {
+	int       cstg;
+	int       cSessions;
+	RNG*      rgrng;      /* [istg * cSessions + iSession] */
+	int*      rgnScore;   /* [istg * cSessions + iSession] */
+	uint64_t* rgnSeen;    /* WORLD_SEEN_WORDS words per session, likewise */
+	int*      rgcReused;  /* Per strategy: sessions copied from its parent */
+	int*      rgistgFrom; /* Scratch for sorting */
+} SESSIONLOG; /* log */
+
+
+/* Steady-state progress callback: iReport counts reports from 1. Returns
+ * true to stop evolution early. */
+typedef bool (*PFNSTEADYREPORT)(void* pvReport, int iReport, double rBestFitness, double rMeanFitness);
+
+
+/* Function prototypes */
+double EvaluateStrategy(const ARGS* pArgs, STRATEGY* pstg, const WORLD* pWorld, WORLD* pwldScratch, RNG* prng);
+void   CalculateFitness(const ARGS* pArgs, POPULATION* pPopulation, const WORLD* pWorld, WORLD** rgpwldScratch, int iGeneration);
+void   CalculateFitnessRing(const ARGS* pArgs, POPULATION* pPopulation, RING* pring, int iGeneration);
+SESSIONLOG* SessionLogCreate(int cstg, int cSessions);
+void   SessionLogDestroy(SESSIONLOG* plog);
+void   SessionLogSortPopulation(SESSIONLOG* plog, const POPULATION* pPop, POPULATION* pPopSorted);
+int64_t CalculateFitnessDelta(const ARGS* pArgs, POPULATION* pPopulation, SESSIONLOG* plog,
+                              const POPULATION* pPopParents, const SESSIONLOG* plogParents,
+                              const WORLD* pWorld, WORLD** rgpwldScratch, int iGeneration);
+void   CalculateGeneralization(const ARGS* pArgs, STRATEGY** rgpstg, int cstg, const WORLD* pWorld, const BANK* pbank,
+                               WORLD** rgpwldScratch, GENERALIZATION* rggen);
+int    SelectParent(POPULATION* pPop, RNG* prng);
+void   MateStrategies(const STRATEGY* pstgMother, const STRATEGY* pstgFather, STRATEGY* pstgChild, int iactCrossover);
+void   MutateStrategy(double rMutationProbability, STRATEGY* pstg, RNG* prng);
+void   EvolveChildren(const ARGS* pArgs, POPULATION* pPopOld, POPULATION* pPopNew, int cChildren, RNG* prng);
+void   EvolveNewPopulation(const ARGS* pArgs, POPULATION* pPopOld, POPULATION* pPopNew, RNG* prng);
+long   EvolveSteadyState(const ARGS* pArgs, POPULATION* pPop, const WORLD* pWorld, WORLD** rgpwldScratch, RNG* prng,
+                         PFNSTEADYREPORT pfnReport, void* pvReport);
@@ -0,0 +1,82 @@
+/*****************************************************************************
+ * instrument.c: Hit counts for instrumented builds of the cleaning loop, and
+ * their export as a heatmap-ready table.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include "types.h"
+#include "error.h"
+#include "strategy.h"
+#include "instrument.h"
+
+
+/* Column names for the actions, in ACTION order */
+static const PCSZ k_rgszActions[NUM_ACTIONS] = {
+	"north", "south", "east", "west", "random", "stay", "pickup"
+};
+
+
+/* Adds one set of counters into a running total */
+void CountersAdd(COUNTERS* pcntTotal, const COUNTERS* pcnt) {
+	ASSERT(pcntTotal && pcnt);
+	int i;
+	for (i = 0; i < STRATEGY_LENGTH; ++i)
+		pcntTotal->rgcStates[i] += pcnt->rgcStates[i];
+	for (i = 0; i < NUM_ACTIONS; ++i)
+		pcntTotal->rgcActions[i] += pcnt->rgcActions[i];
+	pcntTotal->cWallHits += pcnt->cWallHits;
+	pcntTotal->cFailedPickUps += pcnt->cFailedPickUps;
+	pcntTotal->cSmartRedirects += pcnt->cSmartRedirects;
+}
+
+
+/* Writes the column names of the counts file. The file is tab-separated with
+ * one row per label (usually a generation), so the state columns can be
+ * plotted directly as a generation-by-state heatmap. */
+void CountersWriteHeader(FILE* pf) {
+	ASSERT(pf);
+	int i;
+	fprintf(pf, "# label");
+	for (i = 0; i < STRATEGY_LENGTH; ++i)
+		fprintf(pf, "\tstate%d", i);
+	for (i = 0; i < NUM_ACTIONS; ++i)
+		fprintf(pf, "\t%s", k_rgszActions[i]);
+	fprintf(pf, "\twall_hits\tfailed_pickups\tsmart_redirects\n");
+}
+
+
+/* Writes one row of the counts file */
+void CountersWrite(FILE* pf, PCSZ pszLabel, const COUNTERS* pcnt) {
+	ASSERT(pf && pszLabel && pcnt);
+	int i;
+	fprintf(pf, "%s", pszLabel);
+	for (i = 0; i < STRATEGY_LENGTH; ++i)
+		fprintf(pf, "\t%llu", (unsigned long long)pcnt->rgcStates[i]);
+	for (i = 0; i < NUM_ACTIONS; ++i)
+		fprintf(pf, "\t%llu", (unsigned long long)pcnt->rgcActions[i]);
+	fprintf(pf, "\t%llu\t%llu\t%llu\n", (unsigned long long)pcnt->cWallHits,
+		(unsigned long long)pcnt->cFailedPickUps, (unsigned long long)pcnt->cSmartRedirects);
+	fflush(pf);
+}
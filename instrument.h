@@ -0,0 +1,54 @@
+/*****************************************************************************
+ * instrument.h: Header for instrument.c.
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#pragma once
+#include <stdio.h>
+#include "types.h"
+#include "strategy.h"
+
+
+/*
+ * Hit counts of RobbyClean's hot loop, collected only by instrumented builds
+ * (scons instrument=1, which defines INSTRUMENT). Normal builds compile the
+ * counting out entirely.
+ */
+typedef struct {
+	uint64_t rgcStates[STRATEGY_LENGTH]; /* Visits per state index */
+	uint64_t rgcActions[NUM_ACTIONS];    /* Executions per chosen action */
+	uint64_t cWallHits;                  /* Wall penalties */
+	uint64_t cFailedPickUps;             /* Pick-ups with no can */
+	uint64_t cSmartRedirects;            /* SmartRobby moves turned by a wall */
+} COUNTERS; /* cnt */
+
+
+#ifdef INSTRUMENT
+#define INSTRUMENT_ENABLED	1
+#define INSTRUMENT_COUNT(pwld, counter)	((pwld)->cnt.counter++)
+#else
+#define INSTRUMENT_ENABLED	0
+#define INSTRUMENT_COUNT(pwld, counter)	((void)0)
+#endif
+
+
+/* Function prototypes */
+void CountersAdd(COUNTERS* pcntTotal, const COUNTERS* pcnt);
+void CountersWriteHeader(FILE* pf);
+void CountersWrite(FILE* pf, PCSZ pszLabel, const COUNTERS* pcnt);
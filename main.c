@@ -20,6 +20,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
  *****************************************************************************/
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,136 +28,321 @@
 #include <unistd.h>
 #include "types.h"
 #include "error.h"
-#include "main.h"
-#include "misc.h"
+#include "args.h"
 #include "strategy.h"
 #include "population.h"
+#include "instrument.h"
 #include "world.h"
-#include "robby.h"
+#include "evolve.h"
+#include "context.h"
+#include "checkpoint.h"
+#include "metrics.h"
+#include "misc.h"
+#include "parallel.h"
+#include "search.h"
+#include "serve.h"
 
 /*
  * WARNING! This codebase uses an uncommon variable naming convention. It makes
  * sense--with an explanation--I swear! Please see the README.
  */
 
-#define GENERALIZATION_SESSIONS		1000.0
-
 
 /* Local functions */
-void CalculateFitness(ARGS const* pArgs, POPULATION* pPopulation, const WORLD* pWorld);
-double CalculateGeneralization(ARGS const* pArgs, STRATEGY* pstg, const WORLD* pWorld);
-void EvolveNewPopulation(const ARGS* pArgs, POPULATION* pPopOld, POPULATION* pPopNew);
-void MateStrategies(const STRATEGY* pstgMother, const STRATEGY* pstgFather, STRATEGY* pstgChild, int iactCrossover);
-void MutateStrategy(double rMutationProbability, STRATEGY* pstg);
-void PrintWelcome(void);
-void ProcessCommandLine(int argc, char** argv, ARGS* pArgs);
-void SortByFitness(POPULATION* pPopulation);
-void Usage();
-
-
-/*
- * Default program parameters
- */
-const ARGS k_argsDefault = {
-	.nPopulationSize  = 200,
-	.cGenerations     = 500,
-	.cSessions        = 200,
-	.cSessionActions  = 200,
-	.rMutationProbability = 0.005,
-	.rCanProbability  = 0.5,
-	.nSeed            = 8675309,
-	.pszWorld         = "default.world",
-	.bUseCrossover    = true,
-	.robbyType        = NormalRobby
-};
+void        BuildIdStrategy(STRATEGY* pstg);
+bool        CanCreateFile(PCSZ pszFile);
+bool        CanCreateInDirectory(PCSZ pszDir);
+PCSZ        CheckArgs(const ARGS* pArgs, const WORLD* pwld);
+int         PrintGeneralization(FILE* pf, const GENERALIZATION* rggen, int cstg);
+bool        PrintSteadyStateReport(void* pvReport, int iReport, double rBestFitness, double rMeanFitness);
+void        PublishMetrics(METRICS* pmet, const CONTEXT* pctx, PCSZ pszPhase);
+void        PrintWelcome(void);
+ParseResult ProcessCommandLine(int argc, char** argv, ARGS* pArgs, FILE* pf, FILE* pfError);
+void        RunRobby(const ARGS* pArgs, const WORLD* pwldTemplate, const STRATEGY* pstgEvaluate, FILE* pf);
+void        Usage(FILE* pf);
+void        WriteCounters(FILE* pf, CONTEXT* pctx, PCSZ pszLabel);
 
 
 /* Print program command-line usage */
-void Usage() {
+void Usage(FILE* pf) {
 	const ARGS* p = &k_argsDefault;
-	fprintf(stderr, "Usage: ./robby ARGS\n");
-	fprintf(stderr, "Where ARGS is zero or more of:\n");
-	fprintf(stderr, "\t-p <Population Size>      (default: %d)\n", p->nPopulationSize);
-	fprintf(stderr, "\t-g <Generations>          (default: %d)\n", p->cGenerations);
-	fprintf(stderr, "\t-s <Sessions>             (default: %d)\n", p->cSessions);
-	fprintf(stderr, "\t-a <Actions Per Session>  (default: %d)\n", p->cSessionActions);
-	fprintf(stderr, "\t-m <Mutation Probability> (default: %g)\n", p->rMutationProbability);
-	fprintf(stderr, "\t-c <Can Probability>      (default: %g)\n", p->rCanProbability);
-	fprintf(stderr, "\t-r <Random number seed>   (default: %d)\n", p->nSeed);
-	fprintf(stderr, "\t-w <World file to use>    (default: %s)\n", p->pszWorld);
-	fprintf(stderr, "\t-x: Turn off crossover\n");
-	fprintf(stderr, "\t-z <id|smart> Use IDRobby (custom; no evolution/mutation) or SmartRobby\n");
-	fprintf(stderr, "\t-h: Display this help message and exit\n");
+	fprintf(pf, "Usage: ./robby ARGS\n");
+	fprintf(pf, "Where ARGS is zero or more of:\n");
+	fprintf(pf, "\t-p <Population Size>      (default: %d)\n", p->nPopulationSize);
+	fprintf(pf, "\t-g <Generations>          (default: %d)\n", p->cGenerations);
+	fprintf(pf, "\t-s <Sessions>             (default: %d)\n", p->cSessions);
+	fprintf(pf, "\t-a <Actions Per Session>  (default: %d)\n", p->cSessionActions);
+	fprintf(pf, "\t-m <Mutation Probability> (default: %g)\n", p->rMutationProbability);
+	fprintf(pf, "\t-c <Can Probability>      (default: %g)\n", p->rCanProbability);
+	fprintf(pf, "\t-r <Random number seed>   (default: %d)\n", p->nSeed);
+	fprintf(pf, "\t-w <World file to use>    (default: %s)\n", p->pszWorld);
+	fprintf(pf, "\t-x: Turn off crossover\n");
+	fprintf(pf, "\t-z <id|smart> Use IDRobby (custom; no evolution/mutation) or SmartRobby\n");
+	fprintf(pf, "\t-t <Threads>              (default: %d, one per CPU)\n", p->cThreads);
+	fprintf(pf, "\t-k <Strategies to generalize> (default: %d)\n", p->cGeneralizeTop);
+	fprintf(pf, "\t-e <Generalization 95%% CI half-width> (default: %g)\n", p->rGeneralizeWidth);
+	fprintf(pf, "\t-S <worst|tournament> Steady-state evolution (no generation barrier) with\n"
+	                "\t   replace-worst or tournament replacement; -g counts population-sized\n"
+	                "\t   batches of evaluations\n");
+	fprintf(pf, "\t-n <Evaluations per report line> (steady-state; default: population size)\n");
+	fprintf(pf, "\t--test-bank <Bank file>   Score generalization on the layouts of a bank\n"
+	                "\t   written by mkbank, so scores are comparable across runs\n");
+	fprintf(pf, "\t--diversity: Add population diversity columns (mean pairwise gene\n"
+	                "\t   distance, mean per-gene entropy, unique genomes) to each generation\n");
+	fprintf(pf, "\t--counts <File>           Write per-generation state/action hit counts\n"
+	                "\t   (instrumented builds only: scons instrument=1)\n");
+	fprintf(pf, "\t--archive <File>          Record every generation's population and fitness\n"
+	                "\t   (generational evolution only; read it back with dumparchive)\n");
+	fprintf(pf, "\t--lazy-cans: Decide each cell's can only when Robby looks at it, so\n"
+	                "\t   sessions on very large worlds cost only their path (different\n"
+	                "\t   layouts from the default, at the same can probability)\n");
+	fprintf(pf, "\t--delta: Score each child on its main parent's sessions, rerunning only\n"
+	                "\t   those in which the parent met a state whose gene changed\n"
+	                "\t   (generational evolution only; lineages keep their layouts)\n");
+	fprintf(pf, "\t--metrics <Name>          Publish live progress to shared memory, for\n"
+	                "\t   ./robby --top <Name> (or any reader of /dev/shm/robby-<Name>)\n");
+	fprintf(pf, "\t--checkpoint <N>          Score the best strategy's generalization every N\n"
+	                "\t   generations on an extra background thread, and add each score to a\n"
+	                "\t   later generation's line as <Score>@<Generation>; a checkpoint due while\n"
+	                "\t   the last is still being scored is skipped (generational only)\n");
+	fprintf(pf, "\t--surrogate <K>           Breed K times as many children as the population\n"
+	                "\t   holds and simulate only those a gene-linear model, trained on every\n"
+	                "\t   evaluated generation, predicts fittest (generational only)\n");
+	fprintf(pf, "\t--producers <N>           Copy worlds and place cans for fitness sessions on\n"
+	                "\t   N extra threads, ahead of the evaluation threads (a stream per\n"
+	                "\t   session, so different fitness from the default; generational only)\n");
+	fprintf(pf, "\t--time-budget <Seconds>   Stop evolving once the run is this old\n");
+	fprintf(pf, "\t--target-fitness <Score>  Stop evolving once the best fitness reaches this\n");
+	fprintf(pf, "\t--window <N>              Stop evolving after N generations (steady-state:\n"
+	                "\t   reports) in which neither the best nor the mean fitness beat its\n"
+	                "\t   record by more than the tolerance\n");
+	fprintf(pf, "\t--tolerance <Score>       (default: %g)\n", p->rStopTolerance);
+	fprintf(pf, "\t--population-dir <Dir>    Keep populations in memory-mapped files in Dir\n"
+	                "\t   (deleted on exit), so they may outgrow RAM; passes over them read\n"
+	                "\t   ahead and write back in the background\n");
+	fprintf(pf, "\t--search <N>              Instead of one run, search N settings of -p, -m,\n"
+	                "\t   -c and -x drawn around ARGS by successive halving: run all for a\n"
+	                "\t   short budget, keep the better-generalizing half and double the budget\n"
+	                "\t   until one reaches -g; configurations run in parallel (see -t), and a\n"
+	                "\t   leaderboard ends the output (generational only)\n");
+	fprintf(pf, "\t-h, --help: Display this help message and exit\n");
+	fprintf(pf, "Or, to keep worlds loaded and run many jobs from one process:\n");
+	fprintf(pf, "\t./robby --serve <Socket> [--jobs <Concurrent jobs> (default: one per CPU)]\n");
+	fprintf(pf, "\t./robby --client <Socket> run ARGS\n");
+	fprintf(pf, "\t./robby --client <Socket> evaluate <Genes> ARGS\n");
+	fprintf(pf, "\t   Served jobs print what ./robby ARGS would, less the welcome\n"
+	                "\t   banner; they run single-threaded unless given -t, each in its own\n"
+	                "\t   process, so one that fails ends with a '# ERROR:' line and leaves\n"
+	                "\t   the server running. <Genes> is a strategy as a string of %d action\n"
+	                "\t   digits, as printed by dumparchive.\n", STRATEGY_LENGTH);
+	fprintf(pf, "Or, to watch a run started with --metrics <Name>:\n");
+	fprintf(pf, "\t./robby --top <Name>\n");
 }
 
 
-/* Process command line, updating caller's ARGS struct */
-void ProcessCommandLine(int argc, char** argv, ARGS* pArgs) {
+/* Long options have no short form; their codes follow the character range */
+enum {
+	OPT_TEST_BANK = 256,
+	OPT_COUNTS,
+	OPT_DIVERSITY,
+	OPT_ARCHIVE,
+	OPT_LAZY_CANS,
+	OPT_DELTA,
+	OPT_METRICS,
+	OPT_CHECKPOINT,
+	OPT_SURROGATE,
+	OPT_TIME_BUDGET,
+	OPT_TARGET_FITNESS,
+	OPT_WINDOW,
+	OPT_TOLERANCE,
+	OPT_PRODUCERS,
+	OPT_SEARCH,
+	OPT_POPULATION_DIR,
+};
+
+
+/* Process command line, updating caller's ARGS struct, echoing each
+ * setting to pf and writing complaints and usage to pfError. Also parses
+ * served jobs, so it never exits; getopt's state is global, so calls must
+ * not overlap. */
+ParseResult ProcessCommandLine(int argc, char** argv, ARGS* pArgs, FILE* pf, FILE* pfError) {
 	int ch;
-	const char szArgOptions[]   = "pgsamcrwxz"; /* Options with an argument */
-	const char szGetOptString[] = "p:g:s:a:m:c:r:w:z:hx"; /* All options */
+	const char szArgOptions[]   = "pgsamcrwztkeSn"; /* Options with an argument */
+	const char szGetOptString[] = "p:g:s:a:m:c:r:w:z:t:k:e:S:n:hx"; /* All options */
+	const struct option rgoptLong[] = {
+		{ "test-bank", required_argument, NULL, OPT_TEST_BANK },
+		{ "counts",    required_argument, NULL, OPT_COUNTS },
+		{ "diversity", no_argument,       NULL, OPT_DIVERSITY },
+		{ "archive",   required_argument, NULL, OPT_ARCHIVE },
+		{ "lazy-cans", no_argument,       NULL, OPT_LAZY_CANS },
+		{ "delta",     no_argument,       NULL, OPT_DELTA },
+		{ "metrics",   required_argument, NULL, OPT_METRICS },
+		{ "checkpoint", required_argument, NULL, OPT_CHECKPOINT },
+		{ "surrogate", required_argument, NULL, OPT_SURROGATE },
+		{ "time-budget", required_argument, NULL, OPT_TIME_BUDGET },
+		{ "target-fitness", required_argument, NULL, OPT_TARGET_FITNESS },
+		{ "window",    required_argument, NULL, OPT_WINDOW },
+		{ "tolerance", required_argument, NULL, OPT_TOLERANCE },
+		{ "producers", required_argument, NULL, OPT_PRODUCERS },
+		{ "search", required_argument, NULL, OPT_SEARCH },
+		{ "population-dir", required_argument, NULL, OPT_POPULATION_DIR },
+		{ "help",      no_argument,       NULL, 'h' },
+		{ NULL,        0,                 NULL, 0 }
+	};
 
 	opterr = 0;
-	while ((ch = getopt(argc, argv, szGetOptString)) != -1) {
+	optind = 0; /* Start over, for served jobs */
+	while ((ch = getopt_long(argc, argv, szGetOptString, rgoptLong, NULL)) != -1) {
 		switch (ch) {
 		case 'p':
 			pArgs->nPopulationSize = atoi(optarg);
-			printf("# Population Size: %d\n", pArgs->nPopulationSize);
+			fprintf(pf, "# Population Size: %d\n", pArgs->nPopulationSize);
 			break;
 		case 'g':
 			pArgs->cGenerations = atoi(optarg);
-			printf("# Generations:     %d\n", pArgs->cGenerations);
+			fprintf(pf, "# Generations:     %d\n", pArgs->cGenerations);
 			break;
 		case 's':
 			pArgs->cSessions = atoi(optarg);
-			printf("# Sessions:        %d\n", pArgs->cSessions);
+			fprintf(pf, "# Sessions:        %d\n", pArgs->cSessions);
 			break;
 		case 'a':
 			pArgs->cSessionActions = atoi(optarg);
-			printf("# Session Actions: %d\n", pArgs->cSessionActions);
+			fprintf(pf, "# Session Actions: %d\n", pArgs->cSessionActions);
 			break;
 		case 'm':
 			pArgs->rMutationProbability = atof(optarg);
-			printf("# Mutation Prob:   %g\n", pArgs->rMutationProbability);
+			fprintf(pf, "# Mutation Prob:   %g\n", pArgs->rMutationProbability);
 			break;
 		case 'c':
 			pArgs->rCanProbability = atof(optarg);
-			printf("# Can Probability: %g\n", pArgs->rCanProbability);
+			fprintf(pf, "# Can Probability: %g\n", pArgs->rCanProbability);
 			break;
 		case 'r':
 			pArgs->nSeed = atoi(optarg);
-			printf("# Random seed:     %d\n", pArgs->nSeed);
+			fprintf(pf, "# Random seed:     %d\n", pArgs->nSeed);
 			break;
 		case 'w':
 			pArgs->pszWorld = optarg;
-			printf("# World file:      %s\n", pArgs->pszWorld);
+			fprintf(pf, "# World file:      %s\n", pArgs->pszWorld);
 			break;
 		case 'x':
 			pArgs->bUseCrossover = false;
-			printf("# Crossover:       off\n");
+			fprintf(pf, "# Crossover:       off\n");
 			break;
 		case 'z':
 			if (strcmp(optarg, "id") == 0) {
 				pArgs->robbyType = IdRobby;
-				printf("# Using IntelligentDesignRobby\n");
+				fprintf(pf, "# Using IntelligentDesignRobby\n");
 			} else if (strcmp(optarg, "smart") == 0) {
 				pArgs->robbyType = SmartRobby;
-				printf("# Using SmartRobby\n");
+				fprintf(pf, "# Using SmartRobby\n");
 			} else
-				fprintf(stderr, "Unrecognized -z parameter\n");
+				fprintf(pfError, "Unrecognized -z parameter\n");
 			break;
-		case 'h':
-			Usage();
-			exit(EXIT_SUCCESS);
+		case 't':
+			pArgs->cThreads = atoi(optarg);
+			fprintf(pf, "# Threads:         %d\n", pArgs->cThreads);
+			break;
+		case 'k':
+			pArgs->cGeneralizeTop = atoi(optarg);
+			fprintf(pf, "# Generalize top:  %d\n", pArgs->cGeneralizeTop);
+			break;
+		case 'e':
+			pArgs->rGeneralizeWidth = atof(optarg);
+			fprintf(pf, "# Generalize CI:   +/- %g\n", pArgs->rGeneralizeWidth);
+			break;
+		case 'S':
+			if (strcmp(optarg, "worst") == 0) {
+				pArgs->evolutionType = SteadyStateReplaceWorst;
+				fprintf(pf, "# Steady-state:    replace worst\n");
+			} else if (strcmp(optarg, "tournament") == 0) {
+				pArgs->evolutionType = SteadyStateReplaceTournament;
+				fprintf(pf, "# Steady-state:    tournament replacement\n");
+			} else
+				fprintf(pfError, "Unrecognized -S parameter\n");
+			break;
+		case 'n':
+			pArgs->cReportEvaluations = atoi(optarg);
+			fprintf(pf, "# Report every:    %d evaluations\n", pArgs->cReportEvaluations);
+			break;
+		case OPT_TEST_BANK:
+			pArgs->pszTestBank = optarg;
+			fprintf(pf, "# Test bank:       %s\n", pArgs->pszTestBank);
+			break;
+		case OPT_COUNTS:
+			pArgs->pszCounts = optarg;
+			fprintf(pf, "# Hit counts file: %s\n", pArgs->pszCounts);
+			break;
+		case OPT_DIVERSITY:
+			pArgs->bDiversity = true;
+			fprintf(pf, "# Diversity:       on\n");
+			break;
+		case OPT_ARCHIVE:
+			pArgs->pszArchive = optarg;
+			fprintf(pf, "# Archive file:    %s\n", pArgs->pszArchive);
+			break;
+		case OPT_LAZY_CANS:
+			pArgs->bLazyCans = true;
+			fprintf(pf, "# Lazy cans:       on\n");
 			break;
+		case OPT_DELTA:
+			pArgs->bDeltaEvaluation = true;
+			fprintf(pf, "# Delta eval:      on\n");
+			break;
+		case OPT_METRICS:
+			pArgs->pszMetrics = optarg;
+			fprintf(pf, "# Metrics name:    %s\n", pArgs->pszMetrics);
+			break;
+		case OPT_CHECKPOINT:
+			pArgs->cCheckpointInterval = atoi(optarg);
+			fprintf(pf, "# Checkpoints:     every %d generations\n", pArgs->cCheckpointInterval);
+			break;
+		case OPT_SURROGATE:
+			pArgs->nSurrogateOversample = atoi(optarg);
+			fprintf(pf, "# Surrogate:       %d children bred per child evaluated\n", pArgs->nSurrogateOversample);
+			break;
+		case OPT_TIME_BUDGET:
+			pArgs->rTimeBudget = atof(optarg);
+			fprintf(pf, "# Time budget:     %g seconds\n", pArgs->rTimeBudget);
+			break;
+		case OPT_TARGET_FITNESS:
+			pArgs->bTargetFitness = true;
+			pArgs->rTargetFitness = atof(optarg);
+			fprintf(pf, "# Target fitness:  %g\n", pArgs->rTargetFitness);
+			break;
+		case OPT_WINDOW:
+			pArgs->cStopWindow = atoi(optarg);
+			fprintf(pf, "# Stop window:     %d\n", pArgs->cStopWindow);
+			break;
+		case OPT_TOLERANCE:
+			pArgs->rStopTolerance = atof(optarg);
+			fprintf(pf, "# Stop tolerance:  %g\n", pArgs->rStopTolerance);
+			break;
+		case OPT_PRODUCERS:
+			pArgs->cLayoutProducers = atoi(optarg);
+			fprintf(pf, "# Producers:       %d\n", pArgs->cLayoutProducers);
+			break;
+		case OPT_SEARCH:
+			pArgs->cSearchConfigs = atoi(optarg);
+			fprintf(pf, "# Search:          %d configurations\n", pArgs->cSearchConfigs);
+			break;
+		case OPT_POPULATION_DIR:
+			pArgs->pszPopulationDir = optarg;
+			fprintf(pf, "# Population dir:  %s\n", pArgs->pszPopulationDir);
+			break;
+		case 'h':
+			Usage(pfError);
+			return ParseHelp;
 		case '?':
-			if (strchr(szArgOptions, optopt) == NULL)
-				fprintf(stderr, "Unknown option -%c\n", optopt);
+			if (optopt == 0 || optopt >= OPT_TEST_BANK)
+				fprintf(pfError, "Unknown option or missing argument: %s\n", argv[optind - 1]);
+			else if (strchr(szArgOptions, optopt) == NULL)
+				fprintf(pfError, "Unknown option -%c\n", optopt);
 			else
-				fprintf(stderr, "Option -%c requires an argument\n", optopt);
-			Usage();
-			exit(EXIT_FAILURE);
-			break;
+				fprintf(pfError, "Option -%c requires an argument\n", optopt);
+			Usage(pfError);
+			return ParseFailed;
 		default:
 			abort();
 		}
@@ -164,244 +350,430 @@ void ProcessCommandLine(int argc, char** argv, ARGS* pArgs) {
 
 	int i;
 	for (i = optind; i < argc; ++i)
-		fprintf(stderr, "** WARNING: Argument '%s' ignored\n", argv[i]);
+		fprintf(pfError, "** WARNING: Argument '%s' ignored\n", argv[i]);
+	return ParseRun;
 }
 
 
-/* Calculate fitness of a population */
-void CalculateFitness(ARGS const* pArgs, POPULATION* pPopulation, const WORLD* pWorld) {
-	ASSERT(pArgs && pPopulation && pWorld);
-
-	/* Create a world to play in */
-	WORLD* pwldCurrent = WorldCreate(pWorld->cx, pWorld->cy);
-
-	int istg, iSession, nScoreSum;
-	for (istg = 0; istg < pPopulation->cstg; ++istg) {
-		/* For each strategy, try it out "cSessions" times and take
-		 * the average score */
-		nScoreSum = 0;
-		for (iSession = 0; iSession < pArgs->cSessions; ++iSession) {
-			/* Start with a fresh world with randomly placed cans
-			 * for each cleaning run */
-			WorldCopy(pWorld, pwldCurrent);
-			WorldSetCansRandomly(pwldCurrent, pArgs->rCanProbability);
-			//WorldDump(pwldCurrent, stdout);
-			nScoreSum += RobbyClean(pArgs, pwldCurrent, &pPopulation->rgstg[istg], pArgs->cSessionActions);
-		}
-		pPopulation->rgstg[istg].rFitness = (double)nScoreSum / (double)pArgs->cSessions;
-		//Debug("Strategy %d: %g", istg, pPopulation->rgstg[istg].rFitness);
+/* Prints generalization results; returns the index of the strategy with the
+ * best mean generalization score */
+int PrintGeneralization(FILE* pf, const GENERALIZATION* rggen, int cstg) {
+	ASSERT(pf && rggen && cstg > 0);
+	int istg, istgBest = 0;
+	for (istg = 0; istg < cstg; ++istg) {
+		fprintf(pf, "# Generalization (rank %d): %g +/- %g (%d sessions)\n", istg + 1,
+			rggen[istg].rMean, rggen[istg].rHalfWidth, rggen[istg].cSessions);
+		if (rggen[istg].rMean > rggen[istgBest].rMean)
+			istgBest = istg;
 	}
-	WorldDestroy(pwldCurrent);
+	return istgBest;
 }
 
 
-/* Calculate generalization score for a strategy */
-double CalculateGeneralization(ARGS const* pArgs, STRATEGY* pstg, const WORLD* pWorld) {
-	ASSERT(pArgs && pstg && pWorld);
+/* Where steady-state progress goes */
+typedef struct {
+	FILE*          pf;
+	METRICS*       pmet;   /* Or NULL */
+	const CONTEXT* pctx;
+	double         rStart; /* Seconds when evolution started */
+} STEADYREPORT; /* rpt */
+
+
+/* Steady-state progress callback: prints a line in the same format as a
+ * generation's to the STEADYREPORT's file, and publishes metrics if asked.
+ * Workers are still running sessions, so action counts are left out. Never
+ * stops evolution itself. */
+bool PrintSteadyStateReport(void* pvReport, int iReport, double rBestFitness, double rMeanFitness) {
+	STEADYREPORT* prpt = (STEADYREPORT*) pvReport;
+	fprintf(prpt->pf, "%d\t\t%g\n", iReport, rBestFitness);
+	fflush(prpt->pf);
+	if (prpt->pmet) {
+		const ARGS* pArgs = &prpt->pctx->args;
+		METRICSSAMPLE smp;
+		memset(&smp, 0, sizeof(smp));
+		smp.pszPhase = "evolving";
+		smp.iGeneration = iReport;
+		smp.rBestFitness = rBestFitness;
+		smp.rMeanFitness = rMeanFitness;
+		smp.cEvaluations = pArgs->nPopulationSize + (int64_t)iReport *
+			(pArgs->cReportEvaluations > 0 ? pArgs->cReportEvaluations : pArgs->nPopulationSize);
+		smp.rSecondsEvaluating = Seconds() - prpt->rStart;
+		MetricsPublish(prpt->pmet, &smp);
+	}
+	return false;
+}
 
-	/* Create a world to play in */
-	WORLD* pwldCurrent = WorldCreate(pWorld->cx, pWorld->cy);
 
-	int iSession, nScoreSum = 0;
-	for (iSession = 0; iSession < GENERALIZATION_SESSIONS; ++iSession) {
-		WorldCopy(pWorld, pwldCurrent);
-		WorldSetCansRandomly(pwldCurrent, pArgs->rCanProbability);
-		nScoreSum += RobbyClean(pArgs, pwldCurrent, pstg, pArgs->cSessionActions);
-	}
-	WorldDestroy(pwldCurrent);
-	return (double)nScoreSum / GENERALIZATION_SESSIONS;
+/* Publishes the run's progress, if it has a metrics page. Must not be called
+ * while sessions are running. */
+void PublishMetrics(METRICS* pmet, const CONTEXT* pctx, PCSZ pszPhase) {
+	if (!pmet)
+		return;
+	METRICSSAMPLE smp;
+	ContextGetMetrics(pctx, pszPhase, &smp);
+	MetricsPublish(pmet, &smp);
 }
 
 
-/* Selects a parent for mating based on fitness rank of a (pre-sorted) population */
-int SelectParent(POPULATION* pPop) {
-	ASSERT(pPop);
-
-	const int nPopSize = pPop->cstg;
-	int istg = rand() % nPopSize;
-	int cTries = nPopSize;
-	/* sum = 1 + 2 + ... + n (where n is population size) or
-	 * n(n+1)/2 */
-	double sum = (double) (nPopSize * (nPopSize + 1) / 2);
-	while (cTries-- > 0) {
-		/* istg is the index of the strategy we're looking at *and*
-		 * its (0-based) rank.
-		 * The probability that each individual will be chosen:
-		 *    POPULATION_SIZE - fitness_rank + 1
-		 *   ------------------------------------
-		 *    1 + 2 + ... + POPULATION_SIZE
-		 */
-		double rRandom = RandomZeroOne();
-		double rProb = (double)(nPopSize - istg + 1) / sum;
-		if (rRandom < rProb)
-			return istg;
-
-		istg = (istg + 1) % nPopSize;
+/* Writes the hit counts collected since the last call as one row of the
+ * counts file, if there is one */
+void WriteCounters(FILE* pf, CONTEXT* pctx, PCSZ pszLabel) {
+	if (!pf)
+		return;
+	/* Too big for the stack with the larger neighborhoods */
+	COUNTERS* pcnt = (COUNTERS*) malloc(sizeof(COUNTERS));
+	VerifyAlloc(pcnt, "counters");
+	ContextTakeCounters(pctx, pcnt);
+	CountersWrite(pf, pszLabel, pcnt);
+	free(pcnt);
+}
+
+
+/* Program Robby with an "intelligent" strategy: Pick up a can if you're on
+ * one, move toward a can if there's one adjacent, move away from a wall if
+ * there's one adjacent, or, if none of the above, just make a random move */
+void BuildIdStrategy(STRATEGY* pstg) {
+	ASSERT(pstg);
+	int i;
+	memset(pstg, 0, sizeof(*pstg));
+	for (i = 0; i < STRATEGY_LENGTH; ++i) {
+		STATE s = WorldGetStateFromIndex(i);
+		if (s.current == CELL_CAN)
+			StrategySetAction(pstg, i, PickUpCan);
+		else if (s.west == CELL_CAN)
+			StrategySetAction(pstg, i, MoveWest);
+		else if (s.north == CELL_CAN)
+			StrategySetAction(pstg, i, MoveNorth);
+		else if (s.east == CELL_CAN)
+			StrategySetAction(pstg, i, MoveEast);
+		else if (s.south == CELL_CAN)
+			StrategySetAction(pstg, i, MoveSouth);
+		else if (s.west == CELL_WALL)
+			StrategySetAction(pstg, i, MoveEast);
+		else if (s.north == CELL_WALL)
+			StrategySetAction(pstg, i, MoveSouth);
+		else if (s.east == CELL_WALL)
+			StrategySetAction(pstg, i, MoveWest);
+		else if (s.south == CELL_WALL)
+			StrategySetAction(pstg, i, MoveNorth);
+		else
+			StrategySetAction(pstg, i, MoveRandom);
 	}
-	return rand() % nPopSize;
 }
 
 
-/* Mates two strategies given a crossover index, putting resulting ACTION set into child */
-void MateStrategies(
-	const STRATEGY* pstgMother,
-	const STRATEGY* pstgFather,
-	STRATEGY* pstgChild,
-	int iactCrossover)
-{
-	ASSERT(pstgMother && pstgFather && pstgChild);
-	ASSERT(iactCrossover >= 0 && iactCrossover < STRATEGY_LENGTH);
+/* Robby's welcome message */
+void PrintWelcome(void) {
+	time_t tmNow = time(NULL);
+	char* szDateTime = ctime(&tmNow);
+	printf("# Robby the Soda-Can-Collecting Robot\n");
+	printf("# %s", szDateTime);
+	printf("# Neighborhood:    %s (%d states)\n", NEIGHBORHOOD_NAME, STRATEGY_LENGTH);
+}
+
+
+/* Returns whether pszFile can be created (or truncated) for writing. It is
+ * left behind, empty. */
+bool CanCreateFile(PCSZ pszFile) {
+	FILE* pf = fopen(pszFile, "w");
+	if (!pf)
+		return false;
+	fclose(pf);
+	return true;
+}
 
-	size_t as = sizeof(pstgMother->rgact[0]);
-	int cactMother = iactCrossover;
-	int cactFather = STRATEGY_LENGTH - iactCrossover;
 
-	memcpy(&pstgChild->rgact[0], &pstgMother->rgact[0], as * cactMother);
-	memcpy(&pstgChild->rgact[iactCrossover], &pstgFather->rgact[iactCrossover], as * cactFather);
+/* Returns whether a file can be created in pszDir; the trial file is removed */
+bool CanCreateInDirectory(PCSZ pszDir) {
+	char szFile[4096];
+	snprintf(szFile, sizeof(szFile), "%s/robby-check-XXXXXX", pszDir);
+	int fd = mkstemp(szFile);
+	if (fd < 0)
+		return false;
+	unlink(szFile);
+	close(fd);
+	return true;
 }
 
 
-/* Mutate given strategy. "For each number in the child's chromosome, with
- * probability MUTATION PROBABILITY replace that number with a randomly
- * generated number between 0 and 6." */
-void MutateStrategy(double rMutationProbability, STRATEGY* pstg) {
-	int iact;
-	for (iact = 0; iact < STRATEGY_LENGTH; ++iact) {
-		if (RandomZeroOne() < rMutationProbability)
-			pstg->rgact[iact] = rand() % NUM_ACTIONS;
+/* Returns why a run with these parameters cannot start, or NULL if it can.
+ * Checked up front so a served job can be refused without taking the
+ * server down: output files are created, and if pwld (the loaded world) is
+ * given, the test bank is opened against it. */
+PCSZ CheckArgs(const ARGS* pArgs, const WORLD* pwld) {
+	if (pArgs->nPopulationSize < 1 || pArgs->cSessions < 1 || pArgs->cSessionActions < 1)
+		return "Population size, sessions and session actions must be positive";
+	if (access(pArgs->pszWorld, R_OK) != 0)
+		return "Cannot read the world file";
+	if (pArgs->pszTestBank && access(pArgs->pszTestBank, R_OK) != 0)
+		return "Cannot read the test bank";
+	if (pArgs->pszArchive && pArgs->evolutionType != Generational)
+		return "--archive needs generational evolution (no -S)";
+	if (pArgs->pszCounts && !INSTRUMENT_ENABLED)
+		return "--counts needs an instrumented build (scons instrument=1)";
+	if (pArgs->bLazyCans && pArgs->pszTestBank)
+		return "--lazy-cans cannot replay the layouts of a --test-bank";
+	if (pArgs->bDeltaEvaluation && pArgs->evolutionType != Generational)
+		return "--delta needs generational evolution (no -S)";
+	if (pArgs->pszMetrics && (pArgs->pszMetrics[0] == '\0' || strchr(pArgs->pszMetrics, '/') ||
+	                          strlen(pArgs->pszMetrics) > 200))
+		return "--metrics needs a short name without slashes";
+	if (pArgs->cCheckpointInterval < 0)
+		return "--checkpoint needs a positive number of generations";
+	if (pArgs->cCheckpointInterval > 0 && pArgs->evolutionType != Generational)
+		return "--checkpoint needs generational evolution (no -S)";
+	if (pArgs->nSurrogateOversample != 0 && pArgs->nSurrogateOversample < 2)
+		return "--surrogate needs at least 2 children bred per child evaluated";
+	if (pArgs->nSurrogateOversample > 0 && pArgs->evolutionType != Generational)
+		return "--surrogate needs generational evolution (no -S)";
+	if (pArgs->rTimeBudget < 0.0 || pArgs->cStopWindow < 0 || pArgs->rStopTolerance < 0.0)
+		return "--time-budget, --window and --tolerance cannot be negative";
+	if (pArgs->cLayoutProducers < 0)
+		return "--producers cannot be negative";
+	if (pArgs->cLayoutProducers > 0 && (pArgs->evolutionType != Generational || pArgs->bDeltaEvaluation ||
+	                                    pArgs->bLazyCans))
+		return "--producers needs generational evolution without --delta or --lazy-cans";
+	if (pArgs->cSearchConfigs < 0)
+		return "--search needs a positive number of configurations";
+	if (pArgs->cSearchConfigs > 0 && (pArgs->evolutionType != Generational || pArgs->robbyType == IdRobby ||
+	                                  pArgs->cGenerations < 1))
+		return "--search needs generational evolution (no -S or -z id) and at least one generation";
+	if (pArgs->cSearchConfigs > 0 && (pArgs->pszArchive || pArgs->pszCounts || pArgs->pszMetrics ||
+	                                  pArgs->cCheckpointInterval > 0 || pArgs->rTimeBudget > 0.0 ||
+	                                  pArgs->bTargetFitness || pArgs->cStopWindow > 0))
+		return "--search sets its own budgets and output; it takes no --archive, --counts, --metrics, "
+		       "--checkpoint or stopping options";
+	if (pwld && pArgs->pszTestBank) {
+		char szError[512];
+		BANK* pbank = BankTryOpen(pArgs->pszTestBank, pwld, szError, sizeof(szError));
+		if (!pbank)
+			return "The test bank cannot be opened for this world";
+		bool bShort = pbank->cLayouts < GENERALIZATION_ROUND_SESSIONS;
+		BankClose(pbank);
+		if (bShort)
+			return "The test bank holds too few layouts to generalize on";
 	}
+	/* Last, as these leave their files behind */
+	if (pArgs->pszArchive && !CanCreateFile(pArgs->pszArchive))
+		return "Cannot create the --archive file";
+	if (pArgs->pszCounts && !CanCreateFile(pArgs->pszCounts))
+		return "Cannot create the --counts file";
+	if (pArgs->pszPopulationDir && !CanCreateInDirectory(pArgs->pszPopulationDir))
+		return "Cannot create files in the --population-dir directory";
+	return NULL;
 }
 
 
-/* Evolves a complete, new population from an existing one using crossover/
- * cloning, and genetic mutation. */
-void EvolveNewPopulation(const ARGS* pArgs, POPULATION* pPopOld, POPULATION* pPopNew) {
-	ASSERT(pPopOld && pPopNew);
-	ASSERT(pPopOld->maxstg == pPopNew->maxstg);
-
-	PopulationEmpty(pPopNew);
-	while (!PopulationIsFull(pPopNew)) {
-		STRATEGY* pstgMother;
-		STRATEGY* pstgFather;
-		int istgMother, istgFather;
-		STRATEGY stgSon, stgDaughter;
-
-		/* Pick parents via "roulette-wheel" selection */
-		istgMother = SelectParent(pPopOld);
-		istgFather = SelectParent(pPopOld);
-		ASSERT(istgMother >= 0 && istgMother < pPopOld->cstg);
-		ASSERT(istgFather >= 0 && istgFather < pPopOld->cstg);
-
-		pstgMother = &pPopOld->rgstg[istgMother];
-		pstgFather = &pPopOld->rgstg[istgFather];
-
-		if (pArgs->bUseCrossover) {
-			/* Mate the parent strategies to form two children using same
-			 * crossover point, but switching parent order for second child, to
-			 * get both combinations of this specific crossover point */
-			int iactCrossover = rand() % STRATEGY_LENGTH;
-			MateStrategies(pstgMother, pstgFather, &stgSon, iactCrossover);
-			MateStrategies(pstgFather, pstgMother, &stgDaughter, iactCrossover);
+/* Runs one evolution (or, if pstgEvaluate is given or the Robby type is
+ * IdRobby, just scores that one strategy; or, with --search, a search over
+ * settings) and prints its results to pf.
+ * pwldTemplate is the loaded world, or NULL to load pArgs->pszWorld. */
+void RunRobby(const ARGS* pArgs, const WORLD* pwldTemplate, const STRATEGY* pstgEvaluate, FILE* pf) {
+	ASSERT(pArgs && pf);
+	CONTEXT* pctx;
+	double rGeneralization;
+	FILE* pfCounts = NULL;
+	METRICS* pmet = NULL;
+
+	if (pArgs->cSearchConfigs > 0 && !pstgEvaluate) {
+		SearchRun(pArgs, pwldTemplate, pf);
+		return;
+	}
+	pctx = ContextCreate(pArgs, pwldTemplate);
+	if (pArgs->pszMetrics) {
+		pmet = MetricsCreate(pArgs->pszMetrics);
+		if (!pmet)
+			fprintf(pf, "# Cannot publish metrics as '%s'\n", pArgs->pszMetrics);
+		PublishMetrics(pmet, pctx, "evolving");
+	}
+	if (pctx->pbank)
+		fprintf(pf, "# Test bank holds %d layouts (can probability %g)\n",
+			pctx->pbank->cLayouts, pctx->pbank->rCanProbability);
+	if (pArgs->pszCounts) {
+		pfCounts = fopen(pArgs->pszCounts, "w");
+		if (!pfCounts)
+			Die("Cannot create '%s'", pArgs->pszCounts);
+		CountersWriteHeader(pfCounts);
+	}
+
+	if (!pstgEvaluate && (pArgs->robbyType == NormalRobby || pArgs->robbyType == SmartRobby)) {
+		fputs("#\n# Generation\tScore", pf);
+		if (pArgs->bDiversity && pArgs->evolutionType == Generational)
+			fputs("\tDistance\tEntropy\tUnique", pf);
+		if (pArgs->cCheckpointInterval > 0)
+			fputs("\tCheckpoint", pf);
+		fputc('\n', pf);
+		if (pArgs->evolutionType != Generational) {
+			STEADYREPORT rpt = { .pf = pf, .pmet = pmet, .pctx = pctx, .rStart = Seconds() };
+			ContextEvolveSteadyState(pctx, PrintSteadyStateReport, &rpt);
+			WriteCounters(pfCounts, pctx, "steady-state");
 		} else {
-			/* Don't use crossover; just clone mother and father, and mutate */
-			StrategyCopy(pstgMother, &stgDaughter);
-			StrategyCopy(pstgFather, &stgSon);
+			CHECKPOINTER* pchk = NULL;
+			if (pArgs->cCheckpointInterval > 0)
+				pchk = CheckpointerCreate(&pctx->args, pctx->pwld, pctx->pbank);
+			/* Stop early if a served job's client has gone away */
+			while (pctx->iGeneration < pArgs->cGenerations && !ferror(pf)) {
+				ContextStep(pctx);
+				fprintf(pf, "%d\t\t%g", pctx->iGeneration, ContextGetBest(pctx)->rFitness);
+				if (pArgs->bDiversity) {
+					DIVERSITY div;
+					ContextGetDiversity(pctx, &div);
+					fprintf(pf, "\t%g\t%g\t%d", div.rMeanDistance, div.rMeanEntropy, div.cUnique);
+				}
+				if (pchk) {
+					/* Only one checkpoint is scored at a time; evolution never
+					 * waits for a late one, it skips the due checkpoint and
+					 * takes the next */
+					int iCheckpoint;
+					GENERALIZATION gen;
+					if (CheckpointerCollect(pchk, false, &iCheckpoint, &gen))
+						fprintf(pf, "\t%g@%d", gen.rMean, iCheckpoint);
+					else
+						fputs("\t-", pf);
+					if (pctx->iGeneration % pArgs->cCheckpointInterval == 0)
+						CheckpointerSubmit(pchk, ContextGetBest(pctx), pctx->iGeneration);
+				}
+				fputc('\n', pf);
+				fflush(pf);
+				char szGeneration[16];
+				snprintf(szGeneration, sizeof(szGeneration), "%d", pctx->iGeneration);
+				WriteCounters(pfCounts, pctx, szGeneration);
+				PublishMetrics(pmet, pctx, "evolving");
+				if (ContextCheckStop(pctx))
+					break;
+			}
+			if (pchk) {
+				int iCheckpoint;
+				GENERALIZATION gen;
+				if (CheckpointerCollect(pchk, true, &iCheckpoint, &gen))
+					fprintf(pf, "# Checkpoint (generation %d): %g +/- %g (%d sessions)\n",
+						iCheckpoint, gen.rMean, gen.rHalfWidth, gen.cSessions);
+				CheckpointerDestroy(pchk);
+			}
 		}
-		/* Either way, mutate the children before adding them */
-		MutateStrategy(pArgs->rMutationProbability, &stgSon);
-		MutateStrategy(pArgs->rMutationProbability, &stgDaughter);
-		PopulationAddStrategy(pPopNew, &stgSon);
-		PopulationAddStrategy(pPopNew, &stgDaughter);
 
-	}
-	ASSERT(pPopOld->cstg == pPopNew->cstg);
-}
+		if (pArgs->rTimeBudget > 0.0 || pArgs->bTargetFitness || pArgs->cStopWindow > 0) {
+			PCSZ pszReason = ContextGetStopReason(pctx);
+			fprintf(pf, "# Stopped after generation %d: %s\n", pctx->iGeneration,
+				pszReason ? pszReason : "generation limit reached");
+		}
 
+		/* Fitness is noisy, so the top-ranked strategy is not necessarily
+		 * the best one; score the top few and report the best of them */
+		const POPULATION* pPop = ContextGetPopulation(pctx);
+		int cGeneralize = pArgs->cGeneralizeTop;
+		if (cGeneralize < 1)
+			cGeneralize = 1;
+		if (cGeneralize > pPop->cstg)
+			cGeneralize = pPop->cstg;
+		STRATEGY** rgpstg = (STRATEGY**) malloc(sizeof(STRATEGY*) * cGeneralize);
+		VerifyAlloc(rgpstg, "%d strategies to generalize", cGeneralize);
+		GENERALIZATION* rggen = (GENERALIZATION*) malloc(sizeof(GENERALIZATION) * cGeneralize);
+		VerifyAlloc(rggen, "%d generalization scores", cGeneralize);
+		int istg;
+		for (istg = 0; istg < cGeneralize; ++istg)
+			rgpstg[istg] = &pPop->rgstg[istg];
+		PublishMetrics(pmet, pctx, "generalizing");
+		ContextGeneralize(pctx, rgpstg, cGeneralize, rggen);
+		WriteCounters(pfCounts, pctx, "generalization");
+		istg = PrintGeneralization(pf, rggen, cGeneralize);
+		fprintf(pf, "# Best generalizing rank: %d\n", istg + 1);
+		rGeneralization = rggen[istg].rMean;
+		free(rggen);
+		free(rgpstg);
+	} else {
+		ASSERT(pstgEvaluate || pArgs->robbyType == IdRobby);
+		/* Too big for the stack with the larger neighborhoods */
+		STRATEGY* pstg = StrategyAllocArray(1);
+		GENERALIZATION gen;
+		if (pstgEvaluate)
+			StrategyCopy(pstgEvaluate, pstg);
+		else
+			BuildIdStrategy(pstg);
+		PublishMetrics(pmet, pctx, "generalizing");
+		ContextGeneralize(pctx, &pstg, 1, &gen);
+		WriteCounters(pfCounts, pctx, "generalization");
+		PrintGeneralization(pf, &gen, 1);
+		rGeneralization = gen.rMean;
+		StrategyFreeArray(pstg);
+	}
+	uint64_t cActionsRun, cActionsSkipped;
+	ContextGetActionCounts(pctx, &cActionsRun, &cActionsSkipped);
+	fprintf(pf, "# Actions fast-forwarded: %.1f%% (%llu of %llu)\n",
+		cActionsRun ? 100.0 * cActionsSkipped / cActionsRun : 0.0,
+		(unsigned long long)cActionsSkipped, (unsigned long long)cActionsRun);
+	if (pArgs->bDeltaEvaluation) {
+		int64_t cSessionsScored, cSessionsReused;
+		ContextGetSessionCounts(pctx, &cSessionsScored, &cSessionsReused);
+		fprintf(pf, "# Sessions reused: %.1f%% (%lld of %lld)\n",
+			cSessionsScored ? 100.0 * cSessionsReused / cSessionsScored : 0.0,
+			(long long)cSessionsReused, (long long)cSessionsScored);
+	}
+	const SURROGATE* psur = ContextGetSurrogate(pctx);
+	if (psur && psur->cChildrenBred > 0) {
+		int64_t cScreenedOut = psur->cChildrenBred - psur->cChildrenEvaluated;
+		fprintf(pf, "# Surrogate screened out: %.1f%% (%lld of %lld children; %lld sessions not simulated)\n",
+			100.0 * cScreenedOut / psur->cChildrenBred, (long long)cScreenedOut,
+			(long long)psur->cChildrenBred, (long long)cScreenedOut * pArgs->cSessions);
+		fprintf(pf, "# Surrogate accuracy: correlation %.3f, mean absolute error %g\n",
+			psur->cCorrelations ? psur->rCorrelationSum / psur->cCorrelations : 0.0,
+			psur->rAbsErrorSum / psur->cChildrenEvaluated);
+	}
+	fprintf(pf, "# Generalization score: %g\n", rGeneralization);
+	fflush(pf);
 
-/* Robby's welcome message */
-void PrintWelcome(void) {
-	time_t tmNow = time(NULL);
-	char* szDateTime = ctime(&tmNow);
-	printf("# Robby the Soda-Can-Collecting Robot\n");
-	printf("# %s", szDateTime);
+	if (pmet) {
+		PublishMetrics(pmet, pctx, "done");
+		MetricsDestroy(pmet);
+	}
+	if (pfCounts)
+		fclose(pfCounts);
+	ContextDestroy(pctx);
 }
 
 
 /* Program entry point */
 int main(int argc, char** argv) {
-	/* start with default values */
-	ARGS args = k_argsDefault;
-	WORLD* pwld;
-	double rGeneralization;
-
-	PrintWelcome();
-
-	ProcessCommandLine(argc, argv, &args);
-	srand(args.nSeed);
-	pwld = WorldCreateFromFile(args.pszWorld);
-
-	if (args.robbyType == NormalRobby || args.robbyType == SmartRobby) {
-		POPULATION* pPopCurrent;
-		POPULATION* pPopOther;
-
-		/* Only need two populations; the current generation's population,
-		 * and one to build the next generation into. We can just swap
-		 * them after every generation. */
-		pPopCurrent = PopulationCreate(args.nPopulationSize);
-		pPopOther   = PopulationCreate(args.nPopulationSize);
-		PopulationRandomize(pPopCurrent);
-	
-		puts("#\n# Generation\tScore");
-		int iGeneration = 0;
-		for (;;) {
-			CalculateFitness(&args, pPopCurrent, pwld);
-			PopulationSortByFitness(pPopCurrent);
-	
-			printf("%d\t\t%g\n", iGeneration + 1, pPopCurrent->rgstg[0].rFitness);
-			if (++iGeneration >= args.cGenerations)
-				break;
-			EvolveNewPopulation(&args, pPopCurrent, pPopOther);
-			SwapPointers((void**)&pPopCurrent, (void**)&pPopOther);
+	/* Server, client and viewer modes take over the whole command line */
+	if (argc >= 2 && strcmp(argv[1], "--top") == 0) {
+		if (argc != 3) {
+			Usage(stderr);
+			return EXIT_FAILURE;
 		}
-		rGeneralization = CalculateGeneralization(&args, &pPopCurrent->rgstg[0], pwld);
-	
-		PopulationDestroy(pPopOther);
-		PopulationDestroy(pPopCurrent);
-	} else {
-		ASSERT(args.robbyType == IdRobby);
-		STRATEGY stgId;
-		int i;
-		/* Program Robby with an "intelligent" strategy: Pick up a can if
-		 * you're on one, move toward a can if there's one adjacent, move
-		 * away from a wall if there's one adjacent, or, if none of the
-		 * above, just make a random move */
-		for (i = 0; i < STRATEGY_LENGTH; ++i) {
-			STATE s = WorldGetStateFromIndex(i);
-			if (s.current == CELL_CAN)
-				stgId.rgact[i] = PickUpCan;
-			else if (s.west == CELL_CAN)
-				stgId.rgact[i] = MoveWest;
-			else if (s.north == CELL_CAN)
-				stgId.rgact[i] = MoveNorth;
-			else if (s.east == CELL_CAN)
-				stgId.rgact[i] = MoveEast;
-			else if (s.south == CELL_CAN)
-				stgId.rgact[i] = MoveSouth;
-			else if (s.west == CELL_WALL)
-				stgId.rgact[i] = MoveEast;
-			else if (s.north == CELL_WALL)
-				stgId.rgact[i] = MoveSouth;
-			else if (s.east == CELL_WALL)
-				stgId.rgact[i] = MoveWest;
-			else if (s.south == CELL_WALL)
-				stgId.rgact[i] = MoveNorth;
-			else
-				stgId.rgact[i] = MoveRandom;
+		return MetricsTop(argv[2]);
+	}
+	if (argc >= 2 && strcmp(argv[1], "--client") == 0) {
+		if (argc < 4) {
+			Usage(stderr);
+			return EXIT_FAILURE;
 		}
-		rGeneralization = CalculateGeneralization(&args, &stgId, pwld);
+		return ClientRun(argv[2], argc - 3, &argv[3]);
+	}
+	if (argc >= 2 && strcmp(argv[1], "--serve") == 0) {
+		int cJobs = 0;
+		if (argc == 5 && strcmp(argv[3], "--jobs") == 0)
+			cJobs = atoi(argv[4]);
+		else if (argc != 3) {
+			Usage(stderr);
+			return EXIT_FAILURE;
+		}
+		return ServeJobs(argv[2], ParallelThreadCount(cJobs), ProcessCommandLine, CheckArgs, RunRobby);
 	}
-	printf("# Generalization score: %g\n", rGeneralization);
 
-	WorldDestroy(pwld);
+	/* start with default values */
+	ARGS args = k_argsDefault;
+	PrintWelcome();
+	switch (ProcessCommandLine(argc, argv, &args, stdout, stderr)) {
+	case ParseHelp:
+		return EXIT_SUCCESS;
+	case ParseFailed:
+		return EXIT_FAILURE;
+	case ParseRun:
+		break;
+	}
+	PCSZ pszError = CheckArgs(&args, NULL);
+	if (pszError)
+		Die("%s", pszError);
+	RunRobby(&args, NULL, NULL, stdout);
 	return 0;
 }
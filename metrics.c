@@ -0,0 +1,211 @@
+/*****************************************************************************
+ * metrics.c: Live metrics: a run publishes its progress to a shared memory
+ * page that robby --top reads while it runs.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "types.h"
+#include "error.h"
+#include "misc.h"
+#include "metrics.h"
+
+
+/* Tries a reader makes while the writer is mid-update before giving up */
+#define METRICS_READ_TRIES	1000
+
+
+/* Returns the process's resident set size in kilobytes, or 0 if unknown */
+static long ResidentKilobytes(void) {
+	long cPages = 0;
+	FILE* pf = fopen("/proc/self/statm", "r");
+	if (!pf)
+		return 0;
+	if (fscanf(pf, "%*d %ld", &cPages) != 1)
+		cPages = 0;
+	fclose(pf);
+	return cPages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+
+/* Creates (or takes over) the shared memory object for pszName and returns
+ * its publisher, or NULL if it cannot be created */
+METRICS* MetricsCreate(PCSZ pszName) {
+	ASSERT(pszName);
+	METRICS* pmet = (METRICS*) malloc(sizeof(METRICS));
+	VerifyAlloc(pmet, "metrics");
+	snprintf(pmet->szName, sizeof(pmet->szName), METRICS_PREFIX "%s", pszName);
+
+	int fd = shm_open(pmet->szName, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		free(pmet);
+		return NULL;
+	}
+	if (ftruncate(fd, METRICS_PAGE_SIZE) != 0) {
+		close(fd);
+		shm_unlink(pmet->szName);
+		free(pmet);
+		return NULL;
+	}
+	pmet->ppage = (METRICSPAGE*) mmap(NULL, METRICS_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (pmet->ppage == MAP_FAILED) {
+		shm_unlink(pmet->szName);
+		free(pmet);
+		return NULL;
+	}
+	pmet->ppage->nSequence = 0;
+	pmet->ppage->szText[0] = '\0';
+	memcpy(pmet->ppage->szMagic, METRICS_MAGIC, sizeof(pmet->ppage->szMagic));
+	pmet->rStart = pmet->rLast = Seconds();
+	pmet->cEvaluationsLast = 0;
+	pmet->cActionsLast = 0;
+	return pmet;
+}
+
+
+/* Publishes a sample, with rates since the previous one. Never blocks: a
+ * reader that overlaps the update simply reads again. */
+void MetricsPublish(METRICS* pmet, const METRICSSAMPLE* psmp) {
+	ASSERT(pmet && psmp);
+	char szText[METRICS_TEXT_LENGTH];
+	double rNow = Seconds();
+	double rInterval = rNow - pmet->rLast;
+	int cch = 0;
+
+	cch += snprintf(szText + cch, sizeof(szText) - cch, "pid %d\nphase %s\n", (int)getpid(), psmp->pszPhase);
+	if (psmp->cGenerations > 0)
+		cch += snprintf(szText + cch, sizeof(szText) - cch, "generation %d of %d\n",
+			psmp->iGeneration, psmp->cGenerations);
+	else
+		cch += snprintf(szText + cch, sizeof(szText) - cch, "generation %d\n", psmp->iGeneration);
+	cch += snprintf(szText + cch, sizeof(szText) - cch,
+		"best_fitness %g\nmean_fitness %g\nevaluations %lld\n",
+		psmp->rBestFitness, psmp->rMeanFitness, (long long)psmp->cEvaluations);
+	if (rInterval > 0.0) {
+		cch += snprintf(szText + cch, sizeof(szText) - cch, "evaluations_per_second %.1f\n",
+			(psmp->cEvaluations - pmet->cEvaluationsLast) / rInterval);
+		if (psmp->cActions > 0)
+			cch += snprintf(szText + cch, sizeof(szText) - cch, "actions_per_second %.4g\n",
+				(double)(psmp->cActions - pmet->cActionsLast) / rInterval);
+	}
+	snprintf(szText + cch, sizeof(szText) - cch,
+		"seconds_elapsed %.1f\nseconds_evaluating %.1f\nseconds_breeding %.1f\n"
+		"seconds_generalizing %.1f\nrss_kb %ld\n",
+		rNow - pmet->rStart, psmp->rSecondsEvaluating, psmp->rSecondsBreeding,
+		psmp->rSecondsGeneralizing, ResidentKilobytes());
+	pmet->rLast = rNow;
+	pmet->cEvaluationsLast = psmp->cEvaluations;
+	pmet->cActionsLast = psmp->cActions;
+
+	/* Odd while the text is inconsistent */
+	METRICSPAGE* ppage = pmet->ppage;
+	uint64_t nSequence = ppage->nSequence;
+	__atomic_store_n(&ppage->nSequence, nSequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(ppage->szText, szText, strlen(szText) + 1);
+	__atomic_store_n(&ppage->nSequence, nSequence + 2, __ATOMIC_RELEASE);
+}
+
+
+/* Removes the shared memory object and frees the publisher. Readers that
+ * have it mapped keep seeing the last sample. */
+void MetricsDestroy(METRICS* pmet) {
+	ASSERT(pmet);
+	shm_unlink(pmet->szName);
+	munmap(pmet->ppage, METRICS_PAGE_SIZE);
+	free(pmet);
+}
+
+
+/* Copies a consistent snapshot of the page's text into szText; returns false
+ * if the writer stayed mid-update (it may have died there) */
+static bool MetricsRead(const METRICSPAGE* ppage, char* szText) {
+	int cTries;
+	for (cTries = 0; cTries < METRICS_READ_TRIES; ++cTries) {
+		uint64_t nBefore = __atomic_load_n(&ppage->nSequence, __ATOMIC_ACQUIRE);
+		if (nBefore & 1) {
+			sched_yield();
+			continue;
+		}
+		memcpy(szText, (const char*) ppage->szText, METRICS_TEXT_LENGTH);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&ppage->nSequence, __ATOMIC_RELAXED) == nBefore) {
+			szText[METRICS_TEXT_LENGTH - 1] = '\0';
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/* The --top viewer: shows the metrics a run publishes as pszName, refreshed
+ * every second until the run is done or gone. If stdout is not a terminal,
+ * prints one snapshot and returns. Returns the process exit code. */
+int MetricsTop(PCSZ pszName) {
+	ASSERT(pszName);
+	char szObject[256];
+	snprintf(szObject, sizeof(szObject), METRICS_PREFIX "%s", pszName);
+	int fd = shm_open(szObject, O_RDONLY, 0);
+	if (fd < 0) {
+		fprintf(stderr, "No run is publishing metrics as '%s'\n", pszName);
+		return EXIT_FAILURE;
+	}
+	const METRICSPAGE* ppage = (const METRICSPAGE*) mmap(NULL, METRICS_PAGE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ppage == MAP_FAILED || memcmp(ppage->szMagic, METRICS_MAGIC, sizeof(ppage->szMagic)) != 0) {
+		fprintf(stderr, "'%s' does not hold robby metrics\n", pszName);
+		return EXIT_FAILURE;
+	}
+
+	bool bTerminal = isatty(STDOUT_FILENO);
+	char szText[METRICS_TEXT_LENGTH];
+	for (;;) {
+		if (!MetricsRead(ppage, szText))
+			strcpy(szText, "(update in progress)\n");
+		if (bTerminal)
+			fputs("\033[H\033[J", stdout); /* Home and clear */
+		printf("# Metrics of run '%s'\n%s", pszName, szText);
+		fflush(stdout);
+
+		int pid = 0;
+		if (!bTerminal || strstr(szText, "\nphase done\n"))
+			break;
+		if (sscanf(szText, "pid %d", &pid) == 1 && kill(pid, 0) != 0) {
+			printf("# The run has exited\n");
+			break;
+		}
+		sleep(1);
+	}
+	munmap((void*) ppage, METRICS_PAGE_SIZE);
+	return EXIT_SUCCESS;
+}
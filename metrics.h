@@ -0,0 +1,76 @@
+/*****************************************************************************
+ * metrics.h: Header for metrics.c.
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#pragma once
+#include "types.h"
+
+
+/* Name prefix of the shared memory objects runs publish to (see shm_open) */
+#define METRICS_PREFIX		"/robby-"
+#define METRICS_MAGIC		"ROBYMET1"
+#define METRICS_PAGE_SIZE	4096
+#define METRICS_TEXT_LENGTH	(METRICS_PAGE_SIZE - 16)
+
+
+/*
+ * The shared page: a seqlock-guarded block of "key value" text lines. The
+ * writer makes nSequence odd, rewrites the text and makes it even again, so
+ * it never waits on a reader; a reader copies the text and retries if the
+ * sequence was odd or changed meanwhile.
+ */
+typedef struct {
+	char              szMagic[8];
+	volatile uint64_t nSequence;
+	char              szText[METRICS_TEXT_LENGTH];
+} METRICSPAGE; /* page */
+
+
+/* What a run reports each time it publishes */
+typedef struct {
+	PCSZ     pszPhase;          /* "evolving", "generalizing" or "done" */
+	int      iGeneration;       /* Generations (or steady-state reports) so far */
+	int      cGenerations;
+	double   rBestFitness;
+	double   rMeanFitness;
+	int64_t  cEvaluations;      /* Strategies evaluated so far */
+	uint64_t cActions;          /* Session actions so far, or 0 if unknown */
+	double   rSecondsEvaluating;
+	double   rSecondsBreeding;
+	double   rSecondsGeneralizing;
+} METRICSSAMPLE; /* smp */
+
+
+/* A run's publisher */
+typedef struct {
+	METRICSPAGE* ppage;
+	char         szName[256];   /* Shared memory object name */
+	double       rStart;        /* Seconds (see Seconds) at creation */
+	double       rLast;         /* ...at the last publication */
+	int64_t      cEvaluationsLast;
+	uint64_t     cActionsLast;
+} METRICS; /* met */
+
+
+/* Function prototypes */
+METRICS* MetricsCreate(PCSZ pszName);
+void     MetricsPublish(METRICS* pmet, const METRICSSAMPLE* psmp);
+void     MetricsDestroy(METRICS* pmet);
+int      MetricsTop(PCSZ pszName);
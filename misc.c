@@ -24,7 +24,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
  *****************************************************************************/
-#include <stdlib.h> /* rand() */
+#include <time.h>   /* clock_gettime */
 #include "error.h"  /* ASSERT() */
 #include "misc.h"
 
@@ -51,9 +51,9 @@ int Sum(const int n[], int c) {
 }
 
 
-/* Grab random number between 0.0 and 1.0 inclusive, at least
- * theoretically (if the RAND_MAX cast is represented accurately
- * in double-precision floating point) */
-double RandomZeroOne() {
-	return (double)rand() / (double)RAND_MAX;
+/* Returns seconds from an arbitrary fixed point, for timing intervals */
+double Seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
 }
@@ -23,4 +23,4 @@
 
 void SwapPointers(void** ppLeft, void** ppRight);
 int Sum(const int n[], int c);
-double RandomZeroOne();
+double Seconds(void);
@@ -0,0 +1,103 @@
+/*****************************************************************************
+ * mkbank.c: Command-line tool that writes a layout bank for robby --test-bank.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "types.h"
+#include "error.h"
+#include "args.h"
+#include "world.h"
+#include "bank.h"
+
+
+/* Enough layouts for the longest generalization (see evolve.c) */
+#define DEFAULT_LAYOUTS	10000
+
+
+/* Print program command-line usage */
+void Usage() {
+	const ARGS* p = &k_argsDefault;
+	fprintf(stderr, "Usage: ./mkbank ARGS <Bank file>\n");
+	fprintf(stderr, "Writes a bank of can layouts for robby --test-bank.\n");
+	fprintf(stderr, "Where ARGS is zero or more of:\n");
+	fprintf(stderr, "\t-n <Layouts>              (default: %d)\n", DEFAULT_LAYOUTS);
+	fprintf(stderr, "\t-c <Can Probability>      (default: %g)\n", p->rCanProbability);
+	fprintf(stderr, "\t-r <Random number seed>   (default: %d)\n", p->nSeed);
+	fprintf(stderr, "\t-w <World file to use>    (default: %s)\n", p->pszWorld);
+	fprintf(stderr, "\t-h: Display this help message and exit\n");
+}
+
+
+/* Program entry point */
+int main(int argc, char** argv) {
+	PCSZ pszWorld = k_argsDefault.pszWorld;
+	double rCanProbability = k_argsDefault.rCanProbability;
+	int nSeed = k_argsDefault.nSeed;
+	int cLayouts = DEFAULT_LAYOUTS;
+	int ch;
+
+	opterr = 0;
+	while ((ch = getopt(argc, argv, "n:c:r:w:h")) != -1) {
+		switch (ch) {
+		case 'n':
+			cLayouts = atoi(optarg);
+			break;
+		case 'c':
+			rCanProbability = atof(optarg);
+			break;
+		case 'r':
+			nSeed = atoi(optarg);
+			break;
+		case 'w':
+			pszWorld = optarg;
+			break;
+		case 'h':
+			Usage();
+			exit(EXIT_SUCCESS);
+			break;
+		default:
+			fprintf(stderr, "Unknown option or missing argument: -%c\n", optopt);
+			Usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (optind != argc - 1) {
+		Usage();
+		exit(EXIT_FAILURE);
+	}
+	if (cLayouts < 1)
+		Die("Need at least one layout");
+	if (rCanProbability < 0.0 || rCanProbability > 1.0)
+		Die("Can probability must be between 0 and 1");
+
+	WORLD* pwld = WorldCreateFromFile(pszWorld);
+	BankWrite(argv[optind], pwld, cLayouts, rCanProbability, (uint64_t)nSeed);
+	printf("Wrote %d layouts of '%s' (can probability %g, seed %d) to '%s'\n",
+		cLayouts, pszWorld, rCanProbability, nSeed, argv[optind]);
+	WorldDestroy(pwld);
+	return 0;
+}
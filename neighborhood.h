@@ -0,0 +1,54 @@
+/*****************************************************************************
+ * neighborhood.h: Compile-time choice of the cells Robby perceives.
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#pragma once
+
+/*
+ * The neighborhood is the set of cells Robby perceives, and so decides how
+ * many states a strategy needs a gene for. It is chosen at compile time
+ * (scons neighborhood=vonneumann|moore|radius2), so that the genome length
+ * and state encoding are constants everywhere:
+ *
+ *   von Neumann (default): current cell and its 4 neighbors, 3^5 states
+ *   Moore:                 current cell and its 8 neighbors, 3^9 states
+ *   Radius 2:              every cell within 2 steps, 3^13 states
+ *
+ * The state index is a base-3 number with one digit per perceived cell (its
+ * CELL value). Digits 0-4 are always current, north, south, west and east;
+ * larger neighborhoods append their other cells (see world.c).
+ */
+#if defined(NEIGHBORHOOD_MOORE)
+#define NEIGHBORHOOD_NAME		"Moore"
+#define NEIGHBORHOOD_CELLS		9
+#define NEIGHBORHOOD_STATES		19683
+#define NEIGHBORHOOD_INDEX_BITS		15
+#elif defined(NEIGHBORHOOD_RADIUS2)
+#define NEIGHBORHOOD_NAME		"radius 2"
+#define NEIGHBORHOOD_CELLS		13
+#define NEIGHBORHOOD_STATES		1594323
+#define NEIGHBORHOOD_INDEX_BITS		21
+#else
+#define NEIGHBORHOOD_VON_NEUMANN
+#define NEIGHBORHOOD_NAME		"von Neumann"
+#define NEIGHBORHOOD_CELLS		5
+#define NEIGHBORHOOD_STATES		243
+#define NEIGHBORHOOD_INDEX_BITS		8
+#endif
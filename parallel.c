@@ -0,0 +1,108 @@
+/*****************************************************************************
+ * parallel.c: Minimal fork/join parallelism on top of pthreads.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h> /* sysconf */
+#include "types.h"
+#include "error.h"
+#include "parallel.h"
+
+
+typedef struct {
+	PFNPARALLELWORK pfnWork;
+	void*           pvContext;
+	int             cItems;
+	int             iItemNext; /* Next unclaimed item; updated atomically */
+} PARALLELJOB; /* job */
+
+typedef struct {
+	PARALLELJOB* pjob;
+	int          iThread;
+} PARALLELWORKER; /* wrk */
+
+
+/* Resolves a requested thread count; zero or less means "one per online CPU" */
+int ParallelThreadCount(int cThreadsRequested) {
+	if (cThreadsRequested > 0)
+		return cThreadsRequested;
+	long cCpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cCpus > 0 ? (int)cCpus : 1;
+}
+
+
+/* Thread body: claims items one at a time until none are left */
+static void* ParallelWorker(void* pv) {
+	PARALLELWORKER* pwrk = (PARALLELWORKER*) pv;
+	PARALLELJOB* pjob = pwrk->pjob;
+	for (;;) {
+		int iItem = __atomic_fetch_add(&pjob->iItemNext, 1, __ATOMIC_RELAXED);
+		if (iItem >= pjob->cItems)
+			break;
+		pjob->pfnWork(pjob->pvContext, iItem, pwrk->iThread);
+	}
+	return NULL;
+}
+
+
+/* Calls pfnWork once for each item in [0, cItems) using up to cThreads
+ * threads (the calling thread is one of them), and returns when all items
+ * are done. Items are handed out dynamically, so callers that need
+ * reproducible results must not depend on which thread ran which item. */
+void ParallelFor(int cThreads, int cItems, PFNPARALLELWORK pfnWork, void* pvContext) {
+	ASSERT(pfnWork);
+	ASSERT(cThreads > 0);
+	if (cItems <= 0)
+		return;
+	if (cThreads > cItems)
+		cThreads = cItems;
+
+	PARALLELJOB job = {
+		.pfnWork   = pfnWork,
+		.pvContext = pvContext,
+		.cItems    = cItems,
+		.iItemNext = 0
+	};
+	PARALLELWORKER* rgwrk = (PARALLELWORKER*) malloc(sizeof(PARALLELWORKER) * cThreads);
+	VerifyAlloc(rgwrk, "%d workers", cThreads);
+	pthread_t* rgthread = (pthread_t*) malloc(sizeof(pthread_t) * cThreads);
+	VerifyAlloc(rgthread, "%d threads", cThreads);
+
+	int iThread;
+	for (iThread = 0; iThread < cThreads; ++iThread) {
+		rgwrk[iThread].pjob = &job;
+		rgwrk[iThread].iThread = iThread;
+	}
+	for (iThread = 1; iThread < cThreads; ++iThread) {
+		if (pthread_create(&rgthread[iThread], NULL, ParallelWorker, &rgwrk[iThread]) != 0)
+			Die("Cannot create worker thread %d", iThread);
+	}
+	ParallelWorker(&rgwrk[0]);
+	for (iThread = 1; iThread < cThreads; ++iThread)
+		pthread_join(rgthread[iThread], NULL);
+	free(rgthread);
+	free(rgwrk);
+}
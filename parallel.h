@@ -1,5 +1,5 @@
 /*****************************************************************************
- * main.h: Header for main.c.
+ * parallel.h: Header for parallel.c.
  *
  * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
  *
@@ -10,7 +10,7 @@
  * the Free Software Foundation, either version 3 of the License, or
  * (at your option) any later version.
  *
- * This program is distributed in the hope that it will be useful,
+ * Robby the Robot is distributed in the hope that it will be useful,
  * but WITHOUT ANY WARRANTY; without even the implied warranty of
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
  * GNU General Public License for more details.
@@ -21,22 +21,11 @@
  *****************************************************************************/
 #pragma once
 
-typedef enum {
-	NormalRobby,
-	SmartRobby,
-	IdRobby,
-} RobbyType;
+/* Work callback for ParallelFor: handles item iItem on thread iThread
+ * (0 <= iThread < number of threads), so callers can keep per-thread scratch
+ * state in an array indexed by iThread. */
+typedef void (*PFNPARALLELWORK)(void* pvContext, int iItem, int iThread);
 
-typedef struct {
-	/*  Variable                 Command line arg */
-	int nPopulationSize;         /* -p */
-	int cGenerations;            /* -g */
-	int cSessions;               /* -s */
-	int cSessionActions;         /* -a */
-	double rMutationProbability; /* -m */
-	double rCanProbability;      /* -c */
-	int nSeed;                   /* -r */
-	PCSZ pszWorld;               /* -w */
-	bool bUseCrossover;          /* -x to turn off crossover*/
-	RobbyType robbyType;         /* -z smart: SmartRobby, -z id: IntelligentDesignRobby */
-} ARGS; /* args */
+/* Function prototypes */
+int  ParallelThreadCount(int cThreadsRequested);
+void ParallelFor(int cThreads, int cItems, PFNPARALLELWORK pfnWork, void* pvContext);
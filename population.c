@@ -24,12 +24,36 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
  *****************************************************************************/
+#define _GNU_SOURCE /* sync_file_range */
+#include <fcntl.h>
+#include <math.h>   /* log2 */
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h> /* memcpy */
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "types.h"
 #include "error.h"
+#include "rng.h"
 #include "population.h"
 
 
+/* Pairwise distances are averaged over every pair when there are at most
+ * this many, and over this many random pairs otherwise */
+#define POPULATION_DIVERSITY_PAIRS	20000
+
+/* Passes over a mapped population ask for it to be read ahead in windows of
+ * about this many bytes */
+#define POPULATION_PREFETCH_BYTES	(8 * 1024 * 1024)
+
+/* Sorting a mapped population fills about this many bytes of the sorted copy
+ * per pass over the original, so the pages being written stay in memory */
+#define POPULATION_SORT_BAND_BYTES	(1024 * 1024 * 1024)
+
+
 /* Allocates a new POPULATION. */
 POPULATION* PopulationCreate(int cStrategies) {
 	ASSERT(cStrategies > 0);
@@ -37,8 +61,36 @@ POPULATION* PopulationCreate(int cStrategies) {
 	VerifyAlloc(pPop, "population");
 	pPop->cstg   = cStrategies;
 	pPop->maxstg = cStrategies;
-	pPop->rgstg  = (STRATEGY*) malloc(sizeof(STRATEGY) * cStrategies);
-	VerifyAlloc(pPop->rgstg, "population strategies");
+	pPop->rgstg  = StrategyAllocArray(cStrategies);
+	pPop->fd     = -1;
+	return pPop;
+}
+
+
+/* Allocates a new POPULATION whose strategies live in a file in pszDir,
+ * mapped into memory, so it may be larger than RAM: the kernel pages it in
+ * and out as passes stream over it. The file's space is reserved up front,
+ * so a full disk fails here rather than mid-run, and the file is unlinked
+ * at once, so it never outlives the run. */
+POPULATION* PopulationCreateMapped(int cStrategies, PCSZ pszDir) {
+	ASSERT(cStrategies > 0 && pszDir);
+	POPULATION* pPop = (POPULATION*) malloc(sizeof(POPULATION));
+	VerifyAlloc(pPop, "population");
+	size_t cb = sizeof(STRATEGY) * (size_t)cStrategies;
+	char szFile[4096];
+	snprintf(szFile, sizeof(szFile), "%s/robby-population-XXXXXX", pszDir);
+	pPop->fd = mkstemp(szFile);
+	if (pPop->fd < 0)
+		Die("Cannot create a population file in '%s'", pszDir);
+	unlink(szFile);
+	if (posix_fallocate(pPop->fd, 0, cb) != 0)
+		Die("Cannot reserve %llu bytes for a population in '%s'", (unsigned long long)cb, pszDir);
+	void* pv = mmap(NULL, cb, PROT_READ | PROT_WRITE, MAP_SHARED, pPop->fd, 0);
+	if (pv == MAP_FAILED)
+		Die("Cannot map a population of %d strategies", cStrategies);
+	pPop->cstg   = cStrategies;
+	pPop->maxstg = cStrategies;
+	pPop->rgstg  = (STRATEGY*) pv;
 	return pPop;
 }
 
@@ -46,16 +98,61 @@ POPULATION* PopulationCreate(int cStrategies) {
 /* Destroys a POPULATION previously allocated by Population_Create. */
 void PopulationDestroy(POPULATION* pPop) {
 	ASSERT(pPop);
-	free(pPop->rgstg);
+	if (pPop->fd >= 0) {
+		munmap(pPop->rgstg, sizeof(STRATEGY) * (size_t)pPop->maxstg);
+		close(pPop->fd);
+	} else {
+		StrategyFreeArray(pPop->rgstg);
+	}
 	free(pPop);
 }
 
 
-void PopulationRandomize(POPULATION* pPop) {
+/*
+ * Called by passes that visit a population in index order as they reach
+ * strategies [istgFirst, istgFirst + cstg). Whenever that range starts a
+ * prefetch window of a mapped population, asks the kernel to read that
+ * window and the next in, so the disk works ahead of the pass. Does nothing
+ * for populations on the heap.
+ */
+void PopulationPrefetch(const POPULATION* pPop, int istgFirst, int cstg) {
+	ASSERT(pPop);
+	if (pPop->fd < 0)
+		return;
+	int cstgWindow = POPULATION_PREFETCH_BYTES / sizeof(STRATEGY);
+	if (cstgWindow < 1)
+		cstgWindow = 1;
+	int istgWindow = (istgFirst + cstgWindow - 1) / cstgWindow * cstgWindow;
+	if (istgWindow >= istgFirst + cstg || istgWindow >= pPop->maxstg)
+		return;
+
+	/* madvise needs a page-aligned start */
+	size_t cbPage = (size_t)sysconf(_SC_PAGESIZE);
+	size_t ibFirst = sizeof(STRATEGY) * (size_t)istgWindow / cbPage * cbPage;
+	size_t ibEnd = sizeof(STRATEGY) * (size_t)pPop->maxstg;
+	if (ibEnd - ibFirst > 2 * (size_t)POPULATION_PREFETCH_BYTES + cbPage)
+		ibEnd = ibFirst + 2 * (size_t)POPULATION_PREFETCH_BYTES + cbPage;
+	madvise((char*) pPop->rgstg + ibFirst, ibEnd - ibFirst, MADV_WILLNEED);
+}
+
+
+/* Starts writing a mapped population's changed pages back to its file
+ * without waiting for them, so that once a generation is done the kernel
+ * can drop its pages without stalling the next pass. Does nothing for
+ * populations on the heap. */
+void PopulationWriteBack(const POPULATION* pPop) {
 	ASSERT(pPop);
+	if (pPop->fd < 0)
+		return;
+	sync_file_range(pPop->fd, 0, sizeof(STRATEGY) * (size_t)pPop->maxstg, SYNC_FILE_RANGE_WRITE);
+}
+
+
+void PopulationRandomize(POPULATION* pPop, RNG* prng) {
+	ASSERT(pPop && prng);
 	int i;
 	for (i = 0; i < pPop->cstg; ++i) {
-		StrategyRandomize(&pPop->rgstg[i]);
+		StrategyRandomize(&pPop->rgstg[i], prng);
 	}
 }
 
@@ -92,19 +189,284 @@ bool PopulationAddStrategy(POPULATION* pPop, const STRATEGY* pstgAdd) {
 }
 
 
-/* Callback comparison function for qsort */
-int CompareStrategies(const void* pv1, const void* pv2) {
-	STRATEGY* pstg1 = (STRATEGY*) pv1;
-	STRATEGY* pstg2 = (STRATEGY*) pv2;
+/* A strategy's place in the sort: its fitness and where it started */
+typedef struct {
+	double rFitness;
+	int    istg;
+} SORTKEY; /* key */
 
-	return (int) (pstg2->rFitness - pstg1->rFitness);
+
+/* Callback comparison function for qsort. Fitnesses within one of each other
+ * compare equal, and then keep their order. */
+static int CompareSortKeys(const void* pv1, const void* pv2) {
+	const SORTKEY* pkey1 = (const SORTKEY*) pv1;
+	const SORTKEY* pkey2 = (const SORTKEY*) pv2;
+	int n = (int) (pkey2->rFitness - pkey1->rFitness);
+	return n ? n : pkey1->istg - pkey2->istg;
 }
 
 
-/* Sort strategies in a population by fitness */
+/* Returns pPop's sort keys, sorted. The keys are gathered in one pass in
+ * index order. */
+static SORTKEY* PopulationSortKeys(const POPULATION* pPop) {
+	const int cstg = pPop->cstg;
+	SORTKEY* rgkey = (SORTKEY*) malloc(sizeof(SORTKEY) * cstg);
+	VerifyAlloc(rgkey, "sort keys (%d strategies)", cstg);
+	int istg;
+	for (istg = 0; istg < cstg; ++istg) {
+		PopulationPrefetch(pPop, istg, 1);
+		rgkey[istg].rFitness = pPop->rgstg[istg].rFitness;
+		rgkey[istg].istg = istg;
+	}
+	qsort(rgkey, cstg, sizeof(rgkey[0]), CompareSortKeys);
+	return rgkey;
+}
+
+
+/* Sort strategies in a population by fitness. The sort is stable, and only
+ * small keys are sorted; strategies are then moved once each, following
+ * the permutation's cycles. */
 void PopulationSortByFitness(POPULATION* pPop) {
 	ASSERT(pPop);
 	ASSERT(pPop->cstg > 0);
-	qsort(pPop->rgstg, pPop->cstg, sizeof(pPop->rgstg[0]), CompareStrategies);
+	const int cstg = pPop->cstg;
+	SORTKEY* rgkey = PopulationSortKeys(pPop);
+	int istg, istgNext, istgStart;
+
+	/* Position istg takes the strategy from rgkey[istg].istg; a key's istg
+	 * is set to -1 once its position is filled */
+	STRATEGY* pstgTemp = StrategyAllocArray(1);
+	for (istgStart = 0; istgStart < cstg; ++istgStart) {
+		if (rgkey[istgStart].istg < 0 || rgkey[istgStart].istg == istgStart)
+			continue;
+		StrategyCopy(&pPop->rgstg[istgStart], pstgTemp);
+		istg = istgStart;
+		while ((istgNext = rgkey[istg].istg) != istgStart) {
+			StrategyCopy(&pPop->rgstg[istgNext], &pPop->rgstg[istg]);
+			rgkey[istg].istg = -1;
+			istg = istgNext;
+		}
+		StrategyCopy(pstgTemp, &pPop->rgstg[istg]);
+		rgkey[istg].istg = -1;
+	}
+	StrategyFreeArray(pstgTemp);
+	free(rgkey);
 }
 
+
+/* Copies pPop's strategies into pPopSorted in the order PopulationSortByFitness
+ * would leave them, without moving pPop's. Each pass reads pPop in index
+ * order and fills one band of ranks of pPopSorted, so a mapped population
+ * larger than RAM is sorted with sequential reads and writes that stay in
+ * memory until written back. If rgistgFrom is not NULL, it receives for each
+ * rank the strategy's index in pPop. */
+void PopulationSortByFitnessInto(const POPULATION* pPop, POPULATION* pPopSorted, int* rgistgFrom) {
+	ASSERT(pPop && pPopSorted && pPop != pPopSorted);
+	ASSERT(pPop->cstg > 0 && pPop->cstg <= pPopSorted->maxstg);
+	const int cstg = pPop->cstg;
+	SORTKEY* rgkey = PopulationSortKeys(pPop);
+	int* rgiRank = (int*) malloc(sizeof(int) * cstg);
+	VerifyAlloc(rgiRank, "sort ranks (%d strategies)", cstg);
+	int istg, iRankFirst;
+	for (istg = 0; istg < cstg; ++istg) {
+		rgiRank[rgkey[istg].istg] = istg;
+		if (rgistgFrom)
+			rgistgFrom[istg] = rgkey[istg].istg;
+	}
+	free(rgkey);
+
+	int cRanksBand = cstg;
+	if (pPop->fd >= 0 || pPopSorted->fd >= 0) {
+		cRanksBand = POPULATION_SORT_BAND_BYTES / sizeof(STRATEGY);
+		if (cRanksBand < 1)
+			cRanksBand = 1;
+	}
+	pPopSorted->cstg = cstg;
+	for (iRankFirst = 0; iRankFirst < cstg; iRankFirst += cRanksBand) {
+		for (istg = 0; istg < cstg; ++istg) {
+			PopulationPrefetch(pPop, istg, 1);
+			if (rgiRank[istg] >= iRankFirst && rgiRank[istg] - iRankFirst < cRanksBand)
+				StrategyCopy(&pPop->rgstg[istg], &pPopSorted->rgstg[rgiRank[istg]]);
+		}
+	}
+	free(rgiRank);
+}
+
+
+#ifdef PACKED_GENOME
+/* Lowest bit of every gene in a word */
+#define GENE_LOW_BITS	0x1249249249249249ULL
+
+/* Returns the number of genes in which two packed genomes differ, a word
+ * (21 genes) at a time: a gene differs if any of its three XORed bits is
+ * set. Bits past the last gene are always clear. */
+static int GenomeDistance(const STRATEGY* pstg1, const STRATEGY* pstg2) {
+	int cDiffer = 0;
+	int iWord;
+	for (iWord = 0; iWord < GENOME_WORDS; ++iWord) {
+		uint64_t n = pstg1->rgnGenes[iWord] ^ pstg2->rgnGenes[iWord];
+		cDiffer += __builtin_popcountll((n | n >> 1 | n >> 2) & GENE_LOW_BITS);
+	}
+	return cDiffer;
+}
+#else
+/* Returns the number of genes in which two genomes differ. Compares 16 genes
+ * at a time where SSE2 is available. */
+static int GenomeDistance(const STRATEGY* pstg1, const STRATEGY* pstg2) {
+	const uint8_t* rgact1 = pstg1->rgact;
+	const uint8_t* rgact2 = pstg2->rgact;
+	int cSame = 0;
+	int iact = 0;
+#ifdef __SSE2__
+	for (; iact + 16 <= STRATEGY_LENGTH; iact += 16) {
+		__m128i v1 = _mm_loadu_si128((const __m128i*)&rgact1[iact]);
+		__m128i v2 = _mm_loadu_si128((const __m128i*)&rgact2[iact]);
+		cSame += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v1, v2)));
+	}
+#endif
+	for (; iact < STRATEGY_LENGTH; ++iact)
+		cSame += rgact1[iact] == rgact2[iact];
+	return STRATEGY_LENGTH - cSame;
+}
+#endif
+
+
+/* Counts, for every gene, how many strategies have each action there:
+ * rgcGenes[act * STRATEGY_LENGTH + iact]. With SSE2, each action is compared
+ * against 16 genes at once into 8-bit counters, which are flushed into the
+ * totals before they can overflow. Packed genomes are counted a gene at a
+ * time. */
+static void CountGenes(const POPULATION* pPop, uint32_t* rgcGenes) {
+	int istg, iact;
+	memset(rgcGenes, 0, sizeof(uint32_t) * NUM_ACTIONS * STRATEGY_LENGTH);
+	istg = 0;
+#if defined(__SSE2__) && !defined(PACKED_GENOME)
+	int act;
+	const int cChunks = STRATEGY_LENGTH / 16;
+	const size_t cbCount = sizeof(__m128i) * NUM_ACTIONS * cChunks;
+	__m128i (*rgvCount)[cChunks] = malloc(cbCount); /* [NUM_ACTIONS][cChunks] */
+	VerifyAlloc(rgvCount, "gene counters");
+	__m128i rgvAction[NUM_ACTIONS];
+	for (act = 0; act < NUM_ACTIONS; ++act)
+		rgvAction[act] = _mm_set1_epi8((char)act);
+	while (istg < pPop->cstg) {
+		int istgEnd = istg + 255 < pPop->cstg ? istg + 255 : pPop->cstg;
+		memset(rgvCount, 0, cbCount);
+		for (; istg < istgEnd; ++istg) {
+			const uint8_t* rgact = pPop->rgstg[istg].rgact;
+			int iChunk;
+			for (iChunk = 0; iChunk < cChunks; ++iChunk) {
+				__m128i v = _mm_loadu_si128((const __m128i*)&rgact[iChunk * 16]);
+				/* A match is 0xff, so subtracting it counts one */
+				for (act = 0; act < NUM_ACTIONS; ++act)
+					rgvCount[act][iChunk] = _mm_sub_epi8(rgvCount[act][iChunk],
+						_mm_cmpeq_epi8(v, rgvAction[act]));
+			}
+			for (iact = cChunks * 16; iact < STRATEGY_LENGTH; ++iact)
+				rgcGenes[rgact[iact] * STRATEGY_LENGTH + iact]++;
+		}
+		for (act = 0; act < NUM_ACTIONS; ++act) {
+			const uint8_t* rgc = (const uint8_t*) rgvCount[act];
+			for (iact = 0; iact < cChunks * 16; ++iact)
+				rgcGenes[act * STRATEGY_LENGTH + iact] += rgc[iact];
+		}
+	}
+	free(rgvCount);
+#endif
+	for (; istg < pPop->cstg; ++istg) {
+		for (iact = 0; iact < STRATEGY_LENGTH; ++iact)
+			rgcGenes[StrategyGetAction(&pPop->rgstg[istg], iact) * STRATEGY_LENGTH + iact]++;
+	}
+}
+
+
+#ifdef PACKED_GENOME
+/* Hashes a packed genome, a word at a time */
+static uint64_t GenomeHash(const STRATEGY* pstg) {
+	uint64_t nHash = 0;
+	int iWord;
+	for (iWord = 0; iWord < GENOME_WORDS; ++iWord)
+		nHash = RngHash(nHash ^ pstg->rgnGenes[iWord]);
+	return nHash;
+}
+#else
+/* Hashes a genome, 8 genes at a time */
+static uint64_t GenomeHash(const STRATEGY* pstg) {
+	const uint8_t* rgact = pstg->rgact;
+	uint64_t nHash = 0, n;
+	int iact;
+	for (iact = 0; iact + 8 <= STRATEGY_LENGTH; iact += 8) {
+		memcpy(&n, &rgact[iact], 8);
+		nHash = RngHash(nHash ^ n);
+	}
+	n = 0;
+	memcpy(&n, &rgact[iact], STRATEGY_LENGTH - iact);
+	return RngHash(nHash ^ n);
+}
+#endif
+
+
+/* Callback comparison function for qsort */
+static int CompareHashes(const void* pv1, const void* pv2) {
+	uint64_t n1 = *(const uint64_t*) pv1;
+	uint64_t n2 = *(const uint64_t*) pv2;
+	return n1 < n2 ? -1 : n1 > n2;
+}
+
+
+/* Measures the diversity of a population's genomes. Big populations have
+ * their pairwise distance estimated from pairs drawn from prng, and their
+ * distinct genomes counted by 64-bit hash (a collision is vanishingly
+ * unlikely). */
+void PopulationDiversity(const POPULATION* pPop, RNG* prng, DIVERSITY* pdiv) {
+	ASSERT(pPop && prng && pdiv);
+	ASSERT(pPop->cstg > 0);
+	const int cstg = pPop->cstg;
+	int64_t cPairsAll = (int64_t)cstg * (cstg - 1) / 2;
+	int64_t nDistanceSum = 0;
+	int i, j, iact, act;
+
+	pdiv->cPairs = 0;
+	if (cPairsAll <= POPULATION_DIVERSITY_PAIRS) {
+		for (i = 0; i < cstg; ++i) {
+			for (j = i + 1; j < cstg; ++j)
+				nDistanceSum += GenomeDistance(&pPop->rgstg[i], &pPop->rgstg[j]);
+		}
+		pdiv->cPairs = (int)cPairsAll;
+	} else {
+		for (; pdiv->cPairs < POPULATION_DIVERSITY_PAIRS; ++pdiv->cPairs) {
+			i = RngInt(prng, cstg);
+			j = RngInt(prng, cstg - 1);
+			if (j >= i)
+				++j;
+			nDistanceSum += GenomeDistance(&pPop->rgstg[i], &pPop->rgstg[j]);
+		}
+	}
+	pdiv->rMeanDistance = pdiv->cPairs ? (double)nDistanceSum / pdiv->cPairs : 0.0;
+
+	uint32_t* rgcGenes = (uint32_t*) malloc(sizeof(uint32_t) * NUM_ACTIONS * STRATEGY_LENGTH);
+	VerifyAlloc(rgcGenes, "gene counts");
+	CountGenes(pPop, rgcGenes);
+	double rEntropySum = 0.0;
+	for (iact = 0; iact < STRATEGY_LENGTH; ++iact) {
+		for (act = 0; act < NUM_ACTIONS; ++act) {
+			uint32_t c = rgcGenes[act * STRATEGY_LENGTH + iact];
+			if (c > 0) {
+				double rP = (double)c / cstg;
+				rEntropySum -= rP * log2(rP);
+			}
+		}
+	}
+	pdiv->rMeanEntropy = rEntropySum / STRATEGY_LENGTH;
+	free(rgcGenes);
+
+	uint64_t* rgnHash = (uint64_t*) malloc(sizeof(uint64_t) * cstg);
+	VerifyAlloc(rgnHash, "genome hashes (%d)", cstg);
+	for (i = 0; i < cstg; ++i)
+		rgnHash[i] = GenomeHash(&pPop->rgstg[i]);
+	qsort(rgnHash, cstg, sizeof(rgnHash[0]), CompareHashes);
+	pdiv->cUnique = 1;
+	for (i = 1; i < cstg; ++i)
+		pdiv->cUnique += rgnHash[i] != rgnHash[i - 1];
+	free(rgnHash);
+}
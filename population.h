@@ -26,13 +26,27 @@ typedef struct {
 	int       cstg;   /* How many strategies are currently used [0,cstg) */
 	int       maxstg; /* Maximum rgstg array length */
 	STRATEGY* rgstg;  /* Array of strategies (chromosomes) */
+	int       fd;     /* File rgstg is mapped from (--population-dir), or -1 */
 } POPULATION; /* Pop */
 
+/* How varied a population's genomes are */
+typedef struct {
+	double rMeanDistance; /* Mean pairwise Hamming distance, in genes */
+	int    cPairs;        /* Pairs the distance is averaged over */
+	double rMeanEntropy;  /* Mean per-gene Shannon entropy, in bits */
+	int    cUnique;       /* Distinct genomes */
+} DIVERSITY; /* div */
+
 /* Function prototypes */
 POPULATION* PopulationCreate(int cStrategies);
-void        PopulationRandomize(POPULATION* pPop);
+POPULATION* PopulationCreateMapped(int cStrategies, PCSZ pszDir);
+void        PopulationPrefetch(const POPULATION* pPop, int istgFirst, int cstg);
+void        PopulationWriteBack(const POPULATION* pPop);
+void        PopulationRandomize(POPULATION* pPop, RNG* prng);
 void        PopulationDestroy(POPULATION* pPop);
 void        PopulationEmpty(POPULATION* pPop);
 bool        PopulationIsFull(POPULATION* pPop);
 bool        PopulationAddStrategy(POPULATION* pPop, const STRATEGY* pstgAdd);
 void        PopulationSortByFitness(POPULATION* pPop);
+void        PopulationSortByFitnessInto(const POPULATION* pPop, POPULATION* pPopSorted, int* rgistgFrom);
+void        PopulationDiversity(const POPULATION* pPop, RNG* prng, DIVERSITY* pdiv);
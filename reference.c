@@ -0,0 +1,324 @@
+/*****************************************************************************
+ * reference.c: Frozen reference engine that faster engines are checked
+ * against.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <math.h>
+#include "types.h"
+#include "error.h"
+#include "args.h"
+#include "rng.h"
+#include "strategy.h"
+#include "population.h"
+#include "world.h"
+#include "reference.h"
+
+
+/* Frozen copies of robby.c's scores and evolve.c's fitness stream family */
+#define REF_HIT_WALL_PUNISHMENT     -5
+#define REF_PICK_UP_CAN_REWARD      10
+#define REF_PICK_UP_CAN_PUNISHMENT  -1
+#define REF_FITNESS_STREAM          0x4669746e657373ULL
+
+
+/* Sets cans in the open cells of a fresh world copy: each open cell, in
+ * order, holds a can with probability rProbability (to 32 bits). Consumes
+ * random numbers exactly as WorldSetCansRandomly did: one 64-cell mask per
+ * bit of the probability, drawn from the top bit down until every cell is
+ * settled below WORLD_SPARSE_CAN_PROBABILITY, otherwise from the lowest set
+ * bit up. */
+void RefSetCansRandomly(WORLD* pwld, double rProbability, RNG* prng) {
+	ASSERT(pwld && prng);
+	double rThreshold = floor(rProbability * 4294967296.0 + 0.5);
+	uint iOpen;
+
+	if (rThreshold >= 4294967296.0) {
+		for (iOpen = 0; iOpen < pwld->ccellOpen; ++iOpen)
+			pwld->cells[pwld->rgicellOpen[iOpen]] = CELL_CAN;
+	} else if (rThreshold <= 0.0) {
+		return;
+	} else if (rProbability < WORLD_SPARSE_CAN_PROBABILITY) {
+		uint32_t nThreshold = (uint32_t)rThreshold;
+		int ibit, ibitLow = 0;
+		while (!(nThreshold & (1u << ibitLow)))
+			++ibitLow;
+		for (iOpen = 0; iOpen < pwld->ccellOpen; iOpen += 64) {
+			uint64_t nUndecided = 0, nMask = 0;
+			for (ibit = 0; ibit < 64 && iOpen + ibit < pwld->ccellOpen; ++ibit)
+				nUndecided |= 1ULL << ibit;
+			for (ibit = 31; ibit >= ibitLow && nUndecided != 0; --ibit) {
+				uint64_t nRandom = RngNext(prng);
+				if (nThreshold & (1u << ibit)) {
+					nMask |= nUndecided & ~nRandom;
+					nUndecided &= nRandom;
+				} else {
+					nUndecided &= ~nRandom;
+				}
+			}
+			for (ibit = 0; ibit < 64 && iOpen + ibit < pwld->ccellOpen; ++ibit) {
+				if (nMask & (1ULL << ibit))
+					pwld->cells[pwld->rgicellOpen[iOpen + ibit]] = CELL_CAN;
+			}
+		}
+	} else {
+		uint32_t nThreshold = (uint32_t)rThreshold;
+		int ibit, ibitLow = 0;
+		while (!(nThreshold & (1u << ibitLow)))
+			++ibitLow;
+		for (iOpen = 0; iOpen < pwld->ccellOpen; iOpen += 64) {
+			uint64_t nMask = 0;
+			for (ibit = ibitLow; ibit < 32; ++ibit) {
+				if (nThreshold & (1u << ibit))
+					nMask |= RngNext(prng);
+				else
+					nMask &= RngNext(prng);
+			}
+			for (ibit = 0; ibit < 64 && iOpen + ibit < pwld->ccellOpen; ++ibit) {
+				if (nMask & (1ULL << ibit))
+					pwld->cells[pwld->rgicellOpen[iOpen + ibit]] = CELL_CAN;
+			}
+		}
+	}
+}
+
+
+/* Reads Robby's state straight from the cells */
+static STATE RefGetState(WORLD* pwld) {
+#ifdef NEIGHBORHOOD_VON_NEUMANN
+	int x = pwld->xRobby, y = pwld->yRobby;
+	STATE s;
+	s.current = WorldGetCell(pwld, x, y);
+	s.north   = WorldGetCell(pwld, x, y - 1);
+	s.south   = WorldGetCell(pwld, x, y + 1);
+	s.west    = WorldGetCell(pwld, x - 1, y);
+	s.east    = WorldGetCell(pwld, x + 1, y);
+	s.index   = s.east * 81 + s.west * 27 + s.south * 9 + s.north * 3 + s.current;
+	return s;
+#else
+	/* The larger neighborhoods' cell order lives in world.c */
+	if (pwld->bLazyCans)
+		return WorldGetStateLazy(pwld, pwld->xRobby, pwld->yRobby);
+	return WorldGetState(pwld, pwld->xRobby, pwld->yRobby);
+#endif
+}
+
+
+/* Performs one of Robby's actions; returns its score */
+static int RefAct(WORLD* pwld, STATE s, ACTION act, RNG* prng) {
+	switch (act) {
+	case MoveNorth:
+		if (s.north == CELL_WALL)
+			return REF_HIT_WALL_PUNISHMENT;
+		pwld->yRobby--;
+		return 0;
+	case MoveSouth:
+		if (s.south == CELL_WALL)
+			return REF_HIT_WALL_PUNISHMENT;
+		pwld->yRobby++;
+		return 0;
+	case MoveEast:
+		if (s.east == CELL_WALL)
+			return REF_HIT_WALL_PUNISHMENT;
+		pwld->xRobby++;
+		return 0;
+	case MoveWest:
+		if (s.west == CELL_WALL)
+			return REF_HIT_WALL_PUNISHMENT;
+		pwld->xRobby--;
+		return 0;
+	case MoveRandom:
+		return RefAct(pwld, s, (ACTION) RngInt(prng, 4), prng);
+	case StayPut:
+		return 0;
+	case PickUpCan:
+		if (s.current != CELL_CAN)
+			return REF_PICK_UP_CAN_PUNISHMENT;
+		WorldSetCell(pwld, pwld->xRobby, pwld->yRobby, CELL_OPEN);
+		return REF_PICK_UP_CAN_REWARD;
+	}
+	Die("Bad action %d", act);
+	return 0;
+}
+
+
+/* Performs one of SmartRobby's moves, turning clockwise from walls; returns
+ * its score (always 0) */
+static int RefSmartMove(WORLD* pwld, STATE s, ACTION act, RNG* prng) {
+	switch (act) {
+	case MoveNorth:
+		if (s.north == CELL_WALL)
+			return RefSmartMove(pwld, s, MoveEast, prng);
+		pwld->yRobby--;
+		return 0;
+	case MoveSouth:
+		if (s.south == CELL_WALL)
+			return RefSmartMove(pwld, s, MoveWest, prng);
+		pwld->yRobby++;
+		return 0;
+	case MoveEast:
+		if (s.east == CELL_WALL)
+			return RefSmartMove(pwld, s, MoveSouth, prng);
+		pwld->xRobby++;
+		return 0;
+	case MoveWest:
+		if (s.west == CELL_WALL)
+			return RefSmartMove(pwld, s, MoveNorth, prng);
+		pwld->xRobby--;
+		return 0;
+	default:
+		ASSERT(act == MoveRandom);
+		return RefSmartMove(pwld, s, (ACTION) RngInt(prng, 4), prng);
+	}
+}
+
+
+/* Runs one cleaning session, every action simulated in turn; returns the
+ * score */
+int RefRobbyClean(const ARGS* pArgs, WORLD* pwld, const STRATEGY* pstg, int cActions, RNG* prng) {
+	ASSERT(pArgs && pwld && pstg && prng);
+	int i, nScore = 0;
+	for (i = 0; i < cActions; ++i) {
+		STATE s = RefGetState(pwld);
+		ACTION act = StrategyGetAction(pstg, s.index);
+		if (pArgs->robbyType == SmartRobby) {
+			if (s.current == CELL_CAN)
+				nScore += RefAct(pwld, s, PickUpCan, prng);
+			else
+				nScore += RefSmartMove(pwld, s, (ACTION)(act % 5), prng);
+		} else
+			nScore += RefAct(pwld, s, act, prng);
+	}
+	return nScore;
+}
+
+
+/* Scores every strategy of a population, one after another, on the same
+ * layouts and moves CalculateFitness uses */
+void RefCalculateFitness(const ARGS* pArgs, POPULATION* pPop, const WORLD* pWorld, WORLD* pwldScratch, int iGeneration) {
+	ASSERT(pArgs && pPop && pWorld && pwldScratch);
+	int istg, iSession;
+	for (istg = 0; istg < pPop->cstg; ++istg) {
+		RNG rng;
+		RngSeedStream(&rng, pArgs->nSeed ^ REF_FITNESS_STREAM, ((uint64_t)iGeneration << 32) | (uint64_t)istg);
+		int nScoreSum = 0;
+		for (iSession = 0; iSession < pArgs->cSessions; ++iSession) {
+			WorldCopy(pWorld, pwldScratch);
+			RefSetCansRandomly(pwldScratch, pArgs->rCanProbability, &rng);
+			nScoreSum += RefRobbyClean(pArgs, pwldScratch, &pPop->rgstg[istg], pArgs->cSessionActions, &rng);
+		}
+		pPop->rgstg[istg].rFitness = (double)nScoreSum / (double)pArgs->cSessions;
+	}
+}
+
+
+/* Picks a parent of a sorted population by rank */
+static int RefSelectParent(const POPULATION* pPop, RNG* prng) {
+	const int cstg = pPop->cstg;
+	int istg = RngInt(prng, cstg);
+	int cTries;
+	double rSum = (double)cstg * (cstg + 1) / 2;
+	for (cTries = 0; cTries < cstg; ++cTries) {
+		if (RngZeroOne(prng) < (double)(cstg - istg + 1) / rSum)
+			return istg;
+		istg = (istg + 1) % cstg;
+	}
+	return RngInt(prng, cstg);
+}
+
+
+/* Replaces genes of a strategy at random, drawing as MutateStrategy did */
+static void RefMutate(double rMutationProbability, STRATEGY* pstg, RNG* prng) {
+	int iact;
+	if (STRATEGY_LENGTH <= 4096) {
+		for (iact = 0; iact < STRATEGY_LENGTH; ++iact) {
+			if (RngZeroOne(prng) < rMutationProbability)
+				StrategySetAction(pstg, iact, (ACTION) RngInt(prng, NUM_ACTIONS));
+		}
+	} else if (rMutationProbability >= 1.0) {
+		for (iact = 0; iact < STRATEGY_LENGTH; ++iact)
+			StrategySetAction(pstg, iact, (ACTION) RngInt(prng, NUM_ACTIONS));
+	} else if (rMutationProbability > 0.0) {
+		const double rLogMiss = log1p(-rMutationProbability);
+		double rNext = -1.0;
+		for (;;) {
+			rNext += 1.0 + floor(log(1.0 - RngZeroOne(prng)) / rLogMiss);
+			if (rNext >= (double)STRATEGY_LENGTH)
+				break;
+			StrategySetAction(pstg, (int)rNext, (ACTION) RngInt(prng, NUM_ACTIONS));
+		}
+	}
+}
+
+
+/* Sets a child's genes: the mother's before iactCrossover, the father's from
+ * there on */
+static void RefMate(const STRATEGY* pstgMother, const STRATEGY* pstgFather, STRATEGY* pstgChild, int iactCrossover) {
+	int iact;
+	for (iact = 0; iact < STRATEGY_LENGTH; ++iact)
+		StrategySetAction(pstgChild, iact, StrategyGetAction(iact < iactCrossover ? pstgMother : pstgFather, iact));
+}
+
+
+/* Breeds a new population from a sorted one, pair by pair, drawing pair i's
+ * random numbers from stream i as EvolveNewPopulation does */
+void RefEvolveNewPopulation(const ARGS* pArgs, const POPULATION* pPopOld, POPULATION* pPopNew, RNG* prng) {
+	ASSERT(pArgs && pPopOld && pPopNew && prng);
+	const uint64_t nSeed = RngNext(prng);
+	const int cstg = pPopOld->cstg;
+	int iPair;
+
+	pPopNew->cstg = cstg;
+	for (iPair = 0; 2 * iPair < cstg; ++iPair) {
+		RNG rng;
+		RngSeedStream(&rng, nSeed, iPair);
+		int istgMother = RefSelectParent(pPopOld, &rng);
+		int istgFather = RefSelectParent(pPopOld, &rng);
+		const STRATEGY* pstgMother = &pPopOld->rgstg[istgMother];
+		const STRATEGY* pstgFather = &pPopOld->rgstg[istgFather];
+		STRATEGY* pstgSon = &pPopNew->rgstg[2 * iPair];
+		STRATEGY* pstgDaughter = 2 * iPair + 1 < cstg ? &pPopNew->rgstg[2 * iPair + 1] : NULL;
+
+		if (pArgs->bUseCrossover) {
+			int iactCrossover = RngInt(&rng, STRATEGY_LENGTH);
+			bool bMotherMost = 2 * iactCrossover >= STRATEGY_LENGTH;
+			RefMate(pstgMother, pstgFather, pstgSon, iactCrossover);
+			pstgSon->istgParent = bMotherMost ? istgMother : istgFather;
+			if (pstgDaughter) {
+				RefMate(pstgFather, pstgMother, pstgDaughter, iactCrossover);
+				pstgDaughter->istgParent = bMotherMost ? istgFather : istgMother;
+			}
+		} else {
+			RefMate(pstgFather, pstgFather, pstgSon, 0);
+			pstgSon->istgParent = istgFather;
+			if (pstgDaughter) {
+				RefMate(pstgMother, pstgMother, pstgDaughter, 0);
+				pstgDaughter->istgParent = istgMother;
+			}
+		}
+		RefMutate(pArgs->rMutationProbability, pstgSon, &rng);
+		if (pstgDaughter)
+			RefMutate(pArgs->rMutationProbability, pstgDaughter, &rng);
+	}
+}
@@ -0,0 +1,41 @@
+/*****************************************************************************
+ * reference.h: Header for reference.c.
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#pragma once
+#include "types.h"
+#include "args.h"
+#include "rng.h"
+#include "strategy.h"
+#include "population.h"
+#include "world.h"
+
+/*
+ * Reference engine: plain, serial copies of the simulation and breeding code
+ * as they stood when the equivalence harness (verify.c) was written. They are
+ * deliberately left unoptimized and must not change; faster engines are
+ * checked against them, session by session and generation by generation.
+ */
+
+/* Function prototypes */
+void RefSetCansRandomly(WORLD* pwld, double rProbability, RNG* prng);
+int  RefRobbyClean(const ARGS* pArgs, WORLD* pwld, const STRATEGY* pstg, int cActions, RNG* prng);
+void RefCalculateFitness(const ARGS* pArgs, POPULATION* pPop, const WORLD* pWorld, WORLD* pwldScratch, int iGeneration);
+void RefEvolveNewPopulation(const ARGS* pArgs, const POPULATION* pPopOld, POPULATION* pPopNew, RNG* prng);
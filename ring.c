@@ -0,0 +1,183 @@
+/*****************************************************************************
+ * ring.c: Layout ring: producer threads place cans in session worlds ahead of
+ * the threads that run the sessions.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "error.h"
+#include "args.h"
+#include "rng.h"
+#include "instrument.h"
+#include "world.h"
+#include "ring.h"
+
+
+/* Producer thread: claims sessions in order and fills each one's slot as
+ * soon as the session before it in that slot has been run */
+static void* RingProducer(void* pv) {
+	RING* pring = (RING*) pv;
+	for (;;) {
+		uint64_t iSession = __atomic_fetch_add(&pring->iProduceNext, 1, __ATOMIC_RELAXED);
+		if (iSession >= pring->cSessions)
+			break;
+		RINGSLOT* pslot = &pring->rgslot[iSession % pring->cSlots];
+		while (__atomic_load_n(&pslot->nSequence, __ATOMIC_ACQUIRE) != iSession)
+			sched_yield();
+		RngSeedStream(&pslot->rng, pring->nSeed, pring->nStreamFirst + iSession);
+		WorldCopy(pring->pWorld, pslot->pwld);
+		WorldSetCansRandomly(pslot->pwld, pring->pArgs->rCanProbability, &pslot->rng);
+		__atomic_store_n(&pslot->nSequence, iSession + 1, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+
+/* Allocates a ring of session worlds copied from pWorld, sized for
+ * cConsumers evaluation threads, to be filled by cProducers threads. Both
+ * pArgs and pWorld must outlive the ring. */
+RING* RingCreate(const ARGS* pArgs, const WORLD* pWorld, int cProducers, int cConsumers) {
+	ASSERT(pArgs && pWorld);
+	ASSERT(cProducers > 0 && cConsumers > 0);
+	ASSERT(!pArgs->bLazyCans);
+	RING* pring = (RING*) malloc(sizeof(RING));
+	VerifyAlloc(pring, "layout ring");
+	pring->pArgs = pArgs;
+	pring->pWorld = pWorld;
+	/* Cells, visit stamps and the session trace */
+	size_t cbWorld = (size_t)pWorld->cx * pWorld->cy * (sizeof(CELL) + sizeof(uint)) +
+		(size_t)pArgs->cSessionActions * (sizeof(int) + sizeof(uint));
+	size_t cSlotsPerConsumer = RING_MAX_BYTES / cbWorld / cConsumers;
+	if (cSlotsPerConsumer > RING_MAX_SLOTS_PER_CONSUMER)
+		cSlotsPerConsumer = RING_MAX_SLOTS_PER_CONSUMER;
+	if (cSlotsPerConsumer < RING_MIN_SLOTS_PER_CONSUMER)
+		cSlotsPerConsumer = RING_MIN_SLOTS_PER_CONSUMER;
+	pring->cSlots = (int)cSlotsPerConsumer * cConsumers;
+	if (posix_memalign((void**)&pring->rgslot, 64, sizeof(RINGSLOT) * pring->cSlots) != 0)
+		pring->rgslot = NULL;
+	VerifyAlloc(pring->rgslot, "layout ring (%d slots)", pring->cSlots);
+	int islot;
+	for (islot = 0; islot < pring->cSlots; ++islot) {
+		pring->rgslot[islot].pwld = WorldCreate(pWorld->cx, pWorld->cy);
+		WorldEnableCycleDetection(pring->rgslot[islot].pwld, pArgs->cSessionActions);
+	}
+	pring->cProducers = cProducers;
+	pring->rgthread = (pthread_t*) malloc(sizeof(pthread_t) * cProducers);
+	VerifyAlloc(pring->rgthread, "layout producers");
+	pring->nSeed = pring->nStreamFirst = 0;
+	pring->cSessions = pring->iProduceNext = 0;
+	return pring;
+}
+
+
+/* Frees a ring allocated by RingCreate. It must not be running. */
+void RingDestroy(RING* pring) {
+	ASSERT(pring);
+	int islot;
+	for (islot = 0; islot < pring->cSlots; ++islot)
+		WorldDestroy(pring->rgslot[islot].pwld);
+	free(pring->rgslot);
+	free(pring->rgthread);
+	free(pring);
+}
+
+
+/* Starts the producers on sessions [0, cSessions), session j drawing its
+ * cans, and then its random moves, from stream nStreamFirst + j of nSeed.
+ * Every session must then be taken and released, in any order, before
+ * RingFinish. */
+void RingStart(RING* pring, uint64_t nSeed, uint64_t nStreamFirst, uint64_t cSessions) {
+	ASSERT(pring);
+	int islot, iProducer;
+	for (islot = 0; islot < pring->cSlots; ++islot)
+		pring->rgslot[islot].nSequence = islot;
+	pring->nSeed = nSeed;
+	pring->nStreamFirst = nStreamFirst;
+	pring->cSessions = cSessions;
+	pring->iProduceNext = 0;
+	for (iProducer = 0; iProducer < pring->cProducers; ++iProducer) {
+		if (pthread_create(&pring->rgthread[iProducer], NULL, RingProducer, pring) != 0)
+			Die("Cannot create layout producer %d", iProducer);
+	}
+}
+
+
+/* Waits until session iSession's world is ready and returns it, with the
+ * session's stream in *pprng. Both belong to the caller until RingRelease. */
+WORLD* RingTake(RING* pring, uint64_t iSession, RNG** pprng) {
+	ASSERT(pring && pprng);
+	ASSERT(iSession < pring->cSessions);
+	RINGSLOT* pslot = &pring->rgslot[iSession % pring->cSlots];
+	while (__atomic_load_n(&pslot->nSequence, __ATOMIC_ACQUIRE) != iSession + 1)
+		sched_yield();
+	*pprng = &pslot->rng;
+	return pslot->pwld;
+}
+
+
+/* Hands session iSession's slot on to the session cSlots after it */
+void RingRelease(RING* pring, uint64_t iSession) {
+	ASSERT(pring);
+	RINGSLOT* pslot = &pring->rgslot[iSession % pring->cSlots];
+	ASSERT(pslot->nSequence == iSession + 1);
+	__atomic_store_n(&pslot->nSequence, iSession + pring->cSlots, __ATOMIC_RELEASE);
+}
+
+
+/* Waits for the producers to finish; every session has been taken by now */
+void RingFinish(RING* pring) {
+	ASSERT(pring);
+	int iProducer;
+	for (iProducer = 0; iProducer < pring->cProducers; ++iProducer)
+		pthread_join(pring->rgthread[iProducer], NULL);
+}
+
+
+/* Adds the actions that sessions run in the ring's worlds have accounted
+ * for to *pcActionsRun and *pcActionsSkipped */
+void RingGetActionCounts(const RING* pring, uint64_t* pcActionsRun, uint64_t* pcActionsSkipped) {
+	ASSERT(pring && pcActionsRun && pcActionsSkipped);
+	int islot;
+	for (islot = 0; islot < pring->cSlots; ++islot) {
+		*pcActionsRun += pring->rgslot[islot].pwld->cActionsRun;
+		*pcActionsSkipped += pring->rgslot[islot].pwld->cActionsSkipped;
+	}
+}
+
+
+/* Adds the hit counts of the ring's worlds to *pcnt and clears them */
+void RingTakeCounters(RING* pring, COUNTERS* pcnt) {
+	ASSERT(pring && pcnt);
+#ifdef INSTRUMENT
+	int islot;
+	for (islot = 0; islot < pring->cSlots; ++islot) {
+		CountersAdd(pcnt, &pring->rgslot[islot].pwld->cnt);
+		memset(&pring->rgslot[islot].pwld->cnt, 0, sizeof(COUNTERS));
+	}
+#endif
+}
@@ -0,0 +1,80 @@
+/*****************************************************************************
+ * ring.h: Header for ring.c.
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#pragma once
+#include <pthread.h>
+#include "types.h"
+#include "args.h"
+#include "rng.h"
+#include "world.h"
+
+
+/* Slots per evaluation thread. Producers run far enough ahead that a thread
+ * handing over to another on the same core does so rarely, as long as the
+ * session worlds fit in the memory budget. */
+#define RING_MAX_SLOTS_PER_CONSUMER	256
+#define RING_MIN_SLOTS_PER_CONSUMER	2
+#define RING_MAX_BYTES			(32 << 20)
+
+
+/* One ready-to-run session world. nSequence says whose turn it is: session
+ * j's producer may fill the slot while it equals j, and session j's
+ * consumer may run it once it equals j + 1; the consumer then hands it on
+ * to session j + cSlots by storing that. */
+typedef struct {
+	uint64_t nSequence;
+	WORLD*   pwld;      /* Copy of the template with the session's cans */
+	RNG      rng;       /* The session's stream, after drawing the cans */
+} __attribute__((aligned(64))) RINGSLOT; /* slot */
+
+
+/*
+ * A bounded, lock-free ring of session worlds between dedicated producer
+ * threads, which copy the world template and place cans, and the evaluation
+ * threads that run the sessions. Session j always uses slot j % cSlots and
+ * its own stream, so results do not depend on which thread did what, or
+ * when.
+ */
+typedef struct {
+	const ARGS*  pArgs;
+	const WORLD* pWorld;        /* Template the session worlds are copied from */
+	int          cSlots;
+	RINGSLOT*    rgslot;
+	int          cProducers;
+	pthread_t*   rgthread;
+
+	/* The current run (see RingStart) */
+	uint64_t     nSeed;         /* Session j draws from stream */
+	uint64_t     nStreamFirst;  /* nStreamFirst + j of this seed */
+	uint64_t     cSessions;
+	uint64_t     iProduceNext;  /* Next session no producer has claimed */
+} RING; /* ring */
+
+
+/* Function prototypes */
+RING*  RingCreate(const ARGS* pArgs, const WORLD* pWorld, int cProducers, int cConsumers);
+void   RingDestroy(RING* pring);
+void   RingStart(RING* pring, uint64_t nSeed, uint64_t nStreamFirst, uint64_t cSessions);
+WORLD* RingTake(RING* pring, uint64_t iSession, RNG** pprng);
+void   RingRelease(RING* pring, uint64_t iSession);
+void   RingFinish(RING* pring);
+void   RingGetActionCounts(const RING* pring, uint64_t* pcActionsRun, uint64_t* pcActionsSkipped);
+void   RingTakeCounters(RING* pring, COUNTERS* pcnt);
@@ -0,0 +1,52 @@
+/*****************************************************************************
+ * rng.c: Reentrant pseudo-random number streams.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include "types.h"
+#include "error.h"
+#include "rng.h"
+
+
+/* Seeds a stream */
+void RngSeed(RNG* prng, uint64_t nSeed) {
+	ASSERT(prng);
+	prng->nState = RngHash(nSeed);
+}
+
+
+/* Seeds stream number iStream of a family of streams sharing one seed. Streams
+ * with different indices are statistically independent, so work can be
+ * assigned one stream per item and give the same result on any thread. */
+void RngSeedStream(RNG* prng, uint64_t nSeed, uint64_t iStream) {
+	ASSERT(prng);
+	prng->nState = RngHash(RngHash(nSeed) ^ RngHash(iStream + 0x632be59bd9b4e019ULL));
+}
+
+
+/* Grab random number in [0.0, 1.0) with 53 bits of precision */
+double RngZeroOne(RNG* prng) {
+	ASSERT(prng);
+	return (double)(RngNext(prng) >> 11) * (1.0 / 9007199254740992.0);
+}
@@ -0,0 +1,59 @@
+/*****************************************************************************
+ * rng.h: Header for rng.c.
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#pragma once
+#include "types.h"
+
+/*
+ * A small, reentrant pseudo-random number generator (SplitMix64). Unlike
+ * rand(), each RNG carries its own state, so every thread (or every session)
+ * can own an independent, reproducible stream.
+ */
+typedef struct {
+	uint64_t nState;
+} RNG; /* rng */
+
+
+/* Mixes a 64-bit value into a well-distributed 64-bit hash */
+static inline uint64_t RngHash(uint64_t n) {
+	n = (n ^ (n >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	n = (n ^ (n >> 27)) * 0x94d049bb133111ebULL;
+	return n ^ (n >> 31);
+}
+
+
+/* Returns the next 64 random bits from the stream */
+static inline uint64_t RngNext(RNG* prng) {
+	prng->nState += 0x9e3779b97f4a7c15ULL;
+	return RngHash(prng->nState);
+}
+
+
+/* Returns a random integer in [0, n) */
+static inline int RngInt(RNG* prng, int n) {
+	return (int)(((RngNext(prng) >> 32) * (uint64_t)n) >> 32);
+}
+
+
+/* Function prototypes */
+void   RngSeed(RNG* prng, uint64_t nSeed);
+void   RngSeedStream(RNG* prng, uint64_t nSeed, uint64_t iStream);
+double RngZeroOne(RNG* prng);
@@ -30,7 +30,8 @@
 #include <string.h>
 #include "types.h"
 #include "error.h"
-#include "main.h"
+#include "args.h"
+#include "rng.h"
 #include "strategy.h"
 #include "population.h"
 #include "world.h"
@@ -44,27 +45,27 @@
 
 
 /* Local functions */
-static int RobbyMoveNorth(WORLD* pwld, STATE s);
-static int RobbyMoveSouth(WORLD* pwld, STATE s);
-static int RobbyMoveEast(WORLD* pwld, STATE s);
-static int RobbyMoveWest(WORLD* pwld, STATE s);
-static int RobbyMoveRandom(WORLD* pwld, STATE s);
-static int RobbyStayPut(WORLD* pwld, STATE s);
-static int RobbyPickUpCan(WORLD* pwld, STATE s);
+static int RobbyMoveNorth(WORLD* pwld, STATE s, RNG* prng);
+static int RobbyMoveSouth(WORLD* pwld, STATE s, RNG* prng);
+static int RobbyMoveEast(WORLD* pwld, STATE s, RNG* prng);
+static int RobbyMoveWest(WORLD* pwld, STATE s, RNG* prng);
+static int RobbyMoveRandom(WORLD* pwld, STATE s, RNG* prng);
+static int RobbyStayPut(WORLD* pwld, STATE s, RNG* prng);
+static int RobbyPickUpCan(WORLD* pwld, STATE s, RNG* prng);
 
 #define NUM_SMART_ACTIONS	5
-static int SmartRobbyMoveNorth(WORLD* pwld, STATE s);
-static int SmartRobbyMoveSouth(WORLD* pwld, STATE s);
-static int SmartRobbyMoveEast(WORLD* pwld, STATE s);
-static int SmartRobbyMoveWest(WORLD* pwld, STATE s);
-static int SmartRobbyMoveRandom(WORLD* pwld, STATE s);
+static int SmartRobbyMoveNorth(WORLD* pwld, STATE s, RNG* prng);
+static int SmartRobbyMoveSouth(WORLD* pwld, STATE s, RNG* prng);
+static int SmartRobbyMoveEast(WORLD* pwld, STATE s, RNG* prng);
+static int SmartRobbyMoveWest(WORLD* pwld, STATE s, RNG* prng);
+static int SmartRobbyMoveRandom(WORLD* pwld, STATE s, RNG* prng);
 
 
 
 /*
  * Robby's action handlers; one function per action
  */
-static int (*k_rgpfnActions[NUM_ACTIONS])(WORLD*, STATE) = {
+static int (*k_rgpfnActions[NUM_ACTIONS])(WORLD*, STATE, RNG*) = {
 	RobbyMoveNorth,
 	RobbyMoveSouth,
 	RobbyMoveEast,
@@ -75,7 +76,7 @@ static int (*k_rgpfnActions[NUM_ACTIONS])(WORLD*, STATE) = {
 };
 
 
-static int (*k_rgpfnSmartActions[NUM_SMART_ACTIONS])(WORLD*, STATE) = {
+static int (*k_rgpfnSmartActions[NUM_SMART_ACTIONS])(WORLD*, STATE, RNG*) = {
 	SmartRobbyMoveNorth,
 	SmartRobbyMoveSouth,
 	SmartRobbyMoveEast,
@@ -87,61 +88,70 @@ static int (*k_rgpfnSmartActions[NUM_SMART_ACTIONS])(WORLD*, STATE) = {
 /* Robby action handlers: Each returns the score of the action performed. */
 
 /* Normal Robby action handlers follow. */
-static int RobbyMoveNorth(WORLD* pwld, STATE s) {
+static int RobbyMoveNorth(WORLD* pwld, STATE s, RNG* prng) {
 	ASSERT(pwld);
-	if (s.north == CELL_WALL)
+	if (s.north == CELL_WALL) {
+		INSTRUMENT_COUNT(pwld, cWallHits);
 		return ROBBY_HIT_WALL_PUNISHMENT;
+	}
 	pwld->yRobby--;
 	return 0;
 }
 
 
-static int RobbyMoveSouth(WORLD* pwld, STATE s) {
+static int RobbyMoveSouth(WORLD* pwld, STATE s, RNG* prng) {
 	ASSERT(pwld);
-	if (s.south == CELL_WALL)
+	if (s.south == CELL_WALL) {
+		INSTRUMENT_COUNT(pwld, cWallHits);
 		return ROBBY_HIT_WALL_PUNISHMENT;
+	}
 	pwld->yRobby++;
 	return 0;
 }
 
 
-static int RobbyMoveEast(WORLD* pwld, STATE s) {
+static int RobbyMoveEast(WORLD* pwld, STATE s, RNG* prng) {
 	ASSERT(pwld);
-	if (s.east == CELL_WALL)
+	if (s.east == CELL_WALL) {
+		INSTRUMENT_COUNT(pwld, cWallHits);
 		return ROBBY_HIT_WALL_PUNISHMENT;
+	}
 	pwld->xRobby++;
 	return 0;
 }
 
 
-static int RobbyMoveWest(WORLD* pwld, STATE s) {
+static int RobbyMoveWest(WORLD* pwld, STATE s, RNG* prng) {
 	ASSERT(pwld);
-	if (s.west == CELL_WALL)
+	if (s.west == CELL_WALL) {
+		INSTRUMENT_COUNT(pwld, cWallHits);
 		return ROBBY_HIT_WALL_PUNISHMENT;
+	}
 	pwld->xRobby--;
 	return 0;
 }
 
 
-static int RobbyMoveRandom(WORLD* pwld, STATE s) {
+static int RobbyMoveRandom(WORLD* pwld, STATE s, RNG* prng) {
 	ASSERT(pwld);
-	return (k_rgpfnActions[rand() % 4])(pwld, s);
+	return (k_rgpfnActions[RngInt(prng, 4)])(pwld, s, prng);
 }
 
 
-static int RobbyStayPut(WORLD* pwld, STATE s) {
+static int RobbyStayPut(WORLD* pwld, STATE s, RNG* prng) {
 	ASSERT(pwld);
 	return 0;
 }
 
 
-static int RobbyPickUpCan(WORLD* pwld, STATE s) {
+static int RobbyPickUpCan(WORLD* pwld, STATE s, RNG* prng) {
 	ASSERT(pwld);
 	if (s.current == CELL_CAN) {
 		/* Remove the can and reward Robby */
-		WorldSetCell(pwld, pwld->xRobby, pwld->yRobby, CELL_OPEN);
+		WorldRemoveCan(pwld, pwld->xRobby, pwld->yRobby);
 		return ROBBY_PICK_UP_CAN_REWARD;
 	}
+	INSTRUMENT_COUNT(pwld, cFailedPickUps);
 	return ROBBY_PICK_UP_CAN_PUNISHMENT;
 }
 
@@ -149,74 +159,138 @@ static int RobbyPickUpCan(WORLD* pwld, STATE s) {
 /* SmartRobby handlers follow. SmartRobby never bumps into walls, but instead
  * attempts a clockwise wall-avoidance scheme */
 
-static int SmartRobbyMoveNorth(WORLD* pwld, STATE s) {
+static int SmartRobbyMoveNorth(WORLD* pwld, STATE s, RNG* prng) {
 	ASSERT(pwld);
-	if (s.north == CELL_WALL)
-		return SmartRobbyMoveEast(pwld, s);
+	if (s.north == CELL_WALL) {
+		INSTRUMENT_COUNT(pwld, cSmartRedirects);
+		return SmartRobbyMoveEast(pwld, s, prng);
+	}
 	pwld->yRobby--;
 	return 0;
 }
 
 
-static int SmartRobbyMoveSouth(WORLD* pwld, STATE s) {
+static int SmartRobbyMoveSouth(WORLD* pwld, STATE s, RNG* prng) {
 	ASSERT(pwld);
-	if (s.south == CELL_WALL)
-		return SmartRobbyMoveWest(pwld, s);
+	if (s.south == CELL_WALL) {
+		INSTRUMENT_COUNT(pwld, cSmartRedirects);
+		return SmartRobbyMoveWest(pwld, s, prng);
+	}
 	pwld->yRobby++;
 	return 0;
 }
 
 
-static int SmartRobbyMoveEast(WORLD* pwld, STATE s) {
+static int SmartRobbyMoveEast(WORLD* pwld, STATE s, RNG* prng) {
 	ASSERT(pwld);
-	if (s.east == CELL_WALL)
-		return SmartRobbyMoveSouth(pwld, s);
+	if (s.east == CELL_WALL) {
+		INSTRUMENT_COUNT(pwld, cSmartRedirects);
+		return SmartRobbyMoveSouth(pwld, s, prng);
+	}
 	pwld->xRobby++;
 	return 0;
 }
 
 
-static int SmartRobbyMoveWest(WORLD* pwld, STATE s) {
+static int SmartRobbyMoveWest(WORLD* pwld, STATE s, RNG* prng) {
 	ASSERT(pwld);
-	if (s.west == CELL_WALL)
-		return SmartRobbyMoveNorth(pwld, s);
+	if (s.west == CELL_WALL) {
+		INSTRUMENT_COUNT(pwld, cSmartRedirects);
+		return SmartRobbyMoveNorth(pwld, s, prng);
+	}
 	pwld->xRobby--;
 	return 0;
 }
 
 
-static int SmartRobbyMoveRandom(WORLD* pwld, STATE s) {
+static int SmartRobbyMoveRandom(WORLD* pwld, STATE s, RNG* prng) {
 	ASSERT(pwld);
-	return (k_rgpfnSmartActions[rand() % 4])(pwld, s);
+	return (k_rgpfnSmartActions[RngInt(prng, 4)])(pwld, s, prng);
 }
 
 
 /*
- * Runs one Robby cleaning session on the given world (which is changed).
+ * Robby is at step iStep in exactly the state he was in at step iFirst:
+ * same cell, same world, and no random move in between. His moves since then
+ * will therefore repeat until the session ends. Computes the score of the
+ * remaining steps from the session trace and leaves Robby where the full
+ * simulation would.
+ */
+static int RobbyFastForward(WORLD* pwld, int iFirst, int iStep, int cActions, int nScore) {
+	const int* rgnScoreAt = pwld->rgnScoreAt;
+	int cPeriod = iStep - iFirst;
+	int cRemaining = cActions - iStep;
+	int iEnd = iFirst + cRemaining % cPeriod;
+	ASSERT(cPeriod > 0);
+
+	pwld->xRobby = pwld->rgicellAt[iEnd] % pwld->cx;
+	pwld->yRobby = pwld->rgicellAt[iEnd] / pwld->cx;
+	pwld->cActionsSkipped += cRemaining;
+	return nScore + (cRemaining / cPeriod) * (nScore - rgnScoreAt[iFirst]) +
+		rgnScoreAt[iEnd] - rgnScoreAt[iFirst];
+}
+
+
+/*
+ * Runs one Robby cleaning session on the given world (which is changed),
+ * drawing random moves from prng.
+ * If the world has cycle detection enabled, a session that settles into a
+ * deterministic loop is finished analytically with the same result. If the
+ * world has a seen mask, the state of every step is marked in it (the
+ * fast-forwarded steps only repeat states already marked).
  * Returns Robby's score for this cleaning session.
  */
-int RobbyClean(const ARGS* pArgs, WORLD* pwld, STRATEGY* pstg, int cActions) {
-	ASSERT(pwld && pstg);
+int RobbyClean(const ARGS* pArgs, WORLD* pwld, STRATEGY* pstg, int cActions, RNG* prng) {
+	ASSERT(pwld && pstg && prng);
 	ASSERT(cActions > 0);
 
+	/* Instrumented builds simulate every action, so the counts are complete */
+	uint* rgnVisit = INSTRUMENT_ENABLED ? NULL : pwld->rgnVisit;
+	uint nStampBase = rgnVisit ? WorldBeginTrace(pwld, cActions) : 0;
+	uint nEpoch = nStampBase; /* Visits stamped after this are comparable */
+	/* Lazy worlds decide cells as they are read; pick the reader once */
+	STATE (*pfnGetState)(WORLD*, int, int) = pwld->bLazyCans ? WorldGetStateLazy : WorldGetState;
 	int nScore = 0;
 	int i;
+	pwld->cActionsRun += cActions;
 	for (i = 0; i < cActions; i++) {
-		STATE s = WorldGetState(pwld, pwld->xRobby, pwld->yRobby);
-		ACTION a = pstg->rgact[s.index];
+		if (rgnVisit) {
+			uint icell = pwld->yRobby * pwld->cx + pwld->xRobby;
+			if (rgnVisit[icell] > nEpoch)
+				return RobbyFastForward(pwld, rgnVisit[icell] - 1 - nStampBase, i, cActions, nScore);
+			rgnVisit[icell] = nStampBase + i + 1;
+			pwld->rgnScoreAt[i] = nScore;
+			pwld->rgicellAt[i] = icell;
+		}
+
+		STATE s = pfnGetState(pwld, pwld->xRobby, pwld->yRobby);
+		ACTION a = StrategyGetAction(pstg, s.index);
+		if (pwld->rgnSeen)
+			pwld->rgnSeen[(s.index % WORLD_SEEN_BITS) / 64] |= 1ULL << (s.index % 64);
 		ASSERT(a >= 0 && a < NUM_ACTIONS);
+		INSTRUMENT_COUNT(pwld, rgcStates[s.index]);
 
 		/* Dispatch the Robby action to appropriate handler */
 		if (pArgs->robbyType == SmartRobby) {
 			/* SmartRobby picks up cans whenever possible, ignoring his genes */
 			if (s.current == CELL_CAN) {
-				nScore += RobbyPickUpCan(pwld, s);
+				INSTRUMENT_COUNT(pwld, rgcActions[PickUpCan]);
+				nScore += RobbyPickUpCan(pwld, s, prng);
+				nEpoch = nStampBase + i + 1;
 				continue;
 			}
-			nScore += k_rgpfnSmartActions[a % NUM_SMART_ACTIONS](pwld, s);
+			a %= NUM_SMART_ACTIONS;
+			INSTRUMENT_COUNT(pwld, rgcActions[a]);
+			nScore += k_rgpfnSmartActions[a](pwld, s, prng);
 		} else {
-			nScore += k_rgpfnActions[a](pwld, s);
+			INSTRUMENT_COUNT(pwld, rgcActions[a]);
+			nScore += k_rgpfnActions[a](pwld, s, prng);
 		}
+
+		/* A random move or a change to the world means earlier visits no
+		 * longer predict what Robby will do next */
+		if (a == MoveRandom || (a == PickUpCan && s.current == CELL_CAN))
+			nEpoch = nStampBase + i + 1;
 	}
 	return nScore;
 }
@@ -21,4 +21,4 @@
  *****************************************************************************/
 #pragma once
 
-int RobbyClean(const ARGS* pArgs, WORLD* pwld, STRATEGY* pstg, int cActions);
+int RobbyClean(const ARGS* pArgs, WORLD* pwld, STRATEGY* pstg, int cActions, RNG* prng);
@@ -0,0 +1,272 @@
+/*****************************************************************************
+ * search.c: Hyperparameter search: successive halving over population size,
+ * mutation and can probabilities and crossover, with the configurations run in
+ * parallel in one process.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "error.h"
+#include "misc.h"
+#include "args.h"
+#include "rng.h"
+#include "strategy.h"
+#include "population.h"
+#include "world.h"
+#include "evolve.h"
+#include "context.h"
+#include "parallel.h"
+#include "search.h"
+
+
+/* Stream family the configurations are drawn from */
+#define SEARCH_STREAM			0x53656172636843ULL
+
+
+/* One round of successive halving: the surviving configurations, each run on
+ * to the round's generation budget and scored */
+typedef struct {
+	const ARGS*    pArgsScore;    /* Parameters every configuration is scored with */
+	const WORLD*   pWorld;        /* The world template */
+	SEARCHCONFIG** rgpcfg;        /* Survivors, best first after the round */
+	int            cSurvivors;
+	int            cGenerations;  /* The round's generation budget */
+	int            cJobs;         /* Threads shared among the survivors */
+} SEARCHROUND; /* round */
+
+
+/* Returns a number drawn log-uniformly from [rLow, rHigh] */
+static double SearchLogUniform(RNG* prng, double rLow, double rHigh) {
+	return rLow * exp(RngZeroOne(prng) * log(rHigh / rLow));
+}
+
+
+/* Draws configuration iConfig around the given parameters: population size
+ * from a quarter to twice -p, mutation probability from a fifth to five
+ * times -m, can probability within 0.25 of -c, crossover on or off.
+ * Configuration 0 is the given parameters themselves. */
+static void SearchDrawConfig(const ARGS* pArgs, int iConfig, RNG* prng, SEARCHCONFIG* pcfg) {
+	memset(pcfg, 0, sizeof(*pcfg));
+	pcfg->args = *pArgs;
+	pcfg->args.cThreads = 1;
+	pcfg->iConfig = iConfig;
+	if (iConfig == 0)
+		return;
+
+	ARGS* p = &pcfg->args;
+	p->nPopulationSize = (int)floor(SearchLogUniform(prng, pArgs->nPopulationSize / 4.0,
+		pArgs->nPopulationSize * 2.0) + 0.5);
+	if (p->nPopulationSize < 2)
+		p->nPopulationSize = 2;
+	p->rMutationProbability = SearchLogUniform(prng, pArgs->rMutationProbability / 5.0,
+		pArgs->rMutationProbability * 5.0);
+	if (p->rMutationProbability > 1.0)
+		p->rMutationProbability = 1.0;
+	p->rCanProbability = pArgs->rCanProbability + 0.5 * (RngZeroOne(prng) - 0.5);
+
+	/* Rounded as the leaderboard prints them, so its settings reproduce runs */
+	char szValue[32];
+	snprintf(szValue, sizeof(szValue), "%.3g", p->rMutationProbability);
+	p->rMutationProbability = atof(szValue);
+	p->rCanProbability = floor(p->rCanProbability * 100.0 + 0.5) / 100.0;
+	if (p->rCanProbability < 0.05)
+		p->rCanProbability = 0.05;
+	if (p->rCanProbability > 0.95)
+		p->rCanProbability = 0.95;
+	p->bUseCrossover = RngInt(prng, 2) == 0;
+}
+
+
+/* ParallelFor callback: runs one surviving configuration on to the round's
+ * budget and scores the generalization of its top strategies, on the layouts
+ * and can probability of the given parameters, so configurations trained on
+ * different can probabilities are compared on the same test. Once there are
+ * fewer survivors than jobs, each gets a share of the idle threads; results
+ * do not depend on it. */
+static void SearchWork(void* pvRound, int iItem, int iThread) {
+	SEARCHROUND* pround = (SEARCHROUND*) pvRound;
+	SEARCHCONFIG* pcfg = pround->rgpcfg[iItem];
+	if (!pcfg->pctx)
+		pcfg->pctx = ContextCreate(&pcfg->args, pround->pWorld);
+	CONTEXT* pctx = pcfg->pctx;
+	if (pctx->iGeneration >= pround->cGenerations && pcfg->iGeneration == pctx->iGeneration)
+		return; /* A short budget that did not grow; the score stands */
+
+	/* Layout producers' rings are sized for one consumer; those runs keep it */
+	int cThreads = 1;
+	if (pround->cSurvivors < pround->cJobs && !pctx->pring)
+		cThreads = pround->cJobs / pround->cSurvivors + (iItem < pround->cJobs % pround->cSurvivors ? 1 : 0);
+	if (cThreads > 1)
+		ContextSetThreads(pctx, cThreads);
+	ARGS argsScore = *pround->pArgsScore;
+	argsScore.cThreads = cThreads;
+	while (pctx->iGeneration < pround->cGenerations)
+		ContextStep(pctx);
+
+	const POPULATION* pPop = ContextGetPopulation(pctx);
+	int cGeneralize = pround->pArgsScore->cGeneralizeTop;
+	if (cGeneralize < 1)
+		cGeneralize = 1;
+	if (cGeneralize > pPop->cstg)
+		cGeneralize = pPop->cstg;
+	STRATEGY** rgpstg = (STRATEGY**) malloc(sizeof(STRATEGY*) * cGeneralize);
+	VerifyAlloc(rgpstg, "%d strategies to generalize", cGeneralize);
+	GENERALIZATION* rggen = (GENERALIZATION*) malloc(sizeof(GENERALIZATION) * cGeneralize);
+	VerifyAlloc(rggen, "%d generalization scores", cGeneralize);
+	int istg, istgBest = 0;
+	for (istg = 0; istg < cGeneralize; ++istg)
+		rgpstg[istg] = &pPop->rgstg[istg];
+	CalculateGeneralization(&argsScore, rgpstg, cGeneralize, pctx->pwld, pctx->pbank,
+		pctx->rgpwldScratch, rggen);
+	for (istg = 1; istg < cGeneralize; ++istg) {
+		if (rggen[istg].rMean > rggen[istgBest].rMean)
+			istgBest = istg;
+	}
+	pcfg->iGeneration = pctx->iGeneration;
+	pcfg->rScore = rggen[istgBest].rMean;
+	pcfg->rHalfWidth = rggen[istgBest].rHalfWidth;
+	free(rggen);
+	free(rgpstg);
+}
+
+
+/* qsort comparator: furthest run first, then best score, then drawn first */
+static int SearchCompareConfigs(const void* pv1, const void* pv2) {
+	const SEARCHCONFIG* pcfg1 = *(SEARCHCONFIG* const*) pv1;
+	const SEARCHCONFIG* pcfg2 = *(SEARCHCONFIG* const*) pv2;
+	if (pcfg1->iGeneration != pcfg2->iGeneration)
+		return pcfg1->iGeneration > pcfg2->iGeneration ? -1 : 1;
+	if (pcfg1->rScore != pcfg2->rScore)
+		return pcfg1->rScore > pcfg2->rScore ? -1 : 1;
+	return pcfg1->iConfig - pcfg2->iConfig;
+}
+
+
+/* Prints a configuration's settings as the options that reproduce its run */
+static void SearchPrintSettings(FILE* pf, const SEARCHCONFIG* pcfg) {
+	fprintf(pf, "-p %d -m %g -c %g%s", pcfg->args.nPopulationSize, pcfg->args.rMutationProbability,
+		pcfg->args.rCanProbability, pcfg->args.bUseCrossover ? "" : " -x");
+	if (pcfg->iConfig == 0)
+		fputs(" (as given)", pf);
+}
+
+
+/*
+ * Searches for good evolution settings by successive halving (--search):
+ * draws pArgs->cSearchConfigs configurations around pArgs, runs them all for
+ * a short generation budget, keeps the better-generalizing half and doubles
+ * the budget, until one configuration reaches -g generations. Survivors carry
+ * on from where they stopped. Configurations run in parallel, one per thread
+ * until there are fewer of them than threads, when they share the threads
+ * out; every one evolves exactly as ./robby with its settings would. Prints
+ * each round and a final leaderboard to pf. pwldTemplate is the loaded
+ * world, or NULL to load pArgs->pszWorld.
+ */
+void SearchRun(const ARGS* pArgs, const WORLD* pwldTemplate, FILE* pf) {
+	ASSERT(pArgs && pf);
+	ASSERT(pArgs->cSearchConfigs > 0 && pArgs->cGenerations > 0);
+	const int cConfigs = pArgs->cSearchConfigs;
+	const int cJobs = ParallelThreadCount(pArgs->cThreads);
+	WORLD* pwldLoaded = pwldTemplate ? NULL : WorldCreateFromFile(pArgs->pszWorld);
+	ARGS argsScore = *pArgs;
+	argsScore.cThreads = 1;
+
+	/* Rounds halve the configurations down to one, doubling the budget */
+	int cRounds = 1;
+	while ((1 << (cRounds - 1)) < cConfigs)
+		++cRounds;
+
+	SEARCHCONFIG* rgcfg = (SEARCHCONFIG*) malloc(sizeof(SEARCHCONFIG) * cConfigs);
+	SEARCHCONFIG** rgpcfg = (SEARCHCONFIG**) malloc(sizeof(SEARCHCONFIG*) * cConfigs);
+	VerifyAlloc(rgcfg, "search configurations");
+	VerifyAlloc(rgpcfg, "search configurations");
+	RNG rng;
+	RngSeedStream(&rng, pArgs->nSeed ^ SEARCH_STREAM, 0);
+	int icfg;
+	for (icfg = 0; icfg < cConfigs; ++icfg) {
+		SearchDrawConfig(pArgs, icfg, &rng, &rgcfg[icfg]);
+		rgpcfg[icfg] = &rgcfg[icfg];
+	}
+
+	fprintf(pf, "# Search: %d configurations, %d rounds, %d jobs; scored at can probability %g\n#\n",
+		cConfigs, cRounds, cJobs, pArgs->rCanProbability);
+	SEARCHROUND round = {
+		.pArgsScore = &argsScore,
+		.pWorld     = pwldTemplate ? pwldTemplate : pwldLoaded,
+		.rgpcfg     = rgpcfg,
+		.cJobs      = cJobs
+	};
+	int64_t cGenerationsRun = 0;
+	int cSurvivors = cConfigs;
+	int iRound;
+	for (iRound = 0; iRound < cRounds; ++iRound) {
+		double rStart = Seconds();
+		int cBudget = pArgs->cGenerations >> (cRounds - 1 - iRound);
+		if (cBudget < 1)
+			cBudget = 1;
+		for (icfg = 0; icfg < cSurvivors; ++icfg)
+			cGenerationsRun += cBudget - rgpcfg[icfg]->iGeneration;
+		round.cSurvivors = cSurvivors;
+		round.cGenerations = cBudget;
+		ParallelFor(cJobs, cSurvivors, SearchWork, &round);
+		qsort(rgpcfg, cSurvivors, sizeof(SEARCHCONFIG*), SearchCompareConfigs);
+		fprintf(pf, "# Round %d: %d configurations to generation %d; best %g (%.1f s)\n",
+			iRound + 1, cSurvivors, cBudget, rgpcfg[0]->rScore, Seconds() - rStart);
+		fflush(pf);
+
+		/* The eliminated keep their scores for the leaderboard */
+		int cKeep = iRound + 1 < cRounds ? (cSurvivors + 1) / 2 : 0;
+		for (icfg = cKeep; icfg < cSurvivors; ++icfg) {
+			ContextDestroy(rgpcfg[icfg]->pctx);
+			rgpcfg[icfg]->pctx = NULL;
+		}
+		cSurvivors = cKeep;
+	}
+
+	qsort(rgpcfg, cConfigs, sizeof(SEARCHCONFIG*), SearchCompareConfigs);
+	fprintf(pf, "#\n# Rank\tGenerations\tScore\t+/-\tSettings\n");
+	for (icfg = 0; icfg < cConfigs; ++icfg) {
+		fprintf(pf, "%d\t%d\t\t%g\t%.3g\t", icfg + 1, rgpcfg[icfg]->iGeneration, rgpcfg[icfg]->rScore,
+			rgpcfg[icfg]->rHalfWidth);
+		SearchPrintSettings(pf, rgpcfg[icfg]);
+		fputc('\n', pf);
+	}
+	fprintf(pf, "# Generations run: %lld (%.1f%% of running every configuration to %d)\n",
+		(long long)cGenerationsRun, 100.0 * cGenerationsRun / ((double)cConfigs * pArgs->cGenerations),
+		pArgs->cGenerations);
+	fputs("# Best settings: ", pf);
+	SearchPrintSettings(pf, rgpcfg[0]);
+	fputc('\n', pf);
+	fprintf(pf, "# Generalization score: %g\n", rgpcfg[0]->rScore);
+	fflush(pf);
+
+	free(rgpcfg);
+	free(rgcfg);
+	if (pwldLoaded)
+		WorldDestroy(pwldLoaded);
+}
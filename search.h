@@ -0,0 +1,43 @@
+/*****************************************************************************
+ * search.h: Header for search.c.
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#pragma once
+#include <stdio.h>
+#include "types.h"
+#include "args.h"
+#include "world.h"
+#include "context.h"
+
+
+/* One configuration of a hyperparameter search (--search) */
+typedef struct {
+	ARGS     args;            /* Its parameters, drawn single-threaded */
+	int      iConfig;         /* Order drawn in (0: the parameters as given) */
+	CONTEXT* pctx;            /* Its run, or NULL before the first round and
+	                           * once eliminated */
+	int      iGeneration;     /* Generations reached */
+	double   rScore;          /* Best generalization score there */
+	double   rHalfWidth;      /* ...and its 95% confidence half-width */
+} SEARCHCONFIG; /* cfg */
+
+
+/* Function prototypes */
+void SearchRun(const ARGS* pArgs, const WORLD* pwldTemplate, FILE* pf);
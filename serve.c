@@ -0,0 +1,357 @@
+/*****************************************************************************
+ * serve.c: Job server and client: runs many jobs from one long-lived
+ * process over a Unix-domain socket.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#define _GNU_SOURCE /* close_range */
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "types.h"
+#include "error.h"
+#include "args.h"
+#include "strategy.h"
+#include "world.h"
+#include "serve.h"
+
+
+/* Fills a socket address for pszSocket; dies if the path is too long */
+static void SetSocketAddress(struct sockaddr_un* psa, PCSZ pszSocket) {
+	memset(psa, 0, sizeof(*psa));
+	psa->sun_family = AF_UNIX;
+	if (strlen(pszSocket) >= sizeof(psa->sun_path))
+		Die("Socket path '%s' is too long", pszSocket);
+	strcpy(psa->sun_path, pszSocket);
+}
+
+
+/* Returns the loaded world for pszFile, loading it on first use, or NULL,
+ * with the reason in szError, if it cannot be loaded. Failures are not
+ * cached, so a world file that is fixed is picked up by the next job. */
+static const WORLD* ServerGetWorld(SERVER* psrv, PCSZ pszFile, char* szError, size_t cchError) {
+	WORLDCACHE* pwc;
+	pthread_mutex_lock(&psrv->mutexWorlds);
+	for (pwc = psrv->pwcFirst; pwc; pwc = pwc->pNext) {
+		if (strcmp(pwc->pszFile, pszFile) == 0)
+			break;
+	}
+	if (!pwc) {
+		WORLD* pwld = WorldLoad(pszFile, szError, cchError);
+		if (!pwld) {
+			pthread_mutex_unlock(&psrv->mutexWorlds);
+			return NULL;
+		}
+		pwc = (WORLDCACHE*) malloc(sizeof(WORLDCACHE));
+		VerifyAlloc(pwc, "world cache entry");
+		pwc->pszFile = strdup(pszFile);
+		VerifyAlloc(pwc->pszFile, "world file name");
+		pwc->pwld = pwld;
+		pwc->pNext = psrv->pwcFirst;
+		psrv->pwcFirst = pwc;
+		printf("# Loaded world '%s'\n", pszFile);
+		fflush(stdout);
+	}
+	pthread_mutex_unlock(&psrv->mutexWorlds);
+	return pwc->pwld;
+}
+
+
+/* Splits a job line into whitespace-separated words in place; returns the
+ * word count. The caller frees *prgpsz. */
+static int SplitWords(char* psz, char*** prgpsz) {
+	int cWords = 0, maxWords = 16;
+	char** rgpsz = (char**) malloc(sizeof(char*) * (maxWords + 1));
+	VerifyAlloc(rgpsz, "job arguments");
+	char* pszSave;
+	char* pszWord;
+	for (pszWord = strtok_r(psz, " \t\r\n", &pszSave); pszWord; pszWord = strtok_r(NULL, " \t\r\n", &pszSave)) {
+		if (cWords == maxWords) {
+			maxWords *= 2;
+			rgpsz = (char**) realloc(rgpsz, sizeof(char*) * (maxWords + 1));
+			VerifyAlloc(rgpsz, "job arguments");
+		}
+		rgpsz[cWords++] = pszWord;
+	}
+	rgpsz[cWords] = NULL;
+	*prgpsz = rgpsz;
+	return cWords;
+}
+
+
+/* Reads a strategy written as a string of action digits; returns false if it
+ * is not one */
+static bool ParseGenes(char* pszGenes, STRATEGY* pstg) {
+	int i;
+	if (strlen(pszGenes) != STRATEGY_LENGTH)
+		return false;
+	/* Decode in place, then set all the genes at once */
+	for (i = 0; i < STRATEGY_LENGTH; ++i) {
+		if (pszGenes[i] < '0' || pszGenes[i] >= '0' + NUM_ACTIONS)
+			return false;
+		pszGenes[i] -= '0';
+	}
+	StrategySetActions(pstg, (const uint8_t*) pszGenes);
+	return true;
+}
+
+
+/* Runs a checked job in a child process, so that failures the checks cannot
+ * foresee (a file that cannot be written, memory that cannot be had, in any
+ * of the job's threads) end only the job. The child shares the loaded worlds
+ * copy-on-write and has the job's stream as its stderr, so the client sees
+ * why it died; the server then adds a "# ERROR:" line saying how. */
+static void ServerForkJob(SERVER* psrv, const ARGS* pArgs, const WORLD* pwld, const STRATEGY* pstgEvaluate,
+                          FILE* pfOut) {
+	fflush(pfOut); /* Or the child would repeat the buffered settings */
+	pid_t pid = fork();
+	if (pid == 0) {
+		/* Other jobs' connections must close when those jobs end */
+		int fd = fileno(pfOut);
+		dup2(fd, STDERR_FILENO);
+		if (fd > STDERR_FILENO + 1)
+			close_range(STDERR_FILENO + 1, fd - 1, 0);
+		close_range(fd + 1, ~0U, 0);
+		psrv->pfnRun(pArgs, pwld, pstgEvaluate, pfOut);
+		fflush(pfOut);
+		_exit(EXIT_SUCCESS);
+	}
+	if (pid < 0) {
+		fprintf(pfOut, "# ERROR: Cannot start the job\n");
+		return;
+	}
+
+	int nStatus;
+	pid_t pidDone;
+	do
+		pidDone = waitpid(pid, &nStatus, 0);
+	while (pidDone < 0 && errno == EINTR);
+	if (pidDone < 0)
+		fprintf(pfOut, "# ERROR: Lost track of the job\n");
+	else if (WIFSIGNALED(nStatus))
+		fprintf(pfOut, "# ERROR: The job died (%s)\n", strsignal(WTERMSIG(nStatus)));
+	else if (WEXITSTATUS(nStatus) != EXIT_SUCCESS)
+		fprintf(pfOut, "# ERROR: The job failed (exit status %d)\n", WEXITSTATUS(nStatus));
+}
+
+
+/* Runs one job line, writing its output (or a "# ERROR:" line) to pfOut.
+ * Jobs are
+ *   run ARGS
+ *   evaluate GENES ARGS
+ * where ARGS are robby's own command-line arguments. */
+static void ServerRunJob(SERVER* psrv, char* pszJob, STRATEGY* pstgEvaluate, FILE* pfOut) {
+	char** rgpszArgs;
+	int cArgs = SplitWords(pszJob, &rgpszArgs);
+	bool bEvaluate = cArgs >= 2 && strcmp(rgpszArgs[0], "evaluate") == 0;
+	if (bEvaluate) {
+		if (!ParseGenes(rgpszArgs[1], pstgEvaluate)) {
+			fprintf(pfOut, "# ERROR: Genes must be %d digits from 0 to %d\n", STRATEGY_LENGTH, NUM_ACTIONS - 1);
+			free(rgpszArgs);
+			return;
+		}
+		/* The genes take the place of the program name */
+		cArgs--;
+		memmove(&rgpszArgs[0], &rgpszArgs[1], sizeof(char*) * (cArgs + 1));
+	} else if (cArgs < 1 || strcmp(rgpszArgs[0], "run") != 0) {
+		fprintf(pfOut, "# ERROR: Jobs are 'run ARGS' or 'evaluate GENES ARGS'\n");
+		free(rgpszArgs);
+		return;
+	}
+
+	/* Jobs share the machine, so each is single-threaded unless it says */
+	ARGS args = k_argsDefault;
+	args.cThreads = 1;
+	pthread_mutex_lock(&psrv->mutexParse);
+	ParseResult result = psrv->pfnParse(cArgs, rgpszArgs, &args, pfOut, pfOut);
+	pthread_mutex_unlock(&psrv->mutexParse);
+
+	/* What would make the job die at once is caught here, so that it is
+	 * refused with a clear reason */
+	char szError[512];
+	const WORLD* pwld = NULL;
+	PCSZ pszError = result == ParseRun ? NULL : "Bad job arguments";
+	if (!pszError) {
+		pwld = ServerGetWorld(psrv, args.pszWorld, szError, sizeof(szError));
+		pszError = pwld ? psrv->pfnCheck(&args, pwld) : szError;
+	}
+	if (pszError)
+		fprintf(pfOut, "# ERROR: %s\n", pszError);
+	else
+		ServerForkJob(psrv, &args, pwld, bEvaluate ? pstgEvaluate : NULL, pfOut);
+	free(rgpszArgs);
+}
+
+
+/* Reads one job line from a connection and runs it */
+static void ServerHandleConnection(SERVER* psrv, STRATEGY* pstgEvaluate, int fd) {
+	int fdRead = dup(fd);
+	FILE* pfIn = fdRead >= 0 ? fdopen(fdRead, "r") : NULL;
+	FILE* pfOut = fdopen(fd, "w");
+	if (!pfIn || !pfOut) {
+		if (pfIn)
+			fclose(pfIn);
+		else if (fdRead >= 0)
+			close(fdRead);
+		if (pfOut)
+			fclose(pfOut);
+		else
+			close(fd);
+		return;
+	}
+
+	char* pszLine = NULL;
+	size_t cbLine = 0;
+	if (getline(&pszLine, &cbLine, pfIn) >= 0)
+		ServerRunJob(psrv, pszLine, pstgEvaluate, pfOut);
+	else
+		fprintf(pfOut, "# ERROR: No job\n");
+	free(pszLine);
+	fclose(pfIn);
+	fclose(pfOut);
+}
+
+
+/* Job thread: runs queued connections' jobs, one at a time, forever */
+static void* ServerJobThread(void* pv) {
+	SERVER* psrv = (SERVER*) pv;
+	/* Too big for the stack with the larger neighborhoods */
+	STRATEGY* pstgEvaluate = StrategyAllocArray(1);
+	for (;;) {
+		pthread_mutex_lock(&psrv->mutexQueue);
+		while (psrv->cfdQueued == 0)
+			pthread_cond_wait(&psrv->condJob, &psrv->mutexQueue);
+		int fd = psrv->rgfdQueue[psrv->ifdHead];
+		psrv->ifdHead = (psrv->ifdHead + 1) % SERVE_QUEUE_LENGTH;
+		psrv->cfdQueued--;
+		pthread_cond_signal(&psrv->condRoom);
+		pthread_mutex_unlock(&psrv->mutexQueue);
+
+		ServerHandleConnection(psrv, pstgEvaluate, fd);
+	}
+	return NULL;
+}
+
+
+/* Serves jobs on the Unix-domain socket pszSocket with cJobs job threads,
+ * until killed. Loaded worlds are kept for the server's lifetime. */
+int ServeJobs(PCSZ pszSocket, int cJobs, PFNPARSEJOB pfnParse, PFNCHECKJOB pfnCheck, PFNRUNJOB pfnRun) {
+	ASSERT(pszSocket && cJobs > 0 && pfnParse && pfnCheck && pfnRun);
+	SERVER srv;
+	memset(&srv, 0, sizeof(srv));
+	srv.pfnParse = pfnParse;
+	srv.pfnCheck = pfnCheck;
+	srv.pfnRun = pfnRun;
+	pthread_mutex_init(&srv.mutexParse, NULL);
+	pthread_mutex_init(&srv.mutexWorlds, NULL);
+	pthread_mutex_init(&srv.mutexQueue, NULL);
+	pthread_cond_init(&srv.condJob, NULL);
+	pthread_cond_init(&srv.condRoom, NULL);
+
+	/* A client that hangs up mid-job must not kill the server */
+	signal(SIGPIPE, SIG_IGN);
+
+	struct sockaddr_un sa;
+	SetSocketAddress(&sa, pszSocket);
+	int fdListen = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fdListen < 0)
+		Die("Cannot create socket");
+	unlink(pszSocket); /* Left over from an earlier server */
+	if (bind(fdListen, (struct sockaddr*) &sa, sizeof(sa)) != 0)
+		Die("Cannot bind to '%s'", pszSocket);
+	if (listen(fdListen, SERVE_QUEUE_LENGTH) != 0)
+		Die("Cannot listen on '%s'", pszSocket);
+
+	int i;
+	for (i = 0; i < cJobs; ++i) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, ServerJobThread, &srv) != 0)
+			Die("Cannot create job thread");
+		pthread_detach(thread);
+	}
+	printf("# Serving on %s with %d job threads\n", pszSocket, cJobs);
+	fflush(stdout);
+
+	for (;;) {
+		int fd = accept(fdListen, NULL, NULL);
+		if (fd < 0)
+			continue;
+		pthread_mutex_lock(&srv.mutexQueue);
+		while (srv.cfdQueued == SERVE_QUEUE_LENGTH)
+			pthread_cond_wait(&srv.condRoom, &srv.mutexQueue);
+		srv.rgfdQueue[(srv.ifdHead + srv.cfdQueued) % SERVE_QUEUE_LENGTH] = fd;
+		srv.cfdQueued++;
+		pthread_cond_signal(&srv.condJob);
+		pthread_mutex_unlock(&srv.mutexQueue);
+	}
+	return 0;
+}
+
+
+/* Sends the job in argv (e.g. "run -p 100") to the server on pszSocket and
+ * copies its output to stdout. Returns nonzero if the job was refused or did
+ * not run to its final score line. */
+int ClientRun(PCSZ pszSocket, int argc, char** argv) {
+	ASSERT(pszSocket && argc > 0 && argv);
+	struct sockaddr_un sa;
+	SetSocketAddress(&sa, pszSocket);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		Die("Cannot create socket");
+	if (connect(fd, (struct sockaddr*) &sa, sizeof(sa)) != 0)
+		Die("Cannot connect to '%s'", pszSocket);
+
+	FILE* pf = fdopen(fd, "r+");
+	VerifyAlloc(pf, "socket stream");
+	int i;
+	for (i = 0; i < argc; ++i)
+		fprintf(pf, "%s%c", argv[i], i + 1 < argc ? ' ' : '\n');
+	fflush(pf);
+	shutdown(fd, SHUT_WR);
+
+	/* Every finished job ends with its score; a stream that stops short
+	 * means the job, or the server, died */
+	char* pszLine = NULL;
+	size_t cbLine = 0;
+	bool bError = false, bScored = false;
+	while (getline(&pszLine, &cbLine, pf) >= 0) {
+		if (strncmp(pszLine, "# ERROR:", 8) == 0)
+			bError = true;
+		bScored = strncmp(pszLine, SERVE_SCORE_LINE, strlen(SERVE_SCORE_LINE)) == 0;
+		fputs(pszLine, stdout);
+		fflush(stdout);
+	}
+	free(pszLine);
+	fclose(pf);
+	if (!bError && !bScored)
+		fprintf(stderr, "The job ended without a score; the server may have died\n");
+	return bError || !bScored ? EXIT_FAILURE : EXIT_SUCCESS;
+}
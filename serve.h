@@ -0,0 +1,84 @@
+/*****************************************************************************
+ * serve.h: Header for serve.c.
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#pragma once
+#include <pthread.h>
+#include <stdio.h>
+#include "types.h"
+#include "args.h"
+#include "strategy.h"
+#include "world.h"
+
+
+/* Concurrent jobs' connections waiting for a free slot */
+#define SERVE_QUEUE_LENGTH	64
+
+/* The line every job's output ends with once it has run to completion */
+#define SERVE_SCORE_LINE	"# Generalization score: "
+
+typedef enum {
+	ParseRun,    /* Good arguments; go ahead */
+	ParseHelp,   /* Usage was asked for and printed */
+	ParseFailed, /* Bad arguments; usage was printed */
+} ParseResult;
+
+/* Callbacks through which the server parses, checks and runs jobs exactly as
+ * the command line does (see main.c) */
+typedef ParseResult (*PFNPARSEJOB)(int argc, char** argv, ARGS* pArgs, FILE* pf, FILE* pfError);
+typedef PCSZ        (*PFNCHECKJOB)(const ARGS* pArgs, const WORLD* pwld);
+typedef void        (*PFNRUNJOB)(const ARGS* pArgs, const WORLD* pwldTemplate, const STRATEGY* pstgEvaluate, FILE* pf);
+
+
+/* A loaded world, kept for every later job that names the same file */
+typedef struct WORLDCACHE {
+	PSZ                pszFile;
+	WORLD*             pwld;
+	struct WORLDCACHE* pNext;
+} WORLDCACHE; /* wc */
+
+
+/*
+ * A job server: accepts connections on a Unix-domain socket and runs one job
+ * per connection on a fixed pool of job threads, streaming the job's output
+ * back over the connection as it is produced. Each thread runs its jobs in
+ * child processes, so a job that dies does not take the server with it.
+ */
+typedef struct {
+	PFNPARSEJOB     pfnParse;
+	PFNCHECKJOB     pfnCheck;
+	PFNRUNJOB       pfnRun;
+	pthread_mutex_t mutexParse;     /* getopt is not reentrant */
+	pthread_mutex_t mutexWorlds;
+	WORLDCACHE*     pwcFirst;
+
+	/* Accepted connections waiting for a job thread */
+	pthread_mutex_t mutexQueue;
+	pthread_cond_t  condJob;        /* Signaled when a connection is queued */
+	pthread_cond_t  condRoom;       /* Signaled when the queue has room */
+	int             rgfdQueue[SERVE_QUEUE_LENGTH];
+	int             ifdHead;
+	int             cfdQueued;
+} SERVER; /* srv */
+
+
+/* Function prototypes */
+int ServeJobs(PCSZ pszSocket, int cJobs, PFNPARSEJOB pfnParse, PFNCHECKJOB pfnCheck, PFNRUNJOB pfnRun);
+int ClientRun(PCSZ pszSocket, int argc, char** argv);
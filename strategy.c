@@ -24,10 +24,12 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
  *****************************************************************************/
-#include <stdlib.h> /* rand */
+#include <stdlib.h>
 #include <string.h> /* memcpy */
+#include <sys/mman.h> /* madvise */
 #include "error.h"
 #include "types.h"
+#include "rng.h"
 #include "strategy.h"
 
 
@@ -39,10 +41,64 @@ void StrategyCopy(const STRATEGY* pstgSource, STRATEGY* pstgTarget) {
 
 
 /* Sets this all of a Strategy's actions to random ones */
-void StrategyRandomize(STRATEGY* pstg) {
-	ASSERT(pstg);
+void StrategyRandomize(STRATEGY* pstg, RNG* prng) {
+	ASSERT(pstg && prng);
 	int i;
+#ifdef PACKED_GENOME
+	/* Keep the bits past the last gene of each word clear */
+	memset(pstg->rgnGenes, 0, sizeof(pstg->rgnGenes));
+#endif
 	for (i = 0; i < STRATEGY_LENGTH; ++i) {
-		pstg->rgact[i] = rand() % NUM_ACTIONS;
+		StrategySetAction(pstg, i, RngInt(prng, NUM_ACTIONS));
 	}
+	pstg->istgParent = -1;
+}
+
+
+/* Allocates an array of cstg strategies, aligned to STRATEGY_ARRAY_ALIGNMENT.
+ * Arrays of large genomes are marked for transparent huge pages. */
+STRATEGY* StrategyAllocArray(int cstg) {
+	ASSERT(cstg > 0);
+	void* pv;
+	size_t cb = sizeof(STRATEGY) * (size_t)cstg;
+	if (posix_memalign(&pv, STRATEGY_ARRAY_ALIGNMENT, cb) != 0)
+		pv = NULL;
+	VerifyAlloc(pv, "%d strategies", cstg);
+#if STRATEGY_LENGTH > 4096
+	madvise(pv, cb, MADV_HUGEPAGE);
+#endif
+	return (STRATEGY*) pv;
+}
+
+
+/* Frees an array allocated by StrategyAllocArray */
+void StrategyFreeArray(STRATEGY* rgstg) {
+	free(rgstg);
+}
+
+
+/* Copies a strategy's genes out, one byte per gene */
+void StrategyGetActions(const STRATEGY* pstg, uint8_t* rgact) {
+	ASSERT(pstg && rgact);
+#ifdef PACKED_GENOME
+	int i;
+	for (i = 0; i < STRATEGY_LENGTH; ++i)
+		rgact[i] = StrategyGetAction(pstg, i);
+#else
+	memcpy(rgact, pstg->rgact, STRATEGY_LENGTH);
+#endif
+}
+
+
+/* Sets a strategy's genes from one byte per gene */
+void StrategySetActions(STRATEGY* pstg, const uint8_t* rgact) {
+	ASSERT(pstg && rgact);
+#ifdef PACKED_GENOME
+	memset(pstg->rgnGenes, 0, sizeof(pstg->rgnGenes));
+	int i;
+	for (i = 0; i < STRATEGY_LENGTH; ++i)
+		pstg->rgnGenes[i / GENES_PER_WORD] |= (uint64_t)rgact[i] << (GENE_BITS * (i % GENES_PER_WORD));
+#else
+	memcpy(pstg->rgact, rgact, STRATEGY_LENGTH);
+#endif
 }
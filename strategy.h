@@ -20,6 +20,8 @@
  *
  *****************************************************************************/
 #pragma once
+#include "rng.h"
+#include "neighborhood.h"
 
 typedef enum {
 	MoveNorth  = 0,
@@ -32,17 +34,81 @@ typedef enum {
 } ACTION;
 #define NUM_ACTIONS  7
 
-/* Number of actions in a strategy */
-#define STRATEGY_LENGTH  243
+/* Number of actions in a strategy: one per state of the neighborhood */
+#define STRATEGY_LENGTH  NEIGHBORHOOD_STATES
+
+/* Genomes of the larger neighborhoods span many pages and are read at random
+ * by state index, so each starts on a cache line, and arrays of them are
+ * allocated on huge-page boundaries (see StrategyAllocArray) to save TLB
+ * misses. The default genome is small enough to need neither. */
+#if STRATEGY_LENGTH > 4096
+#define STRATEGY_ALIGNMENT       64
+#define STRATEGY_ARRAY_ALIGNMENT (2 * 1024 * 1024)
+#else
+#define STRATEGY_ALIGNMENT       8
+#define STRATEGY_ARRAY_ALIGNMENT 64
+#endif
+
+/*
+ * Genomes are stored one gene per byte by default. Packed builds (scons
+ * packed=1, which defines PACKED_GENOME) store 21 three-bit genes per 64-bit
+ * word instead, for populations too big for memory otherwise: the default
+ * STRATEGY shrinks from 256 bytes to 112. A gene never straddles two words,
+ * so reading or writing one is a shift and a mask. Either way, genes are only
+ * accessed through StrategyGetAction and StrategySetAction (and the bulk
+ * StrategyGetActions and StrategySetActions), and random streams are drawn
+ * identically, so both builds evolve the same strategies.
+ */
+#ifdef PACKED_GENOME
+#define GENE_BITS        3
+#define GENES_PER_WORD   21
+#define GENE_MASK        7
+#define GENOME_WORDS     ((STRATEGY_LENGTH + GENES_PER_WORD - 1) / GENES_PER_WORD)
+#endif
 
 /* An individual chromosome in the population, or "strategy" */
 typedef struct {
+#ifdef PACKED_GENOME
+	uint64_t rgnGenes[GENOME_WORDS]; /* Gene i: bits 3(i % 21) up of word i / 21 */
+#else
 	/* ACTIONs stored as bytes for hopefully better cache performance */
 	uint8_t rgact[STRATEGY_LENGTH];
+#endif
+	/* Index of the parent that gave the most genes, in the previous generation
+	 * as sorted, or -1 if random. The unpacked genomes leave padding before
+	 * rFitness that holds it, as does the cache-line rounding of the larger
+	 * packed ones; the default packed STRATEGY has no slack and grows from
+	 * 104 bytes to 112 for it. */
+	int32_t istgParent;
 	double  rFitness; /* Average score after 'NUM_SESSIONS' cleanings */
-} STRATEGY; /* stg */
+} __attribute__((aligned(STRATEGY_ALIGNMENT))) STRATEGY; /* stg */
+
+
+/* Returns the action a strategy takes in state iact */
+static inline ACTION StrategyGetAction(const STRATEGY* pstg, int iact) {
+#ifdef PACKED_GENOME
+	return (ACTION)((pstg->rgnGenes[iact / GENES_PER_WORD] >> (GENE_BITS * (iact % GENES_PER_WORD))) & GENE_MASK);
+#else
+	return (ACTION) pstg->rgact[iact];
+#endif
+}
+
+/* Sets the action a strategy takes in state iact */
+static inline void StrategySetAction(STRATEGY* pstg, int iact, ACTION act) {
+#ifdef PACKED_GENOME
+	uint64_t* pn = &pstg->rgnGenes[iact / GENES_PER_WORD];
+	int nShift = GENE_BITS * (iact % GENES_PER_WORD);
+	*pn = (*pn & ~((uint64_t)GENE_MASK << nShift)) | ((uint64_t)act << nShift);
+#else
+	pstg->rgact[iact] = (uint8_t) act;
+#endif
+}
 
 
 /* Function prototypes */
 void StrategyCopy(const STRATEGY* pstgSource, STRATEGY* pstgTarget);
-void StrategyRandomize(STRATEGY* pstg);
+void StrategyRandomize(STRATEGY* pstg, RNG* prng);
+STRATEGY* StrategyAllocArray(int cstg);
+void StrategyFreeArray(STRATEGY* rgstg);
+void StrategyGetActions(const STRATEGY* pstg, uint8_t* rgact);
+void StrategySetActions(STRATEGY* pstg, const uint8_t* rgact);
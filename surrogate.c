@@ -0,0 +1,195 @@
+/*****************************************************************************
+ * surrogate.c: Surrogate fitness model: predicts bred children's fitness from
+ * their genes so only the most promising are simulated.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <math.h>
+#include <stdlib.h>
+#include "types.h"
+#include "error.h"
+#include "strategy.h"
+#include "population.h"
+#include "surrogate.h"
+
+
+/* Training step size: the fraction of each strategy's prediction error the
+ * model corrects for it (normalized least mean squares) */
+#define SURROGATE_STEP	0.5
+
+
+/* Allocates an untrained model, which predicts zero for every strategy, for
+ * screening children into populations of cstg strategies */
+SURROGATE* SurrogateCreate(int cstg) {
+	ASSERT(cstg > 0);
+	SURROGATE* psur = (SURROGATE*) calloc(1, sizeof(SURROGATE));
+	VerifyAlloc(psur, "surrogate");
+	psur->rgrWeight = (double*) calloc(STRATEGY_LENGTH * NUM_ACTIONS, sizeof(double));
+	VerifyAlloc(psur->rgrWeight, "surrogate weights");
+	psur->rgrPredicted = (double*) malloc(sizeof(double) * cstg);
+	VerifyAlloc(psur->rgrPredicted, "surrogate predictions (%d strategies)", cstg);
+	psur->cstg = cstg;
+	return psur;
+}
+
+
+/* Frees a model allocated by SurrogateCreate */
+void SurrogateDestroy(SURROGATE* psur) {
+	ASSERT(psur);
+	free(psur->rgrPredicted);
+	free(psur->rgrWeight);
+	free(psur);
+}
+
+
+/* Returns the model's predicted fitness for a strategy */
+double SurrogatePredict(const SURROGATE* psur, const STRATEGY* pstg) {
+	ASSERT(psur && pstg);
+	double rFitness = psur->rBias;
+	int iact;
+	for (iact = 0; iact < STRATEGY_LENGTH; ++iact)
+		rFitness += psur->rgrWeight[iact * NUM_ACTIONS + StrategyGetAction(pstg, iact)];
+	return rFitness;
+}
+
+
+/* Predicts a bred child's fitness as its main parent's measured fitness,
+ * adjusted by what the model makes of the genes in which they differ. This
+ * ranks siblings by their differences while keeping the parent's far more
+ * accurate score as the baseline. */
+static double SurrogatePredictChild(const SURROGATE* psur, const STRATEGY* pstg, const POPULATION* pPopParents) {
+	if (pstg->istgParent < 0)
+		return SurrogatePredict(psur, pstg);
+	const STRATEGY* pstgParent = &pPopParents->rgstg[pstg->istgParent];
+	double rFitness = pstgParent->rFitness;
+	int iact;
+	for (iact = 0; iact < STRATEGY_LENGTH; ++iact) {
+		ACTION act = StrategyGetAction(pstg, iact);
+		ACTION actParent = StrategyGetAction(pstgParent, iact);
+		if (act != actParent)
+			rFitness += psur->rgrWeight[iact * NUM_ACTIONS + act] - psur->rgrWeight[iact * NUM_ACTIONS + actParent];
+	}
+	return rFitness;
+}
+
+
+/* A pool child and its predicted fitness */
+typedef struct {
+	double rPredicted;
+	int    istg;
+} PREDICTION; /* prd */
+
+
+/* qsort comparator: highest prediction first, ties to the earlier child, so
+ * the order is total and does not depend on the sort */
+static int ComparePredictions(const void* pvLeft, const void* pvRight) {
+	const PREDICTION* pprdLeft = (const PREDICTION*) pvLeft;
+	const PREDICTION* pprdRight = (const PREDICTION*) pvRight;
+	if (pprdLeft->rPredicted != pprdRight->rPredicted)
+		return pprdLeft->rPredicted > pprdRight->rPredicted ? -1 : 1;
+	return pprdLeft->istg - pprdRight->istg;
+}
+
+
+/* Keeps the cChildren children of pPool (bred from pPopParents) with the
+ * highest predicted fitness, copying them into pPopNew in pool order, and
+ * remembers their predictions for SurrogateTrain to score */
+void SurrogateScreen(SURROGATE* psur, const POPULATION* pPopParents, const POPULATION* pPool, POPULATION* pPopNew,
+                     int cChildren) {
+	ASSERT(psur && pPopParents && pPool && pPopNew);
+	ASSERT(cChildren > 0 && cChildren <= pPool->cstg && cChildren <= pPopNew->maxstg && cChildren <= psur->cstg);
+
+	const int cPool = pPool->cstg;
+	PREDICTION* rgprd = (PREDICTION*) malloc(sizeof(PREDICTION) * cPool);
+	double* rgrPredicted = (double*) malloc(sizeof(double) * cPool);
+	bool* rgbKeep = (bool*) calloc(cPool, sizeof(bool));
+	VerifyAlloc(rgprd && rgrPredicted && rgbKeep ? rgprd : NULL, "surrogate screening (%d children)", cPool);
+	int istg, i;
+	for (istg = 0; istg < cPool; ++istg) {
+		rgrPredicted[istg] = SurrogatePredictChild(psur, &pPool->rgstg[istg], pPopParents);
+		rgprd[istg].rPredicted = rgrPredicted[istg];
+		rgprd[istg].istg = istg;
+	}
+	qsort(rgprd, cPool, sizeof(PREDICTION), ComparePredictions);
+	for (i = 0; i < cChildren; ++i)
+		rgbKeep[rgprd[i].istg] = true;
+
+	pPopNew->cstg = 0;
+	for (istg = 0; istg < cPool; ++istg) {
+		if (rgbKeep[istg]) {
+			psur->rgrPredicted[pPopNew->cstg] = rgrPredicted[istg];
+			StrategyCopy(&pPool->rgstg[istg], &pPopNew->rgstg[pPopNew->cstg++]);
+		}
+	}
+	ASSERT(pPopNew->cstg == cChildren);
+
+	psur->cChildrenBred += cPool;
+	psur->cChildrenEvaluated += cChildren;
+	free(rgbKeep);
+	free(rgrPredicted);
+	free(rgprd);
+}
+
+
+/* Trains the model on a freshly evaluated population, one strategy at a time
+ * in population order. If bScreened, the population is what SurrogateScreen
+ * last let through, and its predictions are first scored against the
+ * fitness found. */
+void SurrogateTrain(SURROGATE* psur, const POPULATION* pPop, bool bScreened) {
+	ASSERT(psur && pPop);
+	ASSERT(!bScreened || pPop->cstg <= psur->cstg);
+	int istg, iact;
+
+	if (bScreened && pPop->cstg > 1) {
+		double rSumP = 0, rSumA = 0, rSumPP = 0, rSumAA = 0, rSumPA = 0;
+		for (istg = 0; istg < pPop->cstg; ++istg) {
+			double rPredicted = psur->rgrPredicted[istg];
+			double rActual = pPop->rgstg[istg].rFitness;
+			psur->rAbsErrorSum += fabs(rPredicted - rActual);
+			rSumP += rPredicted;
+			rSumA += rActual;
+			rSumPP += rPredicted * rPredicted;
+			rSumAA += rActual * rActual;
+			rSumPA += rPredicted * rActual;
+		}
+		double n = (double)pPop->cstg;
+		double rVarianceP = rSumPP - rSumP * rSumP / n;
+		double rVarianceA = rSumAA - rSumA * rSumA / n;
+		if (rVarianceP > 0.0 && rVarianceA > 0.0) {
+			psur->rCorrelationSum += (rSumPA - rSumP * rSumA / n) / sqrt(rVarianceP * rVarianceA);
+			psur->cCorrelations++;
+		}
+	}
+
+	/* Every strategy has exactly one active weight per gene, plus the bias */
+	const double rStep = SURROGATE_STEP / (STRATEGY_LENGTH + 1);
+	for (istg = 0; istg < pPop->cstg; ++istg) {
+		const STRATEGY* pstg = &pPop->rgstg[istg];
+		double rCorrection = rStep * (pstg->rFitness - SurrogatePredict(psur, pstg));
+		psur->rBias += rCorrection;
+		for (iact = 0; iact < STRATEGY_LENGTH; ++iact)
+			psur->rgrWeight[iact * NUM_ACTIONS + StrategyGetAction(pstg, iact)] += rCorrection;
+	}
+	psur->cTrained += pPop->cstg;
+}
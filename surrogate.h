@@ -0,0 +1,56 @@
+/*****************************************************************************
+ * surrogate.h: Header for surrogate.c.
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#pragma once
+#include "types.h"
+#include "strategy.h"
+#include "population.h"
+
+
+/*
+ * A cheap fitness model used to pre-screen bred children: a per-gene linear
+ * model with one weight for every (state, action) pair, so a strategy's
+ * predicted fitness is the bias plus the weights of the actions its genes
+ * hold. It is trained online on every evaluated generation, and keeps
+ * statistics on how well it predicted the children it let through.
+ */
+typedef struct {
+	double  rBias;
+	double* rgrWeight;           /* [iact * NUM_ACTIONS + action] */
+	int     cTrained;            /* Evaluated strategies trained on */
+	int     cstg;                /* Population size screened for */
+	double* rgrPredicted;        /* Predictions for the last screened children */
+
+	int64_t cChildrenBred;       /* Children the model screened */
+	int64_t cChildrenEvaluated;  /* ...of which it let through */
+	double  rAbsErrorSum;        /* Over the evaluated children */
+	double  rCorrelationSum;     /* Predicted against actual fitness, */
+	int     cCorrelations;       /* summed over screened generations */
+} SURROGATE; /* sur */
+
+
+/* Function prototypes */
+SURROGATE* SurrogateCreate(int cstg);
+void       SurrogateDestroy(SURROGATE* psur);
+double     SurrogatePredict(const SURROGATE* psur, const STRATEGY* pstg);
+void       SurrogateScreen(SURROGATE* psur, const POPULATION* pPopParents, const POPULATION* pPool, POPULATION* pPopNew,
+                           int cChildren);
+void       SurrogateTrain(SURROGATE* psur, const POPULATION* pPop, bool bScreened);
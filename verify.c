@@ -0,0 +1,487 @@
+/*****************************************************************************
+ * verify.c: Equivalence harness: checks the engine against the frozen
+ * reference engine.
+ *
+ * WARNING! This codebase uses an uncommon variable naming convention. It makes
+ * sense--with an explanation--I swear! Please see the README.
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (C) 2009  Adam J. DiCarlo <adam.dicarlo@gmail.com>
+ *
+ * This file is part of Robby the Robot.
+ *
+ * Robby the Robot is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Robby the Robot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "types.h"
+#include "error.h"
+#include "args.h"
+#include "misc.h"
+#include "rng.h"
+#include "strategy.h"
+#include "population.h"
+#include "world.h"
+#include "robby.h"
+#include "evolve.h"
+#include "reference.h"
+
+
+#define DEFAULT_TRIALS		2000
+#define DEFAULT_RUNS		20
+#define DEFAULT_GENERATIONS	10
+#define MAX_WORLD_SIDE		24	/* Random worlds are up to this square */
+
+
+/* Print program command-line usage */
+void Usage() {
+	fprintf(stderr, "Usage: ./verify ARGS\n");
+	fprintf(stderr, "Checks the engine against the frozen reference engine (reference.c) on\n"
+	                "random worlds, strategies and seeds. Exits nonzero at the first\n"
+	                "divergence, after describing it.\n");
+	fprintf(stderr, "Where ARGS is zero or more of:\n");
+	fprintf(stderr, "\t-n <Session trials>        (default: %d)\n", DEFAULT_TRIALS);
+	fprintf(stderr, "\t-p <Evolution runs (each)> (default: %d)\n", DEFAULT_RUNS);
+	fprintf(stderr, "\t-g <Generations per run>   (default: %d)\n", DEFAULT_GENERATIONS);
+	fprintf(stderr, "\t-r <Random number seed>    (default: %d)\n", k_argsDefault.nSeed);
+	fprintf(stderr, "\t-w <World file to use>     (default: a new random world per trial)\n");
+	fprintf(stderr, "\t-h: Display this help message and exit\n");
+}
+
+
+/* Loads the given world, or makes a random one: walls around the edge, walls
+ * inside with a random density, and Robby on a random inside cell. Robby's
+ * inside neighbors stay open, since SmartRobby would turn forever if walled
+ * in. The world goes through a temporary file so it is loaded exactly as a
+ * real one. */
+static WORLD* CreateTrialWorld(PCSZ pszWorld, RNG* prng) {
+	if (pszWorld)
+		return WorldCreateFromFile(pszWorld);
+
+	char szFile[] = "/tmp/robby-verify-XXXXXX";
+	int fd = mkstemp(szFile);
+	if (fd < 0)
+		Die("Cannot create a temporary world file");
+	FILE* pf = fdopen(fd, "w");
+	VerifyAlloc(pf, "temporary world file");
+	int cx = 4 + RngInt(prng, MAX_WORLD_SIDE - 3);
+	int cy = 4 + RngInt(prng, MAX_WORLD_SIDE - 3);
+	int xRobby = 1 + RngInt(prng, cx - 2);
+	int yRobby = 1 + RngInt(prng, cy - 2);
+	double rWall = RngZeroOne(prng) * 0.3;
+	int x, y;
+	fprintf(pf, "%d %d\n", cx, cy);
+	for (y = 0; y < cy; ++y) {
+		for (x = 0; x < cx; ++x) {
+			char ch = ' ';
+			if (x == xRobby && y == yRobby)
+				ch = 'R';
+			else if (x == 0 || y == 0 || x == cx - 1 || y == cy - 1)
+				ch = 'x';
+			else if (RngZeroOne(prng) < rWall && abs(x - xRobby) + abs(y - yRobby) > 1)
+				ch = 'x';
+			fputc(ch, pf);
+		}
+		fputc('\n', pf);
+	}
+	fclose(pf);
+	WORLD* pwld = WorldCreateFromFile(szFile);
+	unlink(szFile);
+	return pwld;
+}
+
+
+/* Picks a can probability, favoring the edge cases of can placement */
+static double RandomCanProbability(RNG* prng) {
+	switch (RngInt(prng, 6)) {
+	case 0:  return 0.0;
+	case 1:  return 1.0;
+	case 2:  return RngZeroOne(prng) * WORLD_SPARSE_CAN_PROBABILITY;
+	default: return RngZeroOne(prng);
+	}
+}
+
+
+/* Returns whether two worlds have the same cells and Robby position */
+static bool WorldsMatch(WORLD* pwld1, WORLD* pwld2) {
+	int x, y;
+	if (pwld1->xRobby != pwld2->xRobby || pwld1->yRobby != pwld2->yRobby)
+		return false;
+	for (y = 0; y < pwld1->cy; ++y) {
+		for (x = 0; x < pwld1->cx; ++x) {
+			if (WorldGetCell(pwld1, x, y) != WorldGetCell(pwld2, x, y))
+				return false;
+		}
+	}
+	return true;
+}
+
+
+/* Prints a strategy's genes as digits */
+static void PrintGenes(const STRATEGY* pstg) {
+	int iact;
+	for (iact = 0; iact < STRATEGY_LENGTH; ++iact)
+		putchar('0' + StrategyGetAction(pstg, iact));
+	putchar('\n');
+}
+
+
+/* Replays a diverged session one action longer at a time to find the first
+ * action after which the engines disagree, and dumps both worlds there */
+static void ReportSessionDivergence(const ARGS* pArgs, const WORLD* pwldLayout, WORLD* pwldEngine, WORLD* pwldRef,
+                                    const STRATEGY* pstg, uint64_t nMoveSeed) {
+	int cActions;
+	for (cActions = 1; cActions <= pArgs->cSessionActions; ++cActions) {
+		RNG rngEngine, rngRef;
+		RngSeed(&rngEngine, nMoveSeed);
+		RngSeed(&rngRef, nMoveSeed);
+		WorldRestoreLayout(pwldEngine);
+		WorldCopy(pwldLayout, pwldRef);
+		int nEngine = RobbyClean(pArgs, pwldEngine, (STRATEGY*) pstg, cActions, &rngEngine);
+		int nRef = RefRobbyClean(pArgs, pwldRef, pstg, cActions, &rngRef);
+		if (nEngine != nRef || !WorldsMatch(pwldEngine, pwldRef)) {
+			printf("First divergence after action %d: score %d (engine) vs %d (reference)\n",
+				cActions, nEngine, nRef);
+			printf("Engine world:\n");
+			WorldDump(pwldEngine, stdout);
+			printf("Reference world:\n");
+			WorldDump(pwldRef, stdout);
+			return;
+		}
+	}
+	printf("Could not reproduce the divergence action by action\n");
+}
+
+
+/* Runs cTrials random sessions on the engine and the reference, comparing
+ * can layouts, scores and final worlds. The engine's world has undo and cycle
+ * detection enabled and replays each layout twice, as generalization does.
+ * One trial in four gives the engine a lazy world instead, and the reference
+ * the same layout laid out in full. Returns false after reporting the first
+ * divergence. */
+static bool VerifySessions(int cTrials, PCSZ pszWorld, RNG* prng) {
+	int iTrial, iRepeat;
+	STRATEGY* pstg = StrategyAllocArray(1);
+	for (iTrial = 0; iTrial < cTrials; ++iTrial) {
+		ARGS args = k_argsDefault;
+		args.robbyType = RngInt(prng, 2) ? SmartRobby : NormalRobby;
+		args.rCanProbability = RandomCanProbability(prng);
+		args.cSessionActions = 1 + RngInt(prng, 400);
+		StrategyRandomize(pstg, prng);
+		/* Lazy strategies loop sooner, which exercises cycle detection */
+		if (RngInt(prng, 2)) {
+			int iact;
+			for (iact = 0; iact < STRATEGY_LENGTH; ++iact) {
+				if (RngInt(prng, 2))
+					StrategySetAction(pstg, iact, RngInt(prng, 2) ? StayPut : MoveNorth + RngInt(prng, 4));
+			}
+		}
+
+		WORLD* pwld = CreateTrialWorld(pszWorld, prng);
+		WORLD* pwldEngine = WorldCreate(pwld->cx, pwld->cy);
+		WORLD* pwldRef = WorldCreate(pwld->cx, pwld->cy);
+		WORLD* pwldLayout = WorldCreate(pwld->cx, pwld->cy);
+		WorldEnableUndo(pwldEngine, args.cSessionActions);
+		WorldEnableCycleDetection(pwldEngine, args.cSessionActions);
+		bool bLazy = RngInt(prng, 4) == 0;
+		if (bLazy)
+			WorldEnableLazyCans(pwldEngine);
+
+		uint64_t nLayoutSeed = RngNext(prng);
+		RNG rngEngine, rngRef;
+		RngSeed(&rngEngine, nLayoutSeed);
+		RngSeed(&rngRef, nLayoutSeed);
+		WorldCopy(pwld, pwldEngine);
+		WorldSetCansRandomly(pwldEngine, args.rCanProbability, &rngEngine);
+		WorldCopy(pwld, pwldRef);
+		if (bLazy) {
+			int x, y;
+			for (y = 0; y < pwld->cy; ++y) {
+				for (x = 0; x < pwld->cx; ++x)
+					WorldSetCell(pwldRef, x, y, WorldGetCell(pwldEngine, x, y));
+			}
+		} else {
+			RefSetCansRandomly(pwldRef, args.rCanProbability, &rngRef);
+		}
+		WorldCopy(pwldRef, pwldLayout);
+		if (!WorldsMatch(pwldEngine, pwldRef)) {
+			printf("Trial %d: can layouts differ (probability %.17g, seed %llu)\n", iTrial,
+				args.rCanProbability, (unsigned long long)nLayoutSeed);
+			printf("Engine layout:\n");
+			WorldDump(pwldEngine, stdout);
+			printf("Reference layout:\n");
+			WorldDump(pwldRef, stdout);
+			return false;
+		}
+
+		for (iRepeat = 0; iRepeat < 2; ++iRepeat) {
+			uint64_t nMoveSeed = RngNext(prng);
+			if (iRepeat > 0) {
+				WorldRestoreLayout(pwldEngine);
+				WorldCopy(pwldLayout, pwldRef);
+			}
+			RngSeed(&rngEngine, nMoveSeed);
+			RngSeed(&rngRef, nMoveSeed);
+			int nEngine = RobbyClean(&args, pwldEngine, pstg, args.cSessionActions, &rngEngine);
+			int nRef = RefRobbyClean(&args, pwldRef, pstg, args.cSessionActions, &rngRef);
+			if (nEngine != nRef || !WorldsMatch(pwldEngine, pwldRef)) {
+				printf("Trial %d, session %d: score %d (engine) vs %d (reference)\n",
+					iTrial, iRepeat + 1, nEngine, nRef);
+				printf("%s Robby, %d actions, can probability %.17g%s, strategy:\n",
+					args.robbyType == SmartRobby ? "Smart" : "Normal", args.cSessionActions, args.rCanProbability,
+					bLazy ? " (lazy)" : "");
+				PrintGenes(pstg);
+				printf("Layout:\n");
+				WorldDump(pwldLayout, stdout);
+				ReportSessionDivergence(&args, pwldLayout, pwldEngine, pwldRef, pstg, nMoveSeed);
+				return false;
+			}
+		}
+		WorldDestroy(pwldLayout);
+		WorldDestroy(pwldRef);
+		WorldDestroy(pwldEngine);
+		WorldDestroy(pwld);
+	}
+	StrategyFreeArray(pstg);
+	printf("Sessions:    %d trials identical\n", cTrials);
+	return true;
+}
+
+
+/* Compares two populations strategy by strategy; reports the first
+ * difference and returns false if there is one. Fitness is only compared if
+ * bFitness, since freshly bred strategies have none yet. */
+static bool PopulationsMatch(const POPULATION* pPopEngine, const POPULATION* pPopRef, int iGeneration, PCSZ pszStage, bool bFitness) {
+	int istg, iact;
+	for (istg = 0; istg < pPopEngine->cstg; ++istg) {
+		const STRATEGY* pstgEngine = &pPopEngine->rgstg[istg];
+		const STRATEGY* pstgRef = &pPopRef->rgstg[istg];
+		for (iact = 0; iact < STRATEGY_LENGTH; ++iact) {
+			if (StrategyGetAction(pstgEngine, iact) != StrategyGetAction(pstgRef, iact)) {
+				printf("Generation %d, %s: strategy %d differs first at gene %d (%d vs %d)\n",
+					iGeneration, pszStage, istg, iact,
+					StrategyGetAction(pstgEngine, iact), StrategyGetAction(pstgRef, iact));
+				return false;
+			}
+		}
+		if ((bFitness && pstgEngine->rFitness != pstgRef->rFitness) || pstgEngine->istgParent != pstgRef->istgParent) {
+			printf("Generation %d, %s: strategy %d has fitness %.17g, parent %d (engine) vs %.17g, %d (reference)\n",
+				iGeneration, pszStage, istg, pstgEngine->rFitness, pstgEngine->istgParent,
+				pstgRef->rFitness, pstgRef->istgParent);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/* Runs cRuns short evolutions with random parameters on the engine (in
+ * parallel) and the reference (serially), comparing the populations after
+ * every evaluation and every breeding. Returns false after reporting the
+ * first divergence. */
+static bool VerifyEvolution(int cRuns, int cGenerations, PCSZ pszWorld, RNG* prng) {
+	int iRun, iGeneration, i;
+	for (iRun = 0; iRun < cRuns; ++iRun) {
+		ARGS args = k_argsDefault;
+		args.nPopulationSize = 2 + RngInt(prng, 60);
+		args.cSessions = 1 + RngInt(prng, 10);
+		args.cSessionActions = 1 + RngInt(prng, 200);
+		args.rMutationProbability = RngInt(prng, 4) ? RngZeroOne(prng) * 0.05 : RngInt(prng, 2);
+		args.rCanProbability = RandomCanProbability(prng);
+		args.bUseCrossover = RngInt(prng, 4) != 0;
+		args.robbyType = RngInt(prng, 2) ? SmartRobby : NormalRobby;
+		args.nSeed = (int)RngNext(prng);
+		args.cThreads = 1 + RngInt(prng, 4);
+
+		WORLD* pwld = CreateTrialWorld(pszWorld, prng);
+		WORLD* rgpwldScratch[args.cThreads];
+		for (i = 0; i < args.cThreads; ++i) {
+			rgpwldScratch[i] = WorldCreate(pwld->cx, pwld->cy);
+			WorldEnableUndo(rgpwldScratch[i], args.cSessionActions);
+			WorldEnableCycleDetection(rgpwldScratch[i], args.cSessionActions);
+		}
+		WORLD* pwldRef = WorldCreate(pwld->cx, pwld->cy);
+		POPULATION* pPopEngine = PopulationCreate(args.nPopulationSize);
+		POPULATION* pPopEngineNext = PopulationCreate(args.nPopulationSize);
+		POPULATION* pPopRef = PopulationCreate(args.nPopulationSize);
+		POPULATION* pPopRefNext = PopulationCreate(args.nPopulationSize);
+		RNG rngEngine, rngRef;
+		RngSeed(&rngEngine, args.nSeed);
+		RngSeed(&rngRef, args.nSeed);
+		PopulationRandomize(pPopEngine, &rngEngine);
+		PopulationRandomize(pPopRef, &rngRef);
+
+		for (iGeneration = 0; iGeneration < cGenerations; ++iGeneration) {
+			CalculateFitness(&args, pPopEngine, pwld, rgpwldScratch, iGeneration);
+			RefCalculateFitness(&args, pPopRef, pwld, pwldRef, iGeneration);
+			if (!PopulationsMatch(pPopEngine, pPopRef, iGeneration, "evaluation", true))
+				return false;
+			PopulationSortByFitnessInto(pPopEngine, pPopEngineNext, NULL);
+			SwapPointers((void**)&pPopEngine, (void**)&pPopEngineNext);
+			PopulationSortByFitness(pPopRef);
+			EvolveNewPopulation(&args, pPopEngine, pPopEngineNext, &rngEngine);
+			RefEvolveNewPopulation(&args, pPopRef, pPopRefNext, &rngRef);
+			SwapPointers((void**)&pPopEngine, (void**)&pPopEngineNext);
+			SwapPointers((void**)&pPopRef, (void**)&pPopRefNext);
+			if (!PopulationsMatch(pPopEngine, pPopRef, iGeneration, "breeding", false))
+				return false;
+		}
+
+		PopulationDestroy(pPopRefNext);
+		PopulationDestroy(pPopRef);
+		PopulationDestroy(pPopEngineNext);
+		PopulationDestroy(pPopEngine);
+		WorldDestroy(pwldRef);
+		for (i = 0; i < args.cThreads; ++i)
+			WorldDestroy(rgpwldScratch[i]);
+		WorldDestroy(pwld);
+	}
+	printf("Evolution:   %d runs of %d generations identical\n", cRuns, cGenerations);
+	return true;
+}
+
+
+/* Runs cRuns short evolutions with random parameters under delta
+ * evaluation, and after each evaluation reruns every strategy's logged
+ * sessions in full on the reference, comparing every session score and
+ * fitness. Returns false after reporting the first divergence. */
+static bool VerifyDelta(int cRuns, int cGenerations, PCSZ pszWorld, RNG* prng) {
+	int iRun, iGeneration, istg, iSession, i;
+	int64_t cReused = 0, cScored = 0;
+	for (iRun = 0; iRun < cRuns; ++iRun) {
+		ARGS args = k_argsDefault;
+		args.nPopulationSize = 2 + RngInt(prng, 60);
+		args.cSessions = 1 + RngInt(prng, 20);
+		args.cSessionActions = 1 + RngInt(prng, 200);
+		args.rMutationProbability = RngZeroOne(prng) * (RngInt(prng, 2) ? 0.002 : 0.05);
+		args.rCanProbability = RandomCanProbability(prng);
+		args.bUseCrossover = RngInt(prng, 2) != 0;
+		args.robbyType = RngInt(prng, 2) ? SmartRobby : NormalRobby;
+		args.nSeed = (int)RngNext(prng);
+		args.cThreads = 1 + RngInt(prng, 4);
+		args.bDeltaEvaluation = true;
+
+		WORLD* pwld = CreateTrialWorld(pszWorld, prng);
+		WORLD* rgpwldScratch[args.cThreads];
+		for (i = 0; i < args.cThreads; ++i) {
+			rgpwldScratch[i] = WorldCreate(pwld->cx, pwld->cy);
+			WorldEnableUndo(rgpwldScratch[i], args.cSessionActions);
+			WorldEnableCycleDetection(rgpwldScratch[i], args.cSessionActions);
+		}
+		WORLD* pwldRef = WorldCreate(pwld->cx, pwld->cy);
+		POPULATION* pPop = PopulationCreate(args.nPopulationSize);
+		POPULATION* pPopParents = PopulationCreate(args.nPopulationSize);
+		SESSIONLOG* plog = SessionLogCreate(args.nPopulationSize, args.cSessions);
+		SESSIONLOG* plogParents = SessionLogCreate(args.nPopulationSize, args.cSessions);
+		RNG rng;
+		RngSeed(&rng, args.nSeed);
+		PopulationRandomize(pPop, &rng);
+
+		for (iGeneration = 0; iGeneration < cGenerations; ++iGeneration) {
+			bool bParents = iGeneration > 0;
+			cReused += CalculateFitnessDelta(&args, pPop, plog, bParents ? pPopParents : NULL,
+				bParents ? plogParents : NULL, pwld, rgpwldScratch, iGeneration);
+			cScored += (int64_t)pPop->cstg * args.cSessions;
+			for (istg = 0; istg < pPop->cstg; ++istg) {
+				int nScoreSum = 0;
+				for (iSession = 0; iSession < args.cSessions; ++iSession) {
+					RNG rngSession = plog->rgrng[istg * args.cSessions + iSession];
+					WorldCopy(pwld, pwldRef);
+					RefSetCansRandomly(pwldRef, args.rCanProbability, &rngSession);
+					int nRef = RefRobbyClean(&args, pwldRef, &pPop->rgstg[istg], args.cSessionActions, &rngSession);
+					int nDelta = plog->rgnScore[istg * args.cSessions + iSession];
+					if (nRef != nDelta) {
+						printf("Generation %d, delta: strategy %d (parent %d), session %d scored %d (delta) vs %d (reference)\n",
+							iGeneration, istg, pPop->rgstg[istg].istgParent, iSession, nDelta, nRef);
+						return false;
+					}
+					nScoreSum += nRef;
+				}
+				if (pPop->rgstg[istg].rFitness != (double)nScoreSum / (double)args.cSessions) {
+					printf("Generation %d, delta: strategy %d has fitness %.17g (delta) vs %.17g (reference)\n",
+						iGeneration, istg, pPop->rgstg[istg].rFitness, (double)nScoreSum / (double)args.cSessions);
+					return false;
+				}
+			}
+			SessionLogSortPopulation(plog, pPop, pPopParents);
+			SwapPointers((void**)&pPop, (void**)&pPopParents);
+			EvolveNewPopulation(&args, pPop, pPopParents, &rng);
+			SwapPointers((void**)&pPop, (void**)&pPopParents);
+			SwapPointers((void**)&plog, (void**)&plogParents);
+		}
+
+		SessionLogDestroy(plogParents);
+		SessionLogDestroy(plog);
+		PopulationDestroy(pPopParents);
+		PopulationDestroy(pPop);
+		WorldDestroy(pwldRef);
+		for (i = 0; i < args.cThreads; ++i)
+			WorldDestroy(rgpwldScratch[i]);
+		WorldDestroy(pwld);
+	}
+	printf("Delta:       %d runs of %d generations identical (%.1f%% of sessions reused)\n",
+		cRuns, cGenerations, cScored ? 100.0 * cReused / cScored : 0.0);
+	return true;
+}
+
+
+/* Program entry point */
+int main(int argc, char** argv) {
+	int cTrials = DEFAULT_TRIALS;
+	int cRuns = DEFAULT_RUNS;
+	int cGenerations = DEFAULT_GENERATIONS;
+	int nSeed = k_argsDefault.nSeed;
+	PCSZ pszWorld = NULL;
+	int ch;
+
+	opterr = 0;
+	while ((ch = getopt(argc, argv, "n:p:g:r:w:h")) != -1) {
+		switch (ch) {
+		case 'n':
+			cTrials = atoi(optarg);
+			break;
+		case 'p':
+			cRuns = atoi(optarg);
+			break;
+		case 'g':
+			cGenerations = atoi(optarg);
+			break;
+		case 'r':
+			nSeed = atoi(optarg);
+			break;
+		case 'w':
+			pszWorld = optarg;
+			break;
+		case 'h':
+			Usage();
+			exit(EXIT_SUCCESS);
+			break;
+		default:
+			fprintf(stderr, "Unknown option or missing argument: -%c\n", optopt);
+			Usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	printf("# Neighborhood: %s (%d states), seed %d\n", NEIGHBORHOOD_NAME, STRATEGY_LENGTH, nSeed);
+	RNG rng;
+	RngSeed(&rng, nSeed);
+	if (!VerifySessions(cTrials, pszWorld, &rng) || !VerifyEvolution(cRuns, cGenerations, pszWorld, &rng) ||
+	    !VerifyDelta(cRuns, cGenerations, pszWorld, &rng))
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
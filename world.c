@@ -24,16 +24,108 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
  *****************************************************************************/
+#include <math.h>   /* floor */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h> /* memcpy */
 #include "types.h"
 #include "error.h"
 #include "parse.h"
+#include "rng.h"
 #include "strategy.h"
 #include "world.h"
 
 
+/* Lazy worlds decide open cell i from step i of a SplitMix stream seeded
+ * with the layout seed, so no cell's can depends on any other cell's */
+#define WORLD_LAZY_CAN_STEP	0x9e3779b97f4a7c15ULL
+
+/* Longest line of a world file, and so its largest dimensions */
+#define WORLD_MAX_LINE_LENGTH	4096
+
+
+#ifndef NEIGHBORHOOD_VON_NEUMANN
+/* Offsets of the cells Robby perceives, in state digit order: current,
+ * north, south, west and east, then the rest of the neighborhood */
+static const int k_rgdxView[NEIGHBORHOOD_CELLS] = {
+	0, 0, 0, -1, 1,
+#if defined(NEIGHBORHOOD_MOORE)
+	-1, 1, -1, 1
+#else
+	0, 0, -2, 2, -1, 1, -1, 1
+#endif
+};
+static const int k_rgdyView[NEIGHBORHOOD_CELLS] = {
+	0, -1, 1, 0, 0,
+#if defined(NEIGHBORHOOD_MOORE)
+	-1, -1, 1, 1
+#else
+	-2, 2, 0, 0, -1, -1, 1, 1
+#endif
+};
+
+
+/* Precomputes, for every cell, the indices of the cells Robby perceives from
+ * it. Cells beyond the edge of the grid are the wall sentinel. Worlds copied
+ * from this one with WorldCopy share the table. */
+static void WorldIndexView(WORLD* pwld) {
+	ASSERT(pwld && !pwld->bOwnsView);
+	uint cCells = pwld->cx * pwld->cy;
+	pwld->rgicellView = (uint*) malloc(sizeof(uint) * cCells * NEIGHBORHOOD_CELLS);
+	VerifyAlloc(pwld->rgicellView, "view table (%d cells)", cCells);
+	pwld->bOwnsView = true;
+	int x, y, k;
+	for (y = 0; y < pwld->cy; ++y) {
+		for (x = 0; x < pwld->cx; ++x) {
+			uint* rgicell = &pwld->rgicellView[(y * pwld->cx + x) * NEIGHBORHOOD_CELLS];
+			for (k = 0; k < NEIGHBORHOOD_CELLS; ++k) {
+				int xView = x + k_rgdxView[k], yView = y + k_rgdyView[k];
+				if (xView < 0 || yView < 0 || xView >= (int)pwld->cx || yView >= (int)pwld->cy)
+					rgicell[k] = cCells;
+				else
+					rgicell[k] = yView * pwld->cx + xView;
+			}
+		}
+	}
+}
+#endif
+
+
+/* Returns the slot of a lazy world's taken set that holds icell, or the empty
+ * slot where it would go */
+static uint WorldTakenSlot(const WORLD* pwld, uint icell) {
+	const uint nMask = pwld->cTakenSlots - 1;
+	uint islot = (uint)(((uint64_t)icell * WORLD_LAZY_CAN_STEP) >> 32) & nMask;
+	while (pwld->rgicellTaken[islot] != 0 && pwld->rgicellTaken[islot] != icell + 1)
+		islot = (islot + 1) & nMask;
+	return islot;
+}
+
+
+/* Returns the cell with index icell. In a lazy world (bLazy, which callers
+ * pass as a constant so that the test folds away), an open cell holds a can
+ * if its hash is below the quantized can probability (the same chance
+ * WorldSetCansRandomly gives it) and the can has not been taken. */
+static inline CELL WorldCellAt(const WORLD* pwld, uint icell, bool bLazy) {
+	CELL cell = pwld->cells[icell];
+	if (bLazy && cell == CELL_OPEN &&
+	    (RngHash(pwld->nCanSeed + (uint64_t)icell * WORLD_LAZY_CAN_STEP) >> 32) < pwld->nCanThreshold &&
+	    pwld->rgicellTaken[WorldTakenSlot(pwld, icell)] == 0)
+		cell = CELL_CAN;
+	return cell;
+}
+
+
+/* Empties a lazy world's taken set. Cells come out in the reverse of the
+ * order they went in, so every probe run is intact when it is walked. */
+static void WorldForgetTaken(WORLD* pwld) {
+	uint i = pwld->cUndo;
+	while (i-- > 0)
+		pwld->rgicellTaken[WorldTakenSlot(pwld, pwld->rgicellUndo[i])] = 0;
+	pwld->cUndo = 0;
+}
+
+
 /* Allocates a new WORLD of given size. Does not set contents. */
 WORLD* WorldCreate(uint cx, uint cy) {
 	ASSERT(cx > 0 && cy > 0);
@@ -41,43 +133,69 @@ WORLD* WorldCreate(uint cx, uint cy) {
 	VerifyAlloc(pwld, "world");
 	pwld->cx = cx;
 	pwld->cy = cy;
-	pwld->cells = (CELL*) malloc(sizeof(CELL) * cx * cy);
+	pwld->cells = (CELL*) malloc(sizeof(CELL) * (cx * cy + 1));
 	VerifyAlloc(pwld->cells, "world cells (%dx%d)", cx, cy);
+	pwld->cells[cx * cy] = CELL_WALL;
+	pwld->rgicellOpen = NULL;
+	pwld->ccellOpen = 0;
+	pwld->bOwnsOpenCells = false;
+	pwld->rgicellUndo = NULL;
+	pwld->cUndo = 0;
+	pwld->maxUndo = 0;
+	pwld->xRobby = pwld->xStart = 0;
+	pwld->yRobby = pwld->yStart = 0;
+	pwld->bLazyCans = false;
+	pwld->nCanSeed = pwld->nCanThreshold = 0;
+	pwld->rgicellTaken = NULL;
+	pwld->cTakenSlots = 0;
+	pwld->rgnVisit = NULL;
+	pwld->nStampNext = 0;
+	pwld->maxSteps = 0;
+	pwld->rgnScoreAt = NULL;
+	pwld->rgicellAt = NULL;
+	pwld->rgnSeen = NULL;
+	pwld->cActionsRun = pwld->cActionsSkipped = 0;
+#ifdef INSTRUMENT
+	memset(&pwld->cnt, 0, sizeof(pwld->cnt));
+#endif
+#ifndef NEIGHBORHOOD_VON_NEUMANN
+	pwld->rgicellView = NULL;
+	pwld->bOwnsView = false;
+#endif
 	return pwld;
 }
 
 
-/* Loads a world from a text file */
-WORLD* WorldCreateFromFile(PCSZ pszFilename) {
-	ASSERT(pszFilename);
+/* Builds the list of open cells used for can placement. Worlds copied from
+ * this one with WorldCopy share the list. */
+static void WorldIndexOpenCells(WORLD* pwld) {
+	ASSERT(pwld && !pwld->bOwnsOpenCells);
+	uint icell, cCells = pwld->cx * pwld->cy;
 
-	FILE* pf = fopen(pszFilename, "r");
-	if (!pf)
-		Die("Cannot open '%s'", pszFilename);
-
-	unsigned int cx, cy;
-	const int MAX_LINE_LENGTH = 4096;
-	char szLine[MAX_LINE_LENGTH + 1];
-	char const* pszCur = szLine;
-	WORLD* pwld;
+	pwld->rgicellOpen = (uint*) malloc(sizeof(uint) * cCells);
+	VerifyAlloc(pwld->rgicellOpen, "open cell list (%d cells)", cCells);
+	pwld->bOwnsOpenCells = true;
+	pwld->ccellOpen = 0;
+	for (icell = 0; icell < cCells; ++icell) {
+		if (pwld->cells[icell] == CELL_OPEN)
+			pwld->rgicellOpen[pwld->ccellOpen++] = icell;
+	}
+}
 
-	/* read first line (dimensions of map) */
-	if (fgets(szLine, MAX_LINE_LENGTH, pf) != szLine)
-		Die("Error reading first line from '%s' -- file too short?", pszFilename);
-	if (!(ParseUInt(&pszCur, &cx) && ParseUInt(&pszCur, &cy)))
-		Die("Malformed first line in '%s'", pszFilename);
-	if (cx > MAX_LINE_LENGTH || cy > MAX_LINE_LENGTH)
-		Die("World too big (maximum dimensions: %d square)", MAX_LINE_LENGTH);
-
-	pwld = WorldCreate(cx, cy);
-	/* Debug("Creating world %d x %d", cx, cy); */
 
+/* Reads the rows of a world file into pwld; returns false, with the reason
+ * in szError, if they are short, hold an unknown character or have no
+ * Robby */
+static bool WorldReadRows(WORLD* pwld, FILE* pf, PCSZ pszFilename, char* szError, size_t cchError) {
+	char szLine[WORLD_MAX_LINE_LENGTH + 1];
 	int x, y;
 	bool bGotRobby = false;
 	for (y = 0; y < pwld->cy; ++y) {
-		if (fgets(szLine, MAX_LINE_LENGTH, pf) != szLine)
-			Die("Error reading from '%s' -- file too short?", pszFilename);
-		pszCur = szLine;
+		if (fgets(szLine, WORLD_MAX_LINE_LENGTH, pf) != szLine) {
+			snprintf(szError, cchError, "Error reading from '%s' -- file too short?", pszFilename);
+			return false;
+		}
+		char const* pszCur = szLine;
 		for (x = 0; x < pwld->cx; ++x) {
 			CELL cell;
 			switch (*pszCur) {
@@ -90,17 +208,98 @@ WORLD* WorldCreateFromFile(PCSZ pszFilename) {
 				bGotRobby = true;
 				break;
 			default:
-				cell = CELL_OPEN; /* Silence "uninitialized" warning */
-				Die("%s (%d,%d): Unknown character '%c' in world",
+				snprintf(szError, cchError, "%s (%d,%d): Unknown character '%c' in world",
 					pszFilename, y + 1, x, *pszCur);
+				return false;
 			}
 			WorldSetCell(pwld, x, y, cell);
 			++pszCur;
 		}
 	}
+	if (!bGotRobby) {
+		snprintf(szError, cchError, "World %s contains no Robby start position (R) cell", pszFilename);
+		return false;
+	}
+	return true;
+}
+
+
+/* Loads a world from a text file. Returns NULL, with the reason in szError,
+ * if the file cannot be read or is not a world, so that a server can refuse
+ * a job naming a bad world and carry on. */
+WORLD* WorldLoad(PCSZ pszFilename, char* szError, size_t cchError) {
+	ASSERT(pszFilename && szError && cchError > 0);
+
+	FILE* pf = fopen(pszFilename, "r");
+	if (!pf) {
+		snprintf(szError, cchError, "Cannot open '%s'", pszFilename);
+		return NULL;
+	}
+
+	/* read first line (dimensions of map) */
+	unsigned int cx, cy;
+	char szLine[WORLD_MAX_LINE_LENGTH + 1];
+	char const* pszCur = szLine;
+	bool bOk = false;
+	if (fgets(szLine, WORLD_MAX_LINE_LENGTH, pf) != szLine)
+		snprintf(szError, cchError, "Error reading first line from '%s' -- file too short?", pszFilename);
+	else if (!(ParseUInt(&pszCur, &cx) && ParseUInt(&pszCur, &cy)) || cx == 0 || cy == 0)
+		snprintf(szError, cchError, "Malformed first line in '%s'", pszFilename);
+	else if (cx > WORLD_MAX_LINE_LENGTH || cy > WORLD_MAX_LINE_LENGTH)
+		snprintf(szError, cchError, "World too big (maximum dimensions: %d square)", WORLD_MAX_LINE_LENGTH);
+	else
+		bOk = true;
+	if (!bOk) {
+		fclose(pf);
+		return NULL;
+	}
+
+	WORLD* pwld = WorldCreate(cx, cy);
+	/* Debug("Creating world %d x %d", cx, cy); */
+	bOk = WorldReadRows(pwld, pf, pszFilename, szError, cchError);
 	fclose(pf);
-	if (!bGotRobby)
-		Die("World %s contains no Robby start position (R) cell", pszFilename);
+	if (!bOk) {
+		WorldDestroy(pwld);
+		return NULL;
+	}
+	pwld->xStart = pwld->xRobby;
+	pwld->yStart = pwld->yRobby;
+	WorldIndexOpenCells(pwld);
+#ifndef NEIGHBORHOOD_VON_NEUMANN
+	WorldIndexView(pwld);
+#endif
+	return pwld;
+}
+
+
+/* Loads a world from a text file; dies if it cannot */
+WORLD* WorldCreateFromFile(PCSZ pszFilename) {
+	char szError[512];
+	WORLD* pwld = WorldLoad(pszFilename, szError, sizeof(szError));
+	if (!pwld)
+		Die("%s", szError);
+	return pwld;
+}
+
+
+/* Allocates an independent copy of a world, including its open cell list and
+ * view table */
+WORLD* WorldClone(WORLD const* pwldSource) {
+	ASSERT(pwldSource && !pwldSource->bLazyCans);
+	WORLD* pwld = WorldCreate(pwldSource->cx, pwldSource->cy);
+	WorldCopy(pwldSource, pwld);
+	pwld->xStart = pwldSource->xStart;
+	pwld->yStart = pwldSource->yStart;
+	if (pwldSource->rgicellOpen) {
+		pwld->rgicellOpen = (uint*) malloc(sizeof(uint) * pwld->ccellOpen);
+		VerifyAlloc(pwld->rgicellOpen, "open cell list (%d cells)", pwld->ccellOpen);
+		memcpy(pwld->rgicellOpen, pwldSource->rgicellOpen, sizeof(uint) * pwld->ccellOpen);
+		pwld->bOwnsOpenCells = true;
+	}
+#ifndef NEIGHBORHOOD_VON_NEUMANN
+	if (pwldSource->rgicellView)
+		WorldIndexView(pwld);
+#endif
 	return pwld;
 }
 
@@ -108,7 +307,19 @@ WORLD* WorldCreateFromFile(PCSZ pszFilename) {
 /* Deallocates a WORLD allocated with World_Create. */
 void WorldDestroy(WORLD* pwld) {
 	ASSERT(pwld);
-	free(pwld->cells);
+	if (pwld->bOwnsOpenCells)
+		free(pwld->rgicellOpen);
+	free(pwld->rgicellUndo);
+	free(pwld->rgicellTaken);
+	free(pwld->rgnVisit);
+	free(pwld->rgnScoreAt);
+	free(pwld->rgicellAt);
+#ifndef NEIGHBORHOOD_VON_NEUMANN
+	if (pwld->bOwnsView)
+		free(pwld->rgicellView);
+#endif
+	if (!pwld->bLazyCans)
+		free(pwld->cells);
 	free(pwld);
 }
 
@@ -140,7 +351,9 @@ void WorldDump(WORLD* pwld, FILE* out) {
 }
 
 
-/* Copies the contents of first world to the second */
+/* Copies the contents of first world to the second. The target borrows the
+ * source's open cell list and view table, and a lazy target its cells too,
+ * so the source must outlive its use and must not change. */
 void WorldCopy(WORLD const* pwldSource, WORLD* pwldTarget) {
 	ASSERT(pwldSource && pwldTarget);
 	ASSERT(pwldSource->cx == pwldTarget->cx);
@@ -148,43 +361,243 @@ void WorldCopy(WORLD const* pwldSource, WORLD* pwldTarget) {
 	ASSERT(pwldSource->xRobby < pwldSource->cx);
 	ASSERT(pwldSource->yRobby < pwldSource->cy);
 	ASSERT(pwldSource != pwldTarget);
-	ASSERT(pwldSource->cells != pwldTarget->cells);
+	ASSERT(!pwldSource->bLazyCans);
+
+	ASSERT(!pwldTarget->bOwnsOpenCells);
+#ifndef NEIGHBORHOOD_VON_NEUMANN
+	ASSERT(!pwldTarget->bOwnsView);
+#endif
 
 	int cCells = pwldTarget->cx * pwldTarget->cy;
 	pwldTarget->xRobby = pwldSource->xRobby;
 	pwldTarget->yRobby = pwldSource->yRobby;
-	memcpy(pwldTarget->cells, pwldSource->cells, sizeof(CELL) * cCells);
+	if (pwldTarget->bLazyCans) {
+		WorldForgetTaken(pwldTarget);
+		pwldTarget->cells = pwldSource->cells;
+	} else {
+		ASSERT(pwldSource->cells != pwldTarget->cells);
+		memcpy(pwldTarget->cells, pwldSource->cells, sizeof(CELL) * cCells);
+	}
+	pwldTarget->rgicellOpen = pwldSource->rgicellOpen;
+	pwldTarget->ccellOpen = pwldSource->ccellOpen;
+#ifndef NEIGHBORHOOD_VON_NEUMANN
+	pwldTarget->rgicellView = pwldSource->rgicellView;
+#endif
+	pwldTarget->xStart = pwldSource->xRobby;
+	pwldTarget->yStart = pwldSource->yRobby;
+	pwldTarget->cUndo = 0;
 }
 
 
-/* Sets cans randomly in open spots in a world.
- * rProbability: Chance (0-1) of a can in each position (used to
- *               the hundredths of a percent) */
-void WorldSetCansRandomly(WORLD* pwld, double rProbability) {
-	ASSERT(pwld);
-	ASSERT(rProbability >= 0.0 && rProbability <= 1.0);
+/* Sparse can placement: decides 64 open cells at a time, each holding a can
+ * if its own 32-bit random number is below nThreshold. The numbers are drawn
+ * one bit plane at a time from the most significant bit down, and a cell is
+ * settled by the first bit that differs from the threshold's, so a low
+ * probability settles the whole block after a few planes. The chance is
+ * nThreshold / 2^32 exactly. */
+static void WorldSetCansSparse(WORLD* pwld, uint32_t nThreshold, RNG* prng) {
+	ASSERT(nThreshold != 0);
+	const int ibitLow = __builtin_ctz(nThreshold);
+	uint iOpen;
+	for (iOpen = 0; iOpen < pwld->ccellOpen; iOpen += 64) {
+		uint64_t nUndecided = ~0ULL, nMask = 0;
+		if (pwld->ccellOpen - iOpen < 64)
+			nUndecided = (1ULL << (pwld->ccellOpen - iOpen)) - 1;
+		int ibit;
+		/* Cells still equal to the threshold past its lowest set bit are
+		 * above it whatever follows */
+		for (ibit = 31; ibit >= ibitLow && nUndecided; --ibit) {
+			uint64_t nRandom = RngNext(prng);
+			if (nThreshold & (1u << ibit)) {
+				nMask |= nUndecided & ~nRandom;
+				nUndecided &= nRandom;
+			} else {
+				nUndecided &= ~nRandom;
+			}
+		}
+		while (nMask) {
+			pwld->cells[pwld->rgicellOpen[iOpen + __builtin_ctzll(nMask)]] = CELL_CAN;
+			nMask &= nMask - 1;
+		}
+	}
+}
+
 
-	int i, max = pwld->cx * pwld->cy;
-	double rChance = rProbability * 10000.0;
-	CELL* pcell = pwld->cells;
-	for (i = 0; i < max; ++i) {
-		if (*pcell == CELL_OPEN) {
-			double rMaybe = (double)(rand() % 10000);
-			if (rMaybe < rChance)
-				*pcell = CELL_CAN;
+/* Dense can placement: draws a 64-bit mask per 64 open cells in which each
+ * bit is set with probability nThreshold / 2^32 exactly. The mask is built
+ * from the binary expansion of the probability, least significant bit first:
+ * OR-ing in a fresh random word maps probability q to 1/2 + q/2, AND-ing
+ * maps it to q/2. */
+static void WorldSetCansDense(WORLD* pwld, uint32_t nThreshold, RNG* prng) {
+	ASSERT(nThreshold != 0);
+	const int ibitLow = __builtin_ctz(nThreshold);
+	uint iOpen;
+	for (iOpen = 0; iOpen < pwld->ccellOpen; iOpen += 64) {
+		uint64_t nMask = 0;
+		int ibit;
+		for (ibit = ibitLow; ibit < 32; ++ibit) {
+			if (nThreshold & (1u << ibit))
+				nMask |= RngNext(prng);
+			else
+				nMask &= RngNext(prng);
 		}
-		pcell++;
+		if (pwld->ccellOpen - iOpen < 64)
+			nMask &= (1ULL << (pwld->ccellOpen - iOpen)) - 1;
+		while (nMask) {
+			pwld->cells[pwld->rgicellOpen[iOpen + __builtin_ctzll(nMask)]] = CELL_CAN;
+			nMask &= nMask - 1;
+		}
+	}
+}
+
+
+/* Sets cans randomly in open spots in a world. The world must be a fresh
+ * WorldCopy of a world loaded from a file (every listed open cell is still
+ * open). A lazy world only draws a layout seed here; its cells are decided
+ * as they are looked at.
+ * rProbability: Chance (0-1) of a can in each position (used to 32 bits
+ *               of precision) */
+void WorldSetCansRandomly(WORLD* pwld, double rProbability, RNG* prng) {
+	ASSERT(pwld && prng);
+	ASSERT(rProbability >= 0.0 && rProbability <= 1.0);
+	ASSERT(pwld->rgicellOpen || pwld->ccellOpen == 0);
+
+	/* Quantize to a 32-bit fixed-point probability, which every placement
+	 * method then honors exactly */
+	double rThreshold = floor(rProbability * 4294967296.0 + 0.5);
+	uint iOpen;
+	if (pwld->bLazyCans) {
+		pwld->nCanSeed = RngNext(prng);
+		pwld->nCanThreshold = (uint64_t)rThreshold;
+	} else if (rThreshold >= 4294967296.0) {
+		for (iOpen = 0; iOpen < pwld->ccellOpen; ++iOpen)
+			pwld->cells[pwld->rgicellOpen[iOpen]] = CELL_CAN;
+	} else if (rThreshold <= 0.0) {
+		return;
+	} else if (rProbability < WORLD_SPARSE_CAN_PROBABILITY) {
+		WorldSetCansSparse(pwld, (uint32_t)rThreshold, prng);
+	} else {
+		WorldSetCansDense(pwld, (uint32_t)rThreshold, prng);
 	}
 }
 
 
+/* Makes the world log every can removed with WorldRemoveCan, so that the
+ * layout can later be put back with WorldRestoreLayout. maxUndo bounds the
+ * removals between restores; a session can never pick up more cans than it
+ * has actions. */
+void WorldEnableUndo(WORLD* pwld, uint maxUndo) {
+	ASSERT(pwld && maxUndo > 0);
+	ASSERT(!pwld->bLazyCans); /* The taken set is sized for the log */
+	free(pwld->rgicellUndo);
+	pwld->rgicellUndo = (uint*) malloc(sizeof(uint) * maxUndo);
+	VerifyAlloc(pwld->rgicellUndo, "world undo log (%d entries)", maxUndo);
+	pwld->maxUndo = maxUndo;
+	pwld->cUndo = 0;
+}
+
+
+/* Makes the world decide cans only where Robby looks, for worlds too large
+ * to lay out in full before every session: WorldCopy then borrows the
+ * template's cells, WorldSetCansRandomly only draws a seed, and taken cans
+ * go in a small hash set, so a session costs time in proportion to its
+ * length rather than to the world's area. Undo must be enabled first; its log
+ * doubles as the list of taken cans, so WorldRestoreLayout works as usual. */
+void WorldEnableLazyCans(WORLD* pwld) {
+	ASSERT(pwld && pwld->rgicellUndo && !pwld->bLazyCans);
+	uint cSlots = 16;
+	while (cSlots < 2 * pwld->maxUndo)
+		cSlots *= 2;
+	pwld->rgicellTaken = (uint*) calloc(cSlots, sizeof(uint));
+	VerifyAlloc(pwld->rgicellTaken, "taken can set (%d slots)", cSlots);
+	pwld->cTakenSlots = cSlots;
+	free(pwld->cells);
+	pwld->cells = NULL;
+	pwld->bLazyCans = true;
+	pwld->cUndo = 0;
+}
+
+
+/* Removes the can at given coordinates, logging it if undo is enabled */
+void WorldRemoveCan(WORLD* pwld, int x, int y) {
+	ASSERT(WorldGetCell(pwld, x, y) == CELL_CAN);
+	uint icell = y * pwld->cx + x;
+	if (pwld->bLazyCans)
+		pwld->rgicellTaken[WorldTakenSlot(pwld, icell)] = icell + 1;
+	else
+		pwld->cells[icell] = CELL_OPEN;
+	if (pwld->rgicellUndo) {
+		if (pwld->cUndo >= pwld->maxUndo)
+			Die("World undo log overflow (%d entries)", pwld->maxUndo);
+		pwld->rgicellUndo[pwld->cUndo++] = icell;
+	}
+}
+
+
+/* Puts back every can removed since the layout was set (by WorldCopy and
+ * WorldSetCansRandomly) and returns Robby to his start position. Touches
+ * only the logged cells, so it is much cheaper than a WorldCopy on large
+ * worlds. */
+void WorldRestoreLayout(WORLD* pwld) {
+	ASSERT(pwld && pwld->rgicellUndo);
+	uint i;
+	if (pwld->bLazyCans) {
+		WorldForgetTaken(pwld);
+	} else {
+		for (i = 0; i < pwld->cUndo; ++i)
+			pwld->cells[pwld->rgicellUndo[i]] = CELL_CAN;
+	}
+	pwld->cUndo = 0;
+	pwld->xRobby = pwld->xStart;
+	pwld->yRobby = pwld->yStart;
+}
+
+
+/* Allocates the session trace RobbyClean uses to detect when Robby is stuck
+ * in a loop, for sessions of up to maxSteps actions */
+void WorldEnableCycleDetection(WORLD* pwld, uint maxSteps) {
+	ASSERT(pwld && maxSteps > 0);
+	uint cCells = pwld->cx * pwld->cy;
+	free(pwld->rgnVisit);
+	free(pwld->rgnScoreAt);
+	free(pwld->rgicellAt);
+	pwld->rgnVisit = (uint*) calloc(cCells, sizeof(uint));
+	VerifyAlloc(pwld->rgnVisit, "visit stamps (%d cells)", cCells);
+	pwld->rgnScoreAt = (int*) malloc(sizeof(int) * maxSteps);
+	VerifyAlloc(pwld->rgnScoreAt, "score trace (%d steps)", maxSteps);
+	pwld->rgicellAt = (uint*) malloc(sizeof(uint) * maxSteps);
+	VerifyAlloc(pwld->rgicellAt, "position trace (%d steps)", maxSteps);
+	pwld->maxSteps = maxSteps;
+	pwld->nStampNext = 0;
+}
+
+
+/* Starts a new session trace of up to cSteps steps. Returns the stamp base:
+ * step i of the session stamps visited cells with base + i + 1, and every
+ * stamp left by an earlier session is <= base, so the visit array never
+ * needs clearing (except when the stamps wrap around). */
+uint WorldBeginTrace(WORLD* pwld, uint cSteps) {
+	ASSERT(pwld && pwld->rgnVisit);
+	ASSERT(cSteps <= pwld->maxSteps);
+	if (pwld->nStampNext > UINT32_MAX - cSteps) {
+		memset(pwld->rgnVisit, 0, sizeof(uint) * pwld->cx * pwld->cy);
+		pwld->nStampNext = 0;
+	}
+	uint nBase = pwld->nStampNext;
+	pwld->nStampNext += cSteps;
+	return nBase;
+}
+
+
 /* Returns cell at given coordinates */
 CELL WorldGetCell(WORLD* pwld, int x, int y) {
 	ASSERT(pwld);
 	ASSERT(x >= 0 && y >= 0);
 	ASSERT(x < pwld->cx && y < pwld->cy);
 	ASSERT_CELL(pwld->cells[y * pwld->cx + x]);
-	return pwld->cells[y * pwld->cx + x];
+	if (pwld->bLazyCans)
+		return WorldCellAt(pwld, y * pwld->cx + x, true);
+	return WorldCellAt(pwld, y * pwld->cx + x, false);
 }
 
 
@@ -194,29 +607,32 @@ void WorldSetCell(WORLD* pwld, int x, int y, CELL cell) {
 	ASSERT(x >= 0 && y >= 0);
 	ASSERT(x < pwld->cx && y < pwld->cy);
 	ASSERT_CELL(cell);
+	ASSERT(!pwld->bLazyCans);
 	pwld->cells[y * pwld->cx + x] = cell;
 }
 
 
-/* Gets STATE for the cell at given coordinates */
-STATE WorldGetState(WORLD* pwld, int x, int y) {
-	ASSERT(pwld);
+/* Gets STATE for the cell at given coordinates, reading the cells as a lazy
+ * world does if bLazy (a constant in both callers) */
+static inline STATE WorldStateAt(const WORLD* pwld, int x, int y, bool bLazy) {
 	/* coordinates must not be on an edge */
 	ASSERT(x >= 1 && y >= 1);
 	ASSERT(x < (pwld->cx - 1) && y < (pwld->cy - 1));
 
+	const uint icell = y * pwld->cx + x;
 	STATE s;
-	s.current = WorldGetCell(pwld, x, y);
-	s.north   = WorldGetCell(pwld, x, y - 1);
-	s.south   = WorldGetCell(pwld, x, y + 1);
-	s.west    = WorldGetCell(pwld, x - 1, y);
-	s.east    = WorldGetCell(pwld, x + 1, y);
+	s.current = WorldCellAt(pwld, icell, bLazy);
+	s.north   = WorldCellAt(pwld, icell - pwld->cx, bLazy);
+	s.south   = WorldCellAt(pwld, icell + pwld->cx, bLazy);
+	s.west    = WorldCellAt(pwld, icell - 1, bLazy);
+	s.east    = WorldCellAt(pwld, icell + 1, bLazy);
 	ASSERT(s.current != CELL_INVALID &&
            s.north   != CELL_INVALID &&
            s.south   != CELL_INVALID &&
            s.east    != CELL_INVALID &&
            s.west    != CELL_INVALID);
 
+#ifdef NEIGHBORHOOD_VON_NEUMANN
 	/* Treat STATE values as place-values for a base-3 number so as to
 	 * generate contiguous indices with all possible STATE combinations. */
 	unsigned int index =
@@ -225,16 +641,39 @@ STATE WorldGetState(WORLD* pwld, int x, int y) {
 		s.south *  9 +
 		s.north *  3 +
 		s.current;
+#else
+	/* The same base-3 number, over every perceived cell */
+	const uint* rgicell = &pwld->rgicellView[icell * NEIGHBORHOOD_CELLS];
+	unsigned int index = 0;
+	int k;
+	for (k = NEIGHBORHOOD_CELLS - 1; k >= 0; --k)
+		index = index * 3 + WorldCellAt(pwld, rgicell[k], bLazy);
+#endif
 	ASSERT(index < STRATEGY_LENGTH);
 	s.index = index;
 	return s;
 }
 
 
+/* Gets STATE for the cell at given coordinates of a world without lazy cans */
+STATE WorldGetState(WORLD* pwld, int x, int y) {
+	ASSERT(pwld && !pwld->bLazyCans);
+	return WorldStateAt(pwld, x, y, false);
+}
+
+
+/* Gets STATE for the cell at given coordinates of a world with lazy cans */
+STATE WorldGetStateLazy(WORLD* pwld, int x, int y) {
+	ASSERT(pwld && pwld->bLazyCans);
+	return WorldStateAt(pwld, x, y, true);
+}
+
+
 /* Translates an action index into a State value */
 STATE WorldGetStateFromIndex(int index) {
 	ASSERT(index >= 0 && index < STRATEGY_LENGTH);
 
+	/* The low five base-3 digits are the named cells, in every neighborhood */
 	STATE s;
 	s.east    = (index / 81) % 3;
 	s.west    = (index / 27) % 3;
@@ -254,7 +693,7 @@ STATE WorldGetStateFromIndex(int index) {
 		s.south *  9 +
 		s.north *  3 +
 		s.current;
-	ASSERT(check == index);
+	ASSERT(check == index % 243);
 #endif
 	return s;
 }
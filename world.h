@@ -20,6 +20,10 @@
  *
  *****************************************************************************/
 #pragma once
+#include <stdio.h>
+#include "rng.h"
+#include "instrument.h"
+#include "neighborhood.h"
 
 typedef uint8_t CELL;
 #define CELL_OPEN	0
@@ -29,19 +33,65 @@ typedef uint8_t CELL;
 #define ASSERT_CELL(cell)	ASSERT((cell) != CELL_INVALID && (cell) < 4)
 
 
+/* Can densities below this are placed by settling 64-cell bit masks from the
+ * probability's top bit down; at or above it, by building them from its
+ * lowest set bit up */
+#define WORLD_SPARSE_CAN_PROBABILITY	0.25
+
+/* Masks of the states a session acted in have one bit per state, modulo this;
+ * the default neighborhood's 243 states each get their own */
+#define WORLD_SEEN_BITS		256
+#define WORLD_SEEN_WORDS	(WORLD_SEEN_BITS / 64)
+
+
 typedef struct {
 	uint  cx;
 	uint  cy;
 	uint  xRobby;
 	uint  yRobby;
-	CELL* cells;
+	CELL* cells;          /* cx * cy cells, then a wall sentinel */
+	uint* rgicellOpen;    /* Indices of the open cells (cans may go here) */
+	uint  ccellOpen;
+	bool  bOwnsOpenCells; /* False if rgicellOpen is borrowed from a template */
+	uint* rgicellUndo;    /* Cans picked up since the layout was set, if logging */
+	uint  cUndo;
+	uint  maxUndo;
+	uint  xStart;         /* Robby's position when the layout was set */
+	uint  yStart;
+
+	/* Lazy can placement, if enabled: cells is borrowed from the template
+	 * and holds no cans, and the undo log lists the cans taken so far */
+	bool  bLazyCans;
+	uint64_t nCanSeed;      /* Layout seed that decides each open cell */
+	uint64_t nCanThreshold; /* Can probability, out of 2^32 */
+	uint* rgicellTaken;   /* Hash set of taken cans (cell + 1; 0 is empty) */
+	uint  cTakenSlots;    /* A power of two */
+
+	/* Session trace for RobbyClean's cycle detection, if enabled */
+	uint* rgnVisit;       /* Per cell: stamp of Robby's last visit */
+	uint  nStampNext;     /* Stamps below this belong to earlier sessions */
+	uint  maxSteps;
+	int*  rgnScoreAt;     /* Per step: score before the step */
+	uint* rgicellAt;      /* Per step: Robby's cell before the step */
+	uint64_t* rgnSeen;    /* If set, RobbyClean marks the state of each step */
+	uint64_t cActionsRun;     /* Actions accounted for, in all sessions */
+	uint64_t cActionsSkipped; /* ...of which were fast-forwarded */
+#ifndef NEIGHBORHOOD_VON_NEUMANN
+	uint* rgicellView;    /* Per cell: the NEIGHBORHOOD_CELLS cells Robby
+	                       * perceives from it, in state digit order */
+	bool  bOwnsView;      /* False if rgicellView is borrowed from a template */
+#endif
+#ifdef INSTRUMENT
+	COUNTERS cnt;             /* Hit counts of sessions run on this world */
+#endif
 } WORLD; /* wld */
 
 
 /*
  * STATE represents Robby's view the world from a particular position within it.
  * It tells what is in the current cell and its adjacents cells, that is, the
- * cells directly above, to the left, to the right, and below.
+ * cells directly above, to the left, to the right, and below. Larger
+ * neighborhoods see more cells, which only show in the index.
  */
 typedef struct {
 	unsigned current:2; /* Each is a CELL, as CELLs fit in 2 bits */
@@ -49,17 +99,26 @@ typedef struct {
 	unsigned south:2;
 	unsigned east:2;
 	unsigned west:2;
-	unsigned index:8;   /* Index into actions table */
+	unsigned index:NEIGHBORHOOD_INDEX_BITS; /* Index into actions table */
 } STATE;
 
 /* Function prototypes */
 WORLD* WorldCreate(uint cx, uint cy);
 WORLD* WorldCreateFromFile(PCSZ pszFilename);
+WORLD* WorldLoad(PCSZ pszFilename, char* szError, size_t cchError);
+WORLD* WorldClone(WORLD const* pwldSource);
 void   WorldDestroy(WORLD* pwld);
 void   WorldDump(WORLD* pwld, FILE* out);
 void   WorldCopy(WORLD const* pwldSource, WORLD* pwldTarget);
-void   WorldSetCansRandomly(WORLD* pwld, double rProbability);
+void   WorldSetCansRandomly(WORLD* pwld, double rProbability, RNG* prng);
+void   WorldEnableUndo(WORLD* pwld, uint maxUndo);
+void   WorldEnableLazyCans(WORLD* pwld);
+void   WorldRemoveCan(WORLD* pwld, int x, int y);
+void   WorldRestoreLayout(WORLD* pwld);
+void   WorldEnableCycleDetection(WORLD* pwld, uint maxSteps);
+uint   WorldBeginTrace(WORLD* pwld, uint cSteps);
 CELL   WorldGetCell(WORLD* pwld, int x, int y);
 void   WorldSetCell(WORLD* pwld, int x, int y, CELL cell);
 STATE  WorldGetState(WORLD* pwld, int x, int y);
+STATE  WorldGetStateLazy(WORLD* pwld, int x, int y);
 STATE  WorldGetStateFromIndex(int index);